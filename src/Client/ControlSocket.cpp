@@ -104,7 +104,7 @@ void ControlSocket::_Execute(std::string s)
         std::stringstream ss;
         ss << "+OK";
         if(r.ret.size())
-            ss << ". r: [" << r.ret << "]";
+            ss << ". r: [" << r.ret.str() << "]";
         SendTelnetText(ss.str());
     }
     else
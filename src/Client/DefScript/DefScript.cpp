@@ -5,6 +5,7 @@
 #include <fstream>
 #include <sstream>
 #include <stdarg.h>
+#include <limits.h>
 #include "VarSet.h"
 #include "DefScript.h"
 
@@ -28,6 +29,7 @@ DefScriptPackage::DefScriptPackage()
         hLogfile << "DefScript engine execution log, compilation date: " __DATE__ "  " __TIME__ "\n\n" ;
     )
     _eventmgr=new DefScript_DynamicEventMgr(this);
+    _scriptcount=0;
     _InitFunctions();
 #   ifdef USING_DEFSCRIPT_EXTENSIONS
     _InitDefScriptInterface();
@@ -49,13 +51,18 @@ void DefScriptPackage::SetParentMethod(void *p)
 
 void DefScriptPackage::Clear(void)
 {
-    for(std::map<std::string,DefScript*>::iterator i = Script.begin(); i != Script.end(); i++)
+    for(DefScriptSymbolTable::iterator i = _symbols.begin(); i != _symbols.end(); i++)
     {
+        if(!i->second.script)
+            continue;
         lists.Unlink(SCRIPT_NAMESPACE + i->first); // remove name from the list storage
-        delete i->second; // delete each script
+        delete i->second.script; // delete each script
+        i->second.script = NULL;
     }
 
-	Script.empty();
+    _scriptcount=0;
+    _scriptlists.clear();
+    _filescripts.clear();
 }
 
 void DefScriptPackage::_InitFunctions(void)
@@ -105,6 +112,18 @@ void DefScriptPackage::_InitFunctions(void)
     AddFunc("strfind",&DefScriptPackage::func_strfind);
     AddFunc("funcexists",&DefScriptPackage::func_funcexists);
     AddFunc("scriptexists",&DefScriptPackage::func_scriptexists);
+    AddFunc("profstart",&DefScriptPackage::func_profstart);
+    AddFunc("profstop",&DefScriptPackage::func_profstop);
+    AddFunc("profreset",&DefScriptPackage::func_profreset);
+    AddFunc("profsummary",&DefScriptPackage::func_profsummary);
+    AddFunc("profflame",&DefScriptPackage::func_profflame);
+    AddFunc("madd",&DefScriptPackage::func_madd);
+    AddFunc("mremove",&DefScriptPackage::func_mremove);
+    AddFunc("mdelim",&DefScriptPackage::func_mdelim);
+    AddFunc("mmatch",&DefScriptPackage::func_mmatch);
+    AddFunc("mlen",&DefScriptPackage::func_mlen);
+    AddFunc("mexists",&DefScriptPackage::func_mexists);
+    AddFunc("mdelete",&DefScriptPackage::func_mdelete);
 
     // list functions
     AddFunc("lpushback",&DefScriptPackage::func_lpushback);
@@ -125,6 +144,27 @@ void DefScriptPackage::_InitFunctions(void)
     AddFunc("lerase",&DefScriptPackage::func_lerase);
     AddFunc("lsort",&DefScriptPackage::func_lsort);
 
+    // dict and set functions
+    AddFunc("dset",&DefScriptPackage::func_dset);
+    AddFunc("dget",&DefScriptPackage::func_dget);
+    AddFunc("dhas",&DefScriptPackage::func_dhas);
+    AddFunc("derase",&DefScriptPackage::func_derase);
+    AddFunc("dlen",&DefScriptPackage::func_dlen);
+    AddFunc("dexists",&DefScriptPackage::func_dexists);
+    AddFunc("ddelete",&DefScriptPackage::func_ddelete);
+    AddFunc("dkeys",&DefScriptPackage::func_dkeys);
+    AddFunc("dvalues",&DefScriptPackage::func_dvalues);
+    AddFunc("dtolist",&DefScriptPackage::func_dtolist);
+    AddFunc("dfromlist",&DefScriptPackage::func_dfromlist);
+    AddFunc("sadd",&DefScriptPackage::func_sadd);
+    AddFunc("shas",&DefScriptPackage::func_shas);
+    AddFunc("serase",&DefScriptPackage::func_serase);
+    AddFunc("slen",&DefScriptPackage::func_slen);
+    AddFunc("sexists",&DefScriptPackage::func_sexists);
+    AddFunc("sdelete",&DefScriptPackage::func_sdelete);
+    AddFunc("stolist",&DefScriptPackage::func_stolist);
+    AddFunc("sfromlist",&DefScriptPackage::func_sfromlist);
+
     // ByteBuffer functions
     AddFunc("bbinit",&DefScriptPackage::func_bbinit);
     AddFunc("bbdelete",&DefScriptPackage::func_bbdelete);
@@ -166,26 +206,39 @@ void DefScriptPackage::AddFunc(std::string n,DefReturnResult (DefScriptPackage::
 
 void DefScriptPackage::AddFunc(DefScriptFunctionEntry e)
 {
-    if( (!e.name.empty()) && (!HasFunc(e.name)) )
-        _functable.push_back(e);
+    if(e.name.empty())
+        return;
+    DefScriptSymbol *sym = _GetSymbol(e.name);
+    if(!sym->func)
+    {
+        sym->func=e.func;
+        sym->escape=e.escape;
+    }
 }
 
 bool DefScriptPackage::HasFunc(std::string n)
 {
-    for(DefScriptFunctionTable::iterator i=_functable.begin();i!=_functable.end();i++)
-        if(i->name==n)
-            return true;
-    return false;
+    DefScriptSymbol *sym = _FindSymbol(n);
+    return sym && sym->func;
 }
 
 void DefScriptPackage::DelFunc(std::string n)
 {
-    for(DefScriptFunctionTable::iterator i=_functable.begin();i!=_functable.end();i++)
-        if(i->name==n)
-        {
-            _functable.erase(i);
-            break;
-        }
+    DefScriptSymbol *sym = _FindSymbol(n);
+    if(sym)
+        sym->func=NULL;
+}
+
+// returns the symbol table entry for a name, creates an empty one if not present
+DefScriptSymbol *DefScriptPackage::_GetSymbol(const std::string& n)
+{
+    return &_symbols[n];
+}
+
+DefScriptSymbol *DefScriptPackage::_FindSymbol(const std::string& n)
+{
+    DefScriptSymbolTable::iterator it = _symbols.find(n);
+    return it == _symbols.end() ? NULL : &(it->second);
 }
 
 void DefScriptPackage::SetPath(std::string p){
@@ -193,11 +246,12 @@ void DefScriptPackage::SetPath(std::string p){
 }
 
 DefScript *DefScriptPackage::GetScript(std::string scname){
-    return ScriptExists(scname) ? Script[scname] : NULL;
+    DefScriptSymbol *sym = _FindSymbol(scname);
+    return sym ? sym->script : NULL;
 }
 
 unsigned int DefScriptPackage::GetScripts(void){
-    return Script.size();
+    return _scriptcount;
 }
 
 DefScript_DynamicEventMgr *DefScriptPackage::GetEventMgr(void)
@@ -207,20 +261,19 @@ DefScript_DynamicEventMgr *DefScriptPackage::GetEventMgr(void)
 
 bool DefScriptPackage::ScriptExists(std::string name)
 {
-    for (std::map<std::string,DefScript*>::iterator i = Script.begin();i != Script.end();i++)
-        if(i->first == name && i->second != NULL)
-            return true;
-    return false;
+    return GetScript(name) != NULL;
 }
 
 void DefScriptPackage::DeleteScript(std::string sn)
 {
     lists.Unlink(SCRIPT_NAMESPACE + sn); // remove name from the list storage
-    if(ScriptExists(sn))
+    DefScriptSymbol *sym = _FindSymbol(sn);
+    if(sym && sym->script)
     {
-
-        delete GetScript(sn); // delete the script itself
-        Script.erase(sn); // remove reference
+        _scriptlists.erase(&(sym->script->Line));
+        delete sym->script; // delete the script itself
+        sym->script = NULL; // remove reference
+        _scriptcount--;
     }
 }
 
@@ -239,7 +292,7 @@ bool DefScriptPackage::LoadScriptFromFile(std::string fn){
     bool commented = false;
     bool escape_all = false;
     char z;
-    unsigned int absline=0;
+    unsigned int absline=0, nextline=1; // number of the current/next line in the file
     DefScript *curScript = NULL;
 
     f.open(fn.c_str(),std::ios_base::in);
@@ -257,21 +310,30 @@ bool DefScriptPackage::LoadScriptFromFile(std::string fn){
     ppos = fn.length();
     sn = stringToLower(fn.substr(slashpos+1,(ppos-slashpos-1)));
     _UpdateOrCreateScriptByName(sn);
-    curScript=Script[sn];
+    curScript=GetScript(sn);
+    std::set<std::string> defined; // names of all scripts in this file
+    defined.insert(sn);
 
     DeleteScript(sn + SN_ONLOAD);
 
 	while(!f.eof())
     {
 		line.clear();
+        absline=nextline;
         while (true)
         {
             f.get(z);
-            if(z=='\n' || z==10 || z==13 || f.eof()) // checking for all just to be sure
+            if(f.eof())
+                break;
+            if(z=='\n') // only this one counts, "\r\n" would be two lines otherwise
+            {
+                nextline++;
+                break;
+            }
+            if(z==13)
                 break;
             line+=z;
         }
-        absline++;
 		if(line.empty())
 			continue; // line is empty, proceed with next line
 		while( !line.empty() && (line.at(0)==' ' || line.at(0)=='\t') )
@@ -335,8 +397,9 @@ bool DefScriptPackage::LoadScriptFromFile(std::string fn){
                     DeleteScript(curScript->GetName());
                 sn = stringToLower(value);
                 _UpdateOrCreateScriptByName(sn);
+                defined.insert(sn);
                 _DEFSC_DEBUG(PRINT_DEBUG("DefScript: now loading '%s'",sn.c_str()));
-                curScript=Script[sn];
+                curScript=GetScript(sn);
             }
             else if(label=="linestrip")
             {
@@ -354,13 +417,13 @@ bool DefScriptPackage::LoadScriptFromFile(std::string fn){
             else if(line=="onload")
             {
                 _UpdateOrCreateScriptByName(sn + SN_ONLOAD);
-                curScript=Script[sn + SN_ONLOAD];
+                curScript=GetScript(sn + SN_ONLOAD);
             }
             else if(line=="endonload" || line=="/onload")
             {
                 RunScript(sn + SN_ONLOAD,NULL,sn);
                 DeleteScript(sn + SN_ONLOAD);
-                curScript=Script[sn];
+                curScript=GetScript(sn);
             }
             else if(line=="cs" || line=="comments-start")
             {
@@ -368,7 +431,7 @@ bool DefScriptPackage::LoadScriptFromFile(std::string fn){
             }
             else if(strncmp(line.c_str(),"tag",3)==0 || strncmp(line.c_str(),"mark",4)==0)
             {
-                curScript->AddLine("#" + line);
+                curScript->AddLine("#" + line, absline);
             }
 
             //...
@@ -455,19 +518,180 @@ bool DefScriptPackage::LoadScriptFromFile(std::string fn){
             continue; // continue with next line without adding the current line to script
         }
 
-        curScript->AddLine(line);
+        curScript->AddLine(line, absline);
 	}
 	f.close();
-    if(cantload || Blocks.size())
+    bool ok = !(cantload || Blocks.size());
+    if(!ok)
     {
         PRINT_ERROR("DefScript: Error loading file '%s'. block mismatch?",fn.c_str());
         DeleteScript(sn);
-        return false;
     }
+
+    // remember which scripts came from this file, to reload or remove them when it changes
+    std::set<std::string>& fs = _filescripts[_FileKey(fn)];
+    fs.clear();
+    for(std::set<std::string>::iterator it = defined.begin(); it != defined.end(); it++)
+        if(GetScript(*it))
+            fs.insert(*it);
+    if(!ok)
+        return false;
 	
 	// ...
     return true;
 }
+
+// the same file must give the same key, whether it was loaded as "./scripts/x.def" or reported as "scripts/x.def".
+// only the directory is resolved, so that a file that was deleted meanwhile still gets its old key.
+std::string DefScriptPackage::_FileKey(const std::string& fn)
+{
+    std::string::size_type slashpos = fn.find_last_of("\\/");
+    std::string dir = slashpos == std::string::npos ? "." : fn.substr(0, slashpos + 1);
+    std::string name = slashpos == std::string::npos ? fn : fn.substr(slashpos + 1);
+#if PLATFORM == PLATFORM_WIN32
+    char buf[_MAX_PATH];
+    if(_fullpath(buf, dir.c_str(), _MAX_PATH))
+        return stringToLower(std::string(buf) + '\\' + name);
+#else
+    char buf[PATH_MAX];
+    if(realpath(dir.c_str(), buf))
+        return std::string(buf) + '/' + name;
+#endif
+    return fn;
+}
+
+// start reloading the script files in this directory as soon as they change on disk, see UpdateWatch()
+bool DefScriptPackage::WatchPath(std::string dir)
+{
+    return _watcher.Watch(dir);
+}
+
+// must be called regularly. reloads the watched script files that were changed or added since the last call,
+// and removes the scripts of files that were deleted. scripts from other files are not touched.
+void DefScriptPackage::UpdateWatch(void)
+{
+    if(!_watcher.IsActive())
+        return;
+    std::set<std::string> files;
+    if(!_watcher.Poll(files))
+        PRINT_ERROR("DefScript: WARNING: too many file changes at once, some changed scripts may not be reloaded");
+    for(std::set<std::string>::iterator it = files.begin(); it != files.end(); it++)
+    {
+        std::fstream f;
+        f.open(it->c_str(),std::ios_base::in);
+        if(f.is_open())
+        {
+            f.close();
+            _ReloadFile(*it);
+        }
+        else
+            _UnloadFile(*it);
+    }
+}
+
+// hooks that other scripts installed into the scripts of the file are moved over to the new scripts.
+// hooks that the scripts of the file installed elsewhere are removed, its #onload code installs them again if it still wants to.
+// calls to the reloaded scripts need no update, they find scripts by name.
+void DefScriptPackage::_ReloadFile(const std::string& fn)
+{
+    std::set<std::string> old = _filescripts[_FileKey(fn)];
+    std::map<std::string,DefList> hooks;
+    for(std::set<std::string>::iterator it = old.begin(); it != old.end(); it++)
+        if(DefScript *sc = GetScript(*it))
+            _TakeHooks(sc, old, hooks[*it]);
+    _RemoveHooks(old);
+
+    bool ok = LoadScriptFromFile(fn);
+    std::set<std::string>& now = _filescripts[_FileKey(fn)];
+    if(ok)
+    {
+        for(std::set<std::string>::iterator it = old.begin(); it != old.end(); it++)
+            if(now.find(*it) == now.end()) // no longer in the file
+                DeleteScript(*it);
+    }
+    for(std::map<std::string,DefList>::iterator it = hooks.begin(); it != hooks.end(); it++)
+    {
+        DefScript *sc = GetScript(it->first);
+        if(!sc || it->second.empty())
+            continue;
+        if(sc->_srcline.size()==sc->Line.size()) // hooks come from other files, they have no line numbers here
+            sc->_srcline.resize(sc->Line.size() + it->second.size(), 0);
+        sc->Line.insert(sc->Line.end(), it->second.begin(), it->second.end());
+        sc->_compiled=false;
+    }
+
+    if(ok)
+        PRINT("DefScript: %s '%s' (%u scripts)",old.empty() ? "Loaded" : "Reloaded",fn.c_str(),(unsigned int)now.size());
+    else
+        PRINT_ERROR("DefScript: Could not reload '%s'",fn.c_str());
+}
+
+void DefScriptPackage::_UnloadFile(const std::string& fn)
+{
+    std::map<std::string,std::set<std::string> >::iterator fi = _filescripts.find(_FileKey(fn));
+    if(fi == _filescripts.end())
+        return;
+    _RemoveHooks(fi->second);
+    for(std::set<std::string>::iterator it = fi->second.begin(); it != fi->second.end(); it++)
+        DeleteScript(*it);
+    PRINT("DefScript: Unloaded '%s' (%u scripts)",fn.c_str(),(unsigned int)fi->second.size());
+    _filescripts.erase(fi);
+}
+
+// moves the hook blocks ("#tag:hook:<name>" up to "#tag:hook-end") out of a script, except those installed by the given scripts
+void DefScriptPackage::_TakeHooks(DefScript *sc, const std::set<std::string>& except, DefList& out)
+{
+    bool take = false, changed = false;
+    for(DefList::iterator it = sc->Line.begin(); it != sc->Line.end(); )
+    {
+        if(!strncmp(it->c_str(), "#tag:hook:", 10))
+            take = except.find(stringToLower(it->substr(10))) == except.end();
+        if(!take)
+        {
+            it++;
+            continue;
+        }
+        take = *it != "#tag:hook-end";
+        out.push_back(*it);
+        if(sc->_srcline.size()==sc->Line.size())
+            sc->_srcline.erase(sc->_srcline.begin() + (it - sc->Line.begin()));
+        it = sc->Line.erase(it);
+        changed = true;
+    }
+    if(changed)
+        sc->_compiled=false; // the line numbers are kept, other than after _ListChanged()
+}
+
+// removes the hook blocks the given scripts installed, from all scripts
+void DefScriptPackage::_RemoveHooks(const std::set<std::string>& by)
+{
+    if(by.empty())
+        return;
+    for(DefScriptSymbolTable::iterator si = _symbols.begin(); si != _symbols.end(); si++)
+    {
+        DefScript *sc = si->second.script;
+        if(!sc)
+            continue;
+        bool erase = false, changed = false;
+        for(DefList::iterator it = sc->Line.begin(); it != sc->Line.end(); )
+        {
+            if(!strncmp(it->c_str(), "#tag:hook:", 10))
+                erase = by.find(stringToLower(it->substr(10))) != by.end();
+            if(!erase)
+            {
+                it++;
+                continue;
+            }
+            erase = *it != "#tag:hook-end";
+            if(sc->_srcline.size()==sc->Line.size())
+                sc->_srcline.erase(sc->_srcline.begin() + (it - sc->Line.begin()));
+            it = sc->Line.erase(it);
+            changed = true;
+        }
+        if(changed)
+            sc->_compiled=false;
+    }
+}
 	
 
 // --- SECTION FOR THE INDIVIDUAL SCRIPTS IN A PACKAGE ---
@@ -477,6 +701,8 @@ DefScript::DefScript(DefScriptPackage *p)
     _parent=p;
 	scriptname="{NONAME}";
     debugmode=false;
+    _compiled=false;
+    _running=0;
 }
 
 DefScript::~DefScript()
@@ -487,6 +713,9 @@ DefScript::~DefScript()
 void DefScript::Clear(void)
 {
     Line.clear();
+    _srcline.clear();
+    _code.clear();
+    _compiled=false;
 }
 
 void DefScript::SetDebug(bool d)
@@ -509,10 +738,13 @@ std::string DefScript::GetName(void)
 	return scriptname;
 }
 
-bool DefScript::AddLine(std::string l){
+bool DefScript::AddLine(std::string l, unsigned int srcline){
 	if(l.empty())
 		return false;
+    if(_srcline.size()==Line.size())
+        _srcline.push_back(srcline);
     Line.push_back(l);
+    _compiled=false;
 	return true;
 }
 
@@ -534,6 +766,38 @@ void CmdSet::Clear()
     defaultarg="";
     caller="";
     myname="";
+    _argvals.clear();
+    _defaultval.clear();
+}
+
+// converts numeric-looking arguments now. used for compiled lines, every copy of the set has the numbers then.
+void CmdSet::CacheValues(void)
+{
+    _argvals.clear();
+    for(_CmdSetArgMap::iterator i=arg.begin(); i!=arg.end(); i++)
+    {
+        DefValue v(i->second);
+        if(v.Cache())
+            _argvals[i->first]=v;
+    }
+    DefValue v(defaultarg);
+    _defaultval = v.Cache() ? v : DefValue();
+}
+
+const DefValue& CmdSet::ArgValue(unsigned int i)
+{
+    DefValue& v=_argvals[i];
+    const std::string& a=arg[i];
+    if(v.str()!=a) // changed since the value was made, or made by a function before
+        v=a;
+    return v;
+}
+
+const DefValue& CmdSet::DefaultValue(void)
+{
+    if(_defaultval.str()!=defaultarg)
+        _defaultval=defaultarg;
+    return _defaultval;
 }
 
 
@@ -550,18 +814,11 @@ bool DefScriptPackage::BoolRunScript(std::string name, CmdSet *pSet)
 // the referred pSet is the parent from which RunScript() has been called
 DefReturnResult DefScriptPackage::RunScript(std::string name, CmdSet *pSet,std::string override_name)
 {
-    DefReturnResult r;
-    if( (!ScriptExists(name)) && (!HasFunc(name)) )
-    {
-        r.ok=false; // doesnt exist
-        r.ret="";
-        return r;
-    }
-
     DefScript *sc = GetScript(name);
     if(!sc)
     {
-        r.ok=false;
+        DefReturnResult r;
+        r.ok=false; // doesnt exist
         r.ret="";
         return r;
     }
@@ -569,6 +826,43 @@ DefReturnResult DefScriptPackage::RunScript(std::string name, CmdSet *pSet,std::
     if(!override_name.empty())
         name=override_name;
 
+    return _RunScript(sc,name,pSet);
+}
+
+// where a line that turned into "if" (false) or "exitloop" only at runtime continues: after the next "else"/"endif"
+// or "endloop" on the same level, looking at the raw lines like the line-based interpreter. the end of the script if there is none.
+unsigned int DefScriptPackage::_SkipDynamicBlock(DefScript *sc, unsigned int i, bool loop)
+{
+    unsigned int depth=0;
+    for(i++; i<sc->Line.size(); i++)
+    {
+        const std::string& line=sc->Line[i];
+        if(loop)
+        {
+            if(line=="loop")
+                depth++;
+            else if(line=="endloop" && !depth--)
+                return i+1;
+        }
+        else
+        {
+            if(!line.compare(0,3,"if "))
+                depth++;
+            else if(line=="else" || line=="endif")
+            {
+                if(!depth)
+                    return i+1;
+                if(line=="endif")
+                    depth--;
+            }
+        }
+    }
+    return sc->Line.size();
+}
+
+DefReturnResult DefScriptPackage::_RunScript(DefScript *sc, std::string name, CmdSet *pSet)
+{
+    DefReturnResult r;
     CmdSet temp;
     if(!pSet)
     {
@@ -577,152 +871,122 @@ DefReturnResult DefScriptPackage::RunScript(std::string name, CmdSet *pSet,std::
     pSet->caller=pSet->myname;
     pSet->myname=name;
 
-    std::deque<Def_Block> Blocks;
     CmdSet mySet;
-    std::string line;
+    unsigned char op;
+    unsigned int jump;
+    DefProfScope profscript(_profiler,DEFPROF_SCRIPT,name);
 
-    for(unsigned int i=0;i<sc->GetLines();i++)
-    {   
-        line=sc->GetLine(i);
-        if(line.empty() || line[0] == '#') // skip markers and preload statements if not removed before
-            continue;
-        if(line=="else")
+    sc->_running++; // a recompile while running keeps the old code alive, ins stays valid
+
+    // the script may be changed by any command it executes (hooks, appenddef, ...).
+    // recompile then and continue at the same line, just like the line-based interpreter did.
+    for(unsigned int i=0; ; )
+    {
+        if(!_IsCompiled(sc))
+            _CompileScript(sc);
+        if(i >= sc->_code.size())
+            break;
+
+        const DefScriptInstruction& ins = sc->_code[i];
+        op = ins.op;
+        jump = ins.jump;
+        switch(op)
         {
-            if(!Blocks.size())
-            {
-                PRINT_ERROR("DEBUG: else-block without any block?! [%s:%u]",name.c_str(),i);
-                r.ok=false;
-                break;
-            }
-            Def_Block b=Blocks.back();
-            if(b.type==BLOCK_IF && b.istrue)
-            {
-                unsigned int other_ifs=0;
-                for(i=b.startline+1;;i++)
-                {
-                    if(memcmp(sc->GetLine(i).c_str(),"if ",3)==0)
-                        other_ifs++;
-                    else if(sc->GetLine(i)=="endif")
-                    {
-                        if(!other_ifs)
-                            break;
-                        other_ifs--;
-                    }
-                }
-                i--; // next line read will be "endif", decide then what to do
-            }
-            continue;
+            case DEFOP_NOP:
+                i++;
+                continue;
+            case DEFOP_ELSE:
+            case DEFOP_ENDLOOP:
+                i = jump;
+                continue;
+            case DEFOP_EXITLOOP:
+                i = jump; // the line after "endloop"
+                continue;
         }
-        else if(line=="endif")
+        if(op==DEFOP_ERROR)
         {
-            if(!Blocks.size())
-            {
-                PRINT_ERROR("DEBUG: endif without any block [%s:%u]",name.c_str(),i);
-                r.ok=false;
-                break;
-            }
-            if(Blocks.back().type!=BLOCK_IF)
-            {
-                PRINT_ERROR("DEBUG: endif: closed block is not an if block! [%s:%u]",name.c_str(),i);
-                r.ok=false;
-                break;
-            }
-            Blocks.pop_back();
-            continue;
-        }
-        else if(line=="loop")
-        {
-            Def_Block b;
-            b.startline=i;
-            b.type=BLOCK_LOOP;
-            b.istrue=true;
-            Blocks.push_back(b);
-            continue;
+            PRINT_ERROR("DEBUG: %s [%s:%u]",ins.text.c_str(),name.c_str(),i);
+            r.ok=false;
+            break;
         }
-        else if(line=="endloop")
+        DefProfScope profline(_profiler,DEFPROF_LINE,name,ins.srcline ? (int)ins.srcline : -(int)(i+1)); // until the next iteration starts
+
+        _PrepareSet(ins,mySet,pSet);
+
+        if(op==DEFOP_IF)
         {
-            if(!Blocks.size())
-            {
-                PRINT_ERROR("DEBUG: endloop without any block [%s:%u]",name.c_str(),i);
-                r.ok=false;
-                break;
-            }
-            if(Blocks.back().type!=BLOCK_LOOP)
-            {
-                PRINT_ERROR("DEBUG: endloop: closed block is not a loop block! [%s:%u]",name.c_str(),i);
-                r.ok=false;
-                break;
-            }
-            i=Blocks.back().startline; // next line executed will be the line after "loop"
+            i = isTrue(mySet.defaultarg) ? i+1 : jump;
             continue;
         }
-        //_DEFSC_DEBUG(printf("DefScript before: \"%s\"\n",line.c_str()));
-        DefXChgResult final=ReplaceVars(line,pSet,0,true);
-        //_DEFSC_DEBUG(printf("DefScript parsed: \"%s\"\n",final.str.c_str()));
-        mySet.Clear();
-	    SplitLine(mySet,final.str);
-        if(mySet.cmd=="if")
-        {
-            Def_Block b;
-            b.startline=i;
-            b.type=BLOCK_IF;
-            b.istrue=isTrue(mySet.defaultarg);
-            Blocks.push_back(b);
-            if(!b.istrue)
-            {
-                unsigned int other_ifs=0;
-                for(i=b.startline+1; i < sc->GetLines() ;i++)
-                {
-                    if(!memcmp(sc->GetLine(i).c_str(),"if ",3))
-                        other_ifs++;
-                    if(sc->GetLine(i)=="else" || sc->GetLine(i)=="endif")
-                    {
-                        if(!other_ifs)
-                            break;
-                        if(sc->GetLine(i)=="endif")
-                            other_ifs--;
-                    }
-                }
-                i--; // next line read will be either "else" or "endif", decide then what to do
-            }
-            continue; // and read line after "else"
-        }
-        else if(mySet.cmd=="exitloop")
+        if(op==DEFOP_LINE && (mySet.cmd=="if" || mySet.cmd=="exitloop"))
         {
-            // skip some ifs if they are present
-            while(Blocks.back().type!=BLOCK_LOOP)
-                Blocks.pop_back();
-            Blocks.pop_back();
-            unsigned int other_loops=0;
-
-            while(true)
-            {
-                if(sc->GetLine(i)=="loop")
-                    other_loops++;
-                if(sc->GetLine(i)=="endloop")
-                {
-                    if(!other_loops)
-                        break;
-                    other_loops--;
-                }
-                i++; // go until next endloop
-            }
-            // next line read will be the line after "endloop"
+            // the compiler could not see these, their blocks are found the way the line-based interpreter did
+            if(mySet.cmd=="exitloop")
+                i = _SkipDynamicBlock(sc,i,true);
+            else
+                i = isTrue(mySet.defaultarg) ? i+1 : _SkipDynamicBlock(sc,i,false);
             continue;
         }
 
         mySet.myname=name;
         mySet.caller=pSet?pSet->myname:"";
-        r=Interpret(mySet);
+        r = _CallInstruction(ins,mySet);
         if(r.mustreturn)
         {
             r.mustreturn=false;
             break;
         }
+        i++;
     }
+    if(!--sc->_running)
+        sc->_retired.clear();
     return r;
 }
 
+// builds the CmdSet of a compiled line, only the parts that contain variables are replaced + split here
+void DefScriptPackage::_PrepareSet(const DefScriptInstruction& ins, CmdSet& mySet, CmdSet *pSet)
+{
+    if(ins.dynamic || ins.op==DEFOP_LINE)
+    {
+        DefXChgResult final = ins.tpl.valid ? _ReplaceTemplate(ins.tpl,ins.tpl.first,ins.tpl.count,pSet,DEFSCRIPT_NONE,true)
+                                            : ReplaceVars(ins.text,pSet,0,true);
+        mySet.Clear();
+        SplitLine(mySet,final.str);
+    }
+    else
+    {
+        mySet = ins.set;
+        if(ins.defvars)
+        {
+            DefXChgResult final = ins.tpl.valid ? _ReplaceTemplate(ins.tpl,ins.tpl.first,ins.tpl.count,pSet,DEFSCRIPT_NONE,true)
+                                                : ReplaceVars(ins.set.defaultarg,pSet,0,true);
+            if(final.str.empty() && mySet.arg.empty())
+                mySet.arg[0]=ins.text;
+            mySet.defaultarg = RemoveBracketsFromString(final.str);
+            if(final.value) // "add,x ${y}" and the like, keep the numeric forms of y
+                mySet._defaultval = *final.value;
+        }
+    }
+}
+
+// runs a compiled line that calls something (DEFOP_CALL, DEFOP_RETURN, DEFOP_LINE) with the set from _PrepareSet()
+DefReturnResult DefScriptPackage::_CallInstruction(const DefScriptInstruction& ins, CmdSet& mySet)
+{
+    if(ins.op==DEFOP_LINE)
+        return Interpret(mySet);
+    DefScriptSymbol *sym = ins.sym;
+    if(sym->func)
+        return _CallFunc(sym->func,sym->escape,mySet);
+    if(ins.op==DEFOP_RETURN)
+    {
+        DefReturnResult r;
+        r.mustreturn=true;
+        r.ret=mySet.DefaultValue();
+        return r;
+    }
+    return _CallScript(sym,mySet);
+}
+
 DefReturnResult DefScriptPackage::RunSingleLine(std::string line)
 {
     DefXChgResult final=ReplaceVars(line,NULL,0,true);
@@ -740,6 +1004,17 @@ DefReturnResult DefScriptPackage::RunSingleLineFromScript(std::string line, DefS
     return Interpret(Set);
 }
 
+// runs a line from _CompileLine() like RunSingleLine() does, or like RunSingleLineFromScript() if pScript is given
+DefReturnResult DefScriptPackage::_RunCompiledLine(const DefScriptInstruction& ins, DefScript *pScript)
+{
+    CmdSet Set, scope;
+    if(pScript)
+        scope.myname=pScript->GetName();
+    _PrepareSet(ins,Set,pScript ? &scope : NULL);
+    Set.myname=scope.myname;
+    return _CallInstruction(ins,Set);
+}
+
 void DefScriptPackage::SplitLine(CmdSet& Set,std::string line)
 {	
 	
@@ -875,24 +1150,38 @@ void DefScriptPackage::UnescapeSet(CmdSet& Set)
 
 DefXChgResult DefScriptPackage::ReplaceVars(std::string str, CmdSet *pSet, unsigned char VarType, bool run_embedded)
 {
+    DefReplaceState st;
+    DefXChgResult xchg;
+    if(str.find_first_of("{}") == std::string::npos) // nothing to replace, the parser would only skip escaped chars
+    {
+        if(VarType!=DEFSCRIPT_NONE)
+            _ResolveVar(str,xchg,pSet,VarType,run_embedded);
+        xchg.str = str;
+        return xchg;
+    }
+    return _ReplaceVarsFrom(str,0,st,xchg,pSet,VarType,run_embedded);
+}
 
+// the parser behind ReplaceVars(), starting at position i with the given state.
+// xchg is the result of the last nested replacement.
+DefXChgResult DefScriptPackage::_ReplaceVarsFrom(std::string& str, unsigned int i, DefReplaceState& st, DefXChgResult& xchg, CmdSet *pSet, unsigned char VarType, bool run_embedded)
+{
     unsigned int
-        openingBracket=0, // defines the position from where the recursive call is started
+        &openingBracket=st.openingBracket,
         closingBracket=0, // the closing bracket
-        bracketsOpen=0, // amount of brackets opened
+        &bracketsOpen=st.bracketsOpen,
         bLen=0; // the lenth of the string in brackets, e.g. ${abc} == 3
 
-    unsigned char 
-        nextVar=DEFSCRIPT_NONE; // '$' or '?'
+    unsigned char
+        &nextVar=st.nextVar;
     bool
-        hasChanged=false, // additional helper. once true, xchg.result will be true later also
-        hasVar=false, // true if openingBracket (= the first bracket) was preceded by '$' or '?'
-        escaped=false;
+        &hasChanged=st.hasChanged,
+        &hasVar=st.hasVar,
+        &escaped=st.escaped;
 
     std::string subStr;
-    DefXChgResult xchg;
 
-    for(unsigned int i=0;i<str.length();i++)
+    for(;i<str.length();i++)
     {
         if(escaped)
         {
@@ -964,94 +1253,186 @@ DefXChgResult DefScriptPackage::ReplaceVars(std::string str, CmdSet *pSet, unsig
            continue;
        }
     } // end for
+    xchg.value=NULL;
     if(!bracketsOpen && VarType!=DEFSCRIPT_NONE)
+        _ResolveVar(str,xchg,pSet,VarType,run_embedded);
+
+    xchg.str = str;
+    if(hasChanged)
+        xchg.changed=true;
+    return xchg;
+}
+
+// gives the same result as ReplaceVars() on the string the template was compiled from.
+// slots are resolved from left to right and their values concatenated with the text between them,
+// values the parser would have to look at again hand the rest of the string over to it.
+DefXChgResult DefScriptPackage::_ReplaceTemplate(const DefTemplate& tpl, unsigned int first, unsigned int count, CmdSet *pSet, unsigned char VarType, bool run_embedded)
+{
+    std::string str;
+    DefXChgResult xchg;
+    const DefValue *value=NULL;
+    unsigned int last=first+count;
+    for(unsigned int p=first; p<last; p++)
     {
-        // fix for empty var: ${}
-        if(str.empty())
+        const DefTemplatePart& part = tpl.parts[p];
+        if(part.type==DEFSCRIPT_NONE)
         {
-            xchg.str="";
-            xchg.changed=true;
-            return xchg;
+            str+=part.text;
+            continue;
+        }
+        if(part.resolve==DEFTPL_PLAIN)
+        {
+            xchg=DefXChgResult();
+            xchg.str=part.name;
+            _ResolveVar(xchg.str,xchg,pSet,part.type,run_embedded,&part);
+            value=xchg.value;
+        }
+        else if(part.resolve==DEFTPL_PARTS)
+            xchg=_ReplaceTemplate(tpl,part.first,part.count,pSet,part.type,run_embedded);
+        else
+            xchg=ReplaceVars(part.name,pSet,part.type,run_embedded);
+
+        if(!xchg.changed) // unknown var, stays as it is
+            str+=part.text;
+        else if(xchg.str.find_first_of("{}\\",1)==std::string::npos) // the parser skips the first char of a value
+            str+=xchg.str;
+        else
+        {
+            DefReplaceState st;
+            unsigned int i=str.length();
+            st.openingBracket=i+1;
+            str+=xchg.str;
+            for(p++; p<last; p++)
+                str+=tpl.parts[p].text;
+            st.escaped = i<str.length() && str[i]=='\\';
+            return _ReplaceVarsFrom(str,i+1,st,xchg,pSet,VarType,run_embedded);
         }
-        if(VarType==DEFSCRIPT_VAR)
+    }
+    xchg.value = count==1 ? value : NULL; // the string is one variable and nothing else
+    if(VarType!=DEFSCRIPT_NONE)
+        _ResolveVar(str,xchg,pSet,VarType,run_embedded);
+    xchg.str = str;
+    return xchg;
+}
+
+// resolves the name of a ${..} or ?{..} once all brackets inside were replaced.
+// part is the template slot str comes from if its name is plain text, it has the name prepared
+void DefScriptPackage::_ResolveVar(std::string& str, DefXChgResult& xchg, CmdSet *pSet, unsigned char VarType, bool run_embedded, const DefTemplatePart *part)
+{
+    xchg.value=NULL;
+    // fix for empty var: ${}
+    if(str.empty())
+    {
+        xchg.str="";
+        xchg.changed=true;
+        return;
+    }
+    if(VarType==DEFSCRIPT_VAR)
+    {
+        // compiled slots keep the Var they found, the name is only built and looked up again
+        // after variables were created or freed
+        if(part && part->var[0]!='@')
         {
-            std::string vname=_NormalizeVarName(str, (pSet==NULL) ? "" : pSet->myname);
-            if(vname[0]=='@')
+            static const std::string noowner;
+            const std::string& owner = (part->global || !pSet) ? noowner : pSet->myname;
+            DefVarCache& c = part->cache;
+            if(!c.valid || c.gen!=variables.Generation() || c.owner!=owner)
             {
-                std::stringstream vns;
-                std::string subs=vname.substr(1,str.length()-1);
-                unsigned int vn=atoi( subs.c_str() );
-                vns << vn;
-                if(pSet && vns.str()==subs) // resolve arg macros @0 - @4294967295
-                    str=pSet->arg[vn];
-                else if(pSet && subs=="def")
-                    str=pSet->defaultarg;
-                else if(pSet && subs=="myname")
-                    str=pSet->myname;
-                else if(pSet && subs=="cmd")
-                    str=pSet->cmd;
-                else if(pSet && subs=="caller")
-                    str=pSet->caller;
-                else if(subs=="n")
-                    str="\n";
-                else if(subs=="clock")
-                {
-                    std::stringstream clock_s;
-                    clock_s << clock();
-                    str = clock_s.str();
-                }
-                else if(subs=="time")
-                {
-                    std::stringstream time_s;
-                    time_s << time(NULL);
-                    str = time_s.str();
-                }
-                else if(variables.Exists(vname))
-                    str=variables.Get(vname);
-                else
-                {
-                    // TODO: call custom macro table
-                    //...
-                    str.clear();
-                }
+                c.var=variables.Find(owner.empty() ? part->var : owner+"::"+part->var);
+                c.gen=variables.Generation();
+                c.owner=owner;
+                c.valid=true;
+            }
+            if(c.var && c.var->IsSet())
+            {
+                str=c.var->value.str();
+                xchg.value=&c.var->value;
                 xchg.changed=true;
             }
+            return;
+        }
+        std::string vname;
+        if(!part)
+            vname=_NormalizeVarName(str, (pSet==NULL) ? "" : pSet->myname);
+        else
+            vname=part->var; // an @ macro
+        if(vname[0]=='@')
+        {
+            std::stringstream vns;
+            std::string subs=vname.substr(1,str.length()-1);
+            unsigned int vn=atoi( subs.c_str() );
+            vns << vn;
+            if(pSet && vns.str()==subs) // resolve arg macros @0 - @4294967295
+                str=pSet->arg[vn];
+            else if(pSet && subs=="def")
+                str=pSet->defaultarg;
+            else if(pSet && subs=="myname")
+                str=pSet->myname;
+            else if(pSet && subs=="cmd")
+                str=pSet->cmd;
+            else if(pSet && subs=="caller")
+                str=pSet->caller;
+            else if(subs=="n")
+                str="\n";
+            else if(subs=="clock")
+            {
+                std::stringstream clock_s;
+                clock_s << clock();
+                str = clock_s.str();
+            }
+            else if(subs=="time")
+            {
+                std::stringstream time_s;
+                time_s << time(NULL);
+                str = time_s.str();
+            }
+            else if(Var *v = variables.Find(vname))
+            {
+                str=v->value.str(); // empty if unset
+                xchg.value=&v->value;
+            }
             else
             {
-                if(variables.Exists(vname))
-                {
-                    str=variables.Get(vname);
-                    xchg.changed=true;
-                }
+                // TODO: call custom macro table
+                //...
+                str.clear();
             }
+            xchg.changed=true;
         }
-        else if(VarType==DEFSCRIPT_FUNC)
+        else
         {
-            if(run_embedded)
+            Var *v = variables.Find(vname);
+            if(v && v->IsSet())
             {
-                DefReturnResult res;
-                if(pSet)
-                    res=RunSingleLineFromScript(str,GetScript(pSet->myname));
-                else
-                    res=RunSingleLine(str);
-                str=res.ret; // returns empty string on invalid function!!
-                xchg.result.ok=res.ok;
+                str=v->value.str();
+                xchg.value=&v->value;
                 xchg.changed=true;
-                //xchg.result.err += res.err;
-            }
-            else // if not allowed to run scripts via ?{...}
-            {
-                str=""; // just replace with 0
-                xchg.changed=true; // yes we have changed something
-                xchg.result.ok=true; // change ok, insert our (empty) return value
             }
         }
     }
-
-    xchg.str = str;
-    if(hasChanged)
-        xchg.changed=true;
-    return xchg;
+    else if(VarType==DEFSCRIPT_FUNC)
+    {
+        if(run_embedded)
+        {
+            DefReturnResult res;
+            if(part && part->code)
+                res=_RunCompiledLine(*part->code,pSet ? GetScript(pSet->myname) : NULL);
+            else if(pSet)
+                res=RunSingleLineFromScript(str,GetScript(pSet->myname));
+            else
+                res=RunSingleLine(str);
+            str=res.ret.str(); // returns empty string on invalid function!!
+            xchg.result.ok=res.ok;
+            xchg.changed=true;
+            //xchg.result.err += res.err;
+        }
+        else // if not allowed to run scripts via ?{...}
+        {
+            str=""; // just replace with 0
+            xchg.changed=true; // yes we have changed something
+            xchg.result.ok=true; // change ok, insert our (empty) return value
+        }
+    }
 }
 
 std::string DefScriptPackage::_NormalizeVarName(std::string vn, std::string sn)
@@ -1093,19 +1474,9 @@ DefReturnResult DefScriptPackage::Interpret(CmdSet& Set)
     DefReturnResult result;
 
     // first search if the script is defined in the internal functions
-    for(unsigned int i=0;i<_functable.size();i++)
-    {
-        if(Set.cmd==_functable[i].name)
-        {
-            if(_functable[i].escape) // if we are going to use a C++ function, unescape the whole set, if supposed to do so.
-                UnescapeSet(Set);    // it will not have any bad side effects, we leave the func within this block!
-            
-            result=(this->*(_functable[i].func))(Set);
-            if(_functable[i].escape)
-                result.ret = EscapeString(result.ret); // and since we are returning a string into the engine, escape it again, if set.
-            return result;
-        }
-    }
+    DefScriptSymbol *sym = _FindSymbol(Set.cmd);
+    if(sym && sym->func)
+        return _CallFunc(sym->func,sym->escape,Set);
 
     if(Set.cmd=="return")
     {
@@ -1115,11 +1486,30 @@ DefReturnResult DefScriptPackage::Interpret(CmdSet& Set)
     }
 
     // if nothing has been found its maybe an external script file to run
-	result=RunScript(Set.cmd, &Set);
+    return _CallScript(sym,Set);
+}
+
+DefReturnResult DefScriptPackage::_CallFunc(DefReturnResult (DefScriptPackage::*func)(CmdSet& Set), bool escape, CmdSet& Set)
+{
+    DefProfScope prof(_profiler,DEFPROF_FUNC,Set.cmd);
+    if(escape) // if we are going to use a C++ function, unescape the whole set, if supposed to do so.
+        UnescapeSet(Set);    // it will not have any bad side effects, we leave the func within this block!
+            
+    DefReturnResult result=(this->*func)(Set);
+    if(escape && !result.ret.IsNumberOnly()) // numbers never need escaping
+        result.ret = EscapeString(result.ret); // and since we are returning a string into the engine, escape it again, if set.
+    return result;
+}
+
+DefReturnResult DefScriptPackage::_CallScript(DefScriptSymbol *sym, CmdSet& Set)
+{
+    DefReturnResult result;
+    result.ok=false;
+    result.ret="";
+    if(sym && sym->script)
+	    result=_RunScript(sym->script, Set.cmd, &Set);
     if((!result.ok) /*&& Script[Set.cmd]->GetDebug()*/)
         PRINT_ERROR("Could not execute script command '%s'",Set.cmd.c_str());
-    
-
     return result;
 }
 
@@ -1129,8 +1519,10 @@ void DefScriptPackage::_UpdateOrCreateScriptByName(std::string sn)
         DeleteScript(sn);
     DefScript *newscript = new DefScript(this);
     newscript->SetName(sn); // necessary that the script knows its own name
-    Script[sn] = newscript;
+    _GetSymbol(sn)->script = newscript;
+    _scriptcount++;
     lists.Assign(SCRIPT_NAMESPACE + sn, &(newscript->Line));
+    _scriptlists[&(newscript->Line)] = newscript;
 }
 
 std::string DefScriptPackage::SecureString(std::string s)
@@ -1151,6 +1543,8 @@ std::string DefScriptPackage::SecureString(std::string s)
 // escapes whole string, which can no longer be parsed & interpreted 
 std::string DefScriptPackage::EscapeString(std::string s)
 {
+    if(s.find_first_of("{}\\\n\t")==std::string::npos)
+        return s;
     std::string out;
     out.reserve(s.length()+8);
     for(unsigned int i = 0; i < s.length(); i++)
@@ -1183,6 +1577,8 @@ std::string DefScriptPackage::EscapeString(std::string s)
 // converts a string into a printable form, with all escape sequences resolved
 std::string DefScriptPackage::UnescapeString(std::string s)
 {
+    if(s.find('\\')==std::string::npos)
+        return s;
     std::string out;
     out.reserve(s.length());
     for(unsigned int i = 0; i < s.length(); i++)
@@ -4,11 +4,18 @@
 
 #include "DefScriptDefines.h"
 #include <map>
+#include <set>
 #include <deque>
+#include <vector>
 #include <fstream>
+#include "UnorderedMap.h"
 #include "VarSet.h"
+#include "DefScriptValue.h"
+#include "DefScriptMatcher.h"
+#include "DefScriptWatcher.h"
 #include "ByteBuffer.h"
 #include "DynamicEvent.h"
+#include "DefScriptProfiler.h"
 #include "TypeStorage.h"
 #include "DefScriptTools.h"
 
@@ -32,7 +39,7 @@ struct DefReturnResult
     DefReturnResult(char *s) { ok=true; mustreturn=false; ret=s; }
     bool ok; // true if the execution of the current statement was successful
     bool mustreturn;
-    std::string ret; // return value used by ?{..}
+    DefValue ret; // return value used by ?{..}
     //bool abrt; // true if ALL current script execution must be aborted.
     //std::string err; // error string, including tracestack, etc.
 };
@@ -41,24 +48,34 @@ struct DefReturnResult
 
 struct DefXChgResult
 {
-    DefXChgResult() { changed=false; }
+    DefXChgResult() { changed=false; value=NULL; }
     bool changed;
     std::string str;
     DefReturnResult result;
+    const DefValue *value; // set if str is exactly the value of one variable, to pass on its numeric forms
 }; 
 
 typedef std::map<unsigned int,std::string> _CmdSetArgMap;
 
 class CmdSet {
+    friend class DefScriptPackage;
 	public:
 	CmdSet();
 	~CmdSet();
 	void Clear();
+    void CacheValues(void);
+    const DefValue& ArgValue(unsigned int);
+    const DefValue& DefaultValue(void);
 	std::string cmd;
 	_CmdSetArgMap arg;
 	std::string defaultarg;
     std::string myname;
     std::string caller;
+
+    private:
+    // typed forms of arg and defaultarg, used only as long as their string still equals the argument
+    std::map<unsigned int,DefValue> _argvals;
+    DefValue _defaultval;
 };
 
 struct DefScriptFunctionEntry {
@@ -73,10 +90,120 @@ struct DefScriptFunctionEntry {
     bool escape;
 };
 
-typedef std::deque<DefScriptFunctionEntry> DefScriptFunctionTable;
+// one entry per name for builtin functions and scripts. a function is preferred over a script with the same name.
+// entries are never removed, only their func/script are reset, so call sites can keep pointers to them.
+struct DefScriptSymbol
+{
+    DefScriptSymbol() { func=NULL; escape=false; script=NULL; }
+    DefReturnResult (DefScriptPackage::*func)(CmdSet& Set);
+    bool escape;
+    DefScript *script;
+};
+
+typedef UNORDERED_MAP<std::string,DefScriptSymbol> DefScriptSymbolTable;
 
 typedef std::deque<std::string> DefList;
 typedef std::map<std::string,DefList*> DefListMap;
+typedef UNORDERED_MAP<std::string,std::string> DefDict;
+typedef UNORDERED_SET<std::string> DefSet;
+
+// opcodes of the compiled form of a script. there is exactly one instruction per script line,
+// so a line index is also an instruction index and lines added/removed at runtime only require a recompile.
+enum DefScriptOpcode
+{
+    DEFOP_NOP,      // empty lines, markers, "endif", "loop"
+    DEFOP_IF,       // jump: first line of the else-branch or the line after "endif"
+    DEFOP_ELSE,     // reached at the end of a true if-branch; jump: line after "endif"
+    DEFOP_ENDLOOP,  // jump: line after "loop"
+    DEFOP_EXITLOOP, // jump: line after the matching "endloop"
+    DEFOP_CALL,     // call the builtin function or script in sym
+    DEFOP_RETURN,   // unless a function named "return" was added
+    DEFOP_LINE,     // cmd is built from variables, resolved + interpreted at runtime
+    DEFOP_ERROR     // block mismatch, text holds the error message
+};
+
+// how the name inside a ${..} or ?{..} slot of a DefTemplate is obtained
+enum DefTemplateResolve
+{
+    DEFTPL_PLAIN,  // the name is plain text
+    DEFTPL_PARTS,  // the name is a template itself, made of parts [first,first+count)
+    DEFTPL_LEGACY  // the name needs the full ReplaceVars() parser
+};
+
+struct DefScriptInstruction;
+
+// what the name of a plain ${..} slot resolved to last time. valid while VarSet::Generation() is gen
+// and the slot is resolved for the same script (owner, empty for global names)
+struct DefVarCache
+{
+    DefVarCache() { var=NULL; gen=0; valid=false; }
+    Var *var; // NULL if the variable did not exist
+    unsigned int gen;
+    std::string owner;
+    bool valid;
+};
+
+struct DefTemplatePart
+{
+    DefTemplatePart() { type=DEFSCRIPT_NONE; resolve=DEFTPL_PLAIN; first=count=0; global=false; code=NULL; }
+    DefTemplatePart(const DefTemplatePart&);
+    DefTemplatePart& operator=(const DefTemplatePart&);
+    ~DefTemplatePart();
+    unsigned char type; // DEFSCRIPT_NONE for literal text, DEFSCRIPT_VAR or DEFSCRIPT_FUNC for a slot
+    unsigned char resolve;
+    unsigned int first, count;
+    std::string text; // the literal text, or the slot as written in the script (inserted if it can't be resolved)
+    std::string name; // the name of a slot, without "${" and "}"
+    // plain ${..} slots: the name with the prefixes removed that _NormalizeVarName() removes.
+    // if global is set this is the final name, otherwise it still needs the script name in front
+    std::string var;
+    bool global;
+    DefScriptInstruction *code; // plain ?{..} slots: the line, compiled once. owned by the part
+    mutable DefVarCache cache; // plain ${..} slots. not copied
+};
+
+// a string that needs variable replacement, split into literal text and slots when the script is compiled.
+// parts [first,first+count) make up the string, the parts of templated slot names are stored before them.
+// strings the template can not represent exactly (plain {..} groups, escapes, unbalanced brackets) are not valid
+// and still go through ReplaceVars().
+struct DefTemplate
+{
+    DefTemplate() { first=count=0; valid=false; }
+    std::vector<DefTemplatePart> parts;
+    unsigned int first, count;
+    bool valid;
+};
+
+struct DefScriptInstruction
+{
+    DefScriptInstruction() { op=DEFOP_NOP; jump=0; srcline=0; dynamic=false; defvars=false; sym=NULL; }
+    unsigned char op;
+    unsigned int jump;
+    unsigned int srcline; // number of the line in its file, 0 if it was added at runtime
+    bool dynamic; // args contain ${..} or ?{..}, the whole line must be replaced + split at runtime
+    bool defvars; // only the defaultarg contains ${..} or ?{..}
+    CmdSet set; // pre-split cmd + args; defaultarg is final unless defvars is set
+    std::string text; // raw line for dynamic instructions, error message for DEFOP_ERROR, arg 0 for an empty defaultarg
+    DefTemplate tpl; // the raw line (dynamic, DEFOP_LINE) or the raw defaultarg (defvars)
+    DefScriptSymbol *sym; // resolved once, follows functions/scripts being added, reloaded or removed
+};
+
+typedef std::vector<DefScriptInstruction> DefScriptCode;
+
+// parser state of ReplaceVars(), so that a replacement can be continued from any position
+struct DefReplaceState
+{
+    DefReplaceState() { openingBracket=0; bracketsOpen=0; nextVar=DEFSCRIPT_NONE; hasChanged=false; hasVar=false; escaped=false; }
+    unsigned int
+        openingBracket, // defines the position from where the recursive call is started
+        bracketsOpen; // amount of brackets opened
+    unsigned char
+        nextVar; // '$' or '?'
+    bool
+        hasChanged, // additional helper. once true, xchg.result will be true later also
+        hasVar, // true if openingBracket (= the first bracket) was preceded by '$' or '?'
+        escaped;
+};
 
 class DefScript {
     friend class DefScriptPackage;
@@ -86,7 +213,7 @@ public:
 
     inline std::string GetLine(unsigned int id) { return Line[id]; }
     inline unsigned int GetLines(void) { return Line.size(); }
-	bool AddLine(std::string );
+	bool AddLine(std::string, unsigned int srcline = 0);
 	std::string GetName(void);
 	void SetName(std::string);
 	void SetPermission(unsigned char);
@@ -99,6 +226,11 @@ public:
 
 private:
     DefList Line;
+    std::vector<unsigned int> _srcline; // number of each entry of Line in the file it was loaded from. not valid if the sizes differ
+    DefScriptCode _code; // compiled form of Line, rebuilt on demand
+    std::deque<DefScriptCode> _retired; // code replaced while the script was running, freed when it returns
+    unsigned int _running; // nesting depth of running instances
+    bool _compiled;
 	unsigned int lines;
 	std::string scriptname;
 	unsigned char permission;
@@ -110,6 +242,7 @@ private:
 
 class DefScriptPackage {
     friend class DefScript;
+    friend class DefScript_DynamicEventMgr;
 public:
 	DefScriptPackage();
 	~DefScriptPackage();
@@ -131,11 +264,18 @@ public:
     std::string _NormalizeVarName(std::string, std::string);
     DefReturnResult RunSingleLineFromScript(std::string line, DefScript *pScript);
     DefScript_DynamicEventMgr *GetEventMgr(void);
+    inline DefScriptProfiler& GetProfiler(void) { return _profiler; }
+    bool WatchPath(std::string);
+    void UpdateWatch(void);
     void AddFunc(DefScriptFunctionEntry);
     void AddFunc(std::string n,DefReturnResult (DefScriptPackage::*)(CmdSet& Set), bool esc=true);
     bool HasFunc(std::string);
     void DelFunc(std::string);
 	TypeStorage<DefList> lists;
+    void _ListChanged(DefList*); // call after changing a list in place, it could hold the lines of a script
+    TypeStorage<DefDict> dicts;
+    TypeStorage<DefSet> sets;
+    TypeStorage<DefMatcher> matchers;
     TypeStorage<ByteBuffer> bytebuffers;
     TypeStorage<std::fstream> files;
     std::string SecureString(std::string);
@@ -153,17 +293,43 @@ private:
     void _UpdateOrCreateScriptByName(std::string);
     void _InitFunctions(void);
     DefXChgResult ReplaceVars(std::string str, CmdSet* pSet, unsigned char VarType, bool run_embedded);
+    DefXChgResult _ReplaceVarsFrom(std::string& str, unsigned int i, DefReplaceState& st, DefXChgResult& xchg, CmdSet* pSet, unsigned char VarType, bool run_embedded);
+    void _ResolveVar(std::string& str, DefXChgResult& xchg, CmdSet* pSet, unsigned char VarType, bool run_embedded, const DefTemplatePart *part = NULL);
+    DefXChgResult _ReplaceTemplate(const DefTemplate& tpl, unsigned int first, unsigned int count, CmdSet* pSet, unsigned char VarType, bool run_embedded);
+    bool _CompileTemplate(DefTemplate& tpl, const std::string& str, unsigned char VarType, unsigned int& first, unsigned int& count);
+    void _CompileTemplate(DefTemplate& tpl, const std::string& str);
 	void SplitLine(CmdSet&,std::string);
     DefReturnResult Interpret(CmdSet&);
+    DefReturnResult _CallFunc(DefReturnResult (DefScriptPackage::*)(CmdSet& Set), bool, CmdSet&);
+    DefReturnResult _CallScript(DefScriptSymbol*,CmdSet&);
+    DefReturnResult _RunScript(DefScript*,std::string name,CmdSet* pSet);
+    unsigned int _SkipDynamicBlock(DefScript*,unsigned int i,bool loop);
+    DefScriptSymbol *_GetSymbol(const std::string&);
+    DefScriptSymbol *_FindSymbol(const std::string&);
+    void _CompileScript(DefScript*);
+    void _CompileLine(DefScriptInstruction&, const std::string&);
+    void _PrepareSet(const DefScriptInstruction&, CmdSet&, CmdSet*);
+    DefReturnResult _CallInstruction(const DefScriptInstruction&, CmdSet&);
+    DefReturnResult _RunCompiledLine(const DefScriptInstruction&, DefScript*);
+    bool _IsCompiled(DefScript*);
+    std::string _FileKey(const std::string&);
+    void _ReloadFile(const std::string&);
+    void _UnloadFile(const std::string&);
+    void _TakeHooks(DefScript*, const std::set<std::string>&, DefList&);
+    void _RemoveHooks(const std::set<std::string>&);
     void RemoveBrackets(CmdSet&);
     void UnescapeSet(CmdSet&);
     std::string RemoveBracketsFromString(std::string);
     void def_print(const char *fmt, ...);
     void *parentMethod;
     DefScript_DynamicEventMgr *_eventmgr;
-    std::map<std::string,DefScript*> Script;
+    DefScriptProfiler _profiler;
+    DefScriptSymbolTable _symbols;
+    unsigned int _scriptcount;
     std::map<std::string,unsigned char> scriptPermissionMap;
-    DefScriptFunctionTable _functable;
+    std::map<DefList*,DefScript*> _scriptlists; // to detect script lines changed by list functions
+    std::map<std::string,std::set<std::string> > _filescripts; // script file -> names of the scripts loaded from it
+    DefScriptWatcher _watcher;
     _DEFSC_DEBUG(std::fstream hLogfile);
 
     // Usable internal basic functions:
@@ -211,6 +377,18 @@ private:
     DefReturnResult func_strfind(CmdSet&);
     DefReturnResult func_scriptexists(CmdSet&);
     DefReturnResult func_funcexists(CmdSet&);
+    DefReturnResult func_profstart(CmdSet&);
+    DefReturnResult func_profstop(CmdSet&);
+    DefReturnResult func_profreset(CmdSet&);
+    DefReturnResult func_profsummary(CmdSet&);
+    DefReturnResult func_profflame(CmdSet&);
+    DefReturnResult func_madd(CmdSet&);
+    DefReturnResult func_mremove(CmdSet&);
+    DefReturnResult func_mdelim(CmdSet&);
+    DefReturnResult func_mmatch(CmdSet&);
+    DefReturnResult func_mlen(CmdSet&);
+    DefReturnResult func_mexists(CmdSet&);
+    DefReturnResult func_mdelete(CmdSet&);
 
 
     // list functions
@@ -231,6 +409,27 @@ private:
     DefReturnResult func_lerase(CmdSet&);
     DefReturnResult func_lsort(CmdSet&);
 
+    // dict and set functions
+    DefReturnResult func_dset(CmdSet&);
+    DefReturnResult func_dget(CmdSet&);
+    DefReturnResult func_dhas(CmdSet&);
+    DefReturnResult func_derase(CmdSet&);
+    DefReturnResult func_dlen(CmdSet&);
+    DefReturnResult func_dexists(CmdSet&);
+    DefReturnResult func_ddelete(CmdSet&);
+    DefReturnResult func_dkeys(CmdSet&);
+    DefReturnResult func_dvalues(CmdSet&);
+    DefReturnResult func_dtolist(CmdSet&);
+    DefReturnResult func_dfromlist(CmdSet&);
+    DefReturnResult func_sadd(CmdSet&);
+    DefReturnResult func_shas(CmdSet&);
+    DefReturnResult func_serase(CmdSet&);
+    DefReturnResult func_slen(CmdSet&);
+    DefReturnResult func_sexists(CmdSet&);
+    DefReturnResult func_sdelete(CmdSet&);
+    DefReturnResult func_stolist(CmdSet&);
+    DefReturnResult func_sfromlist(CmdSet&);
+
     // ByteBuffer functions
     DefReturnResult func_bbinit(CmdSet&);
     DefReturnResult func_bbdelete(CmdSet&);
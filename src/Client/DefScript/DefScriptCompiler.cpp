@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "DefScript.h"
+
+using namespace DefScriptTools;
+
+// scans the part of a line that SplitLine() turns into cmd and args.
+// returns the position of the space that starts the defaultarg (npos if there is none)
+// and whether cmd or args contain ${..} or ?{..}, which have to be replaced before splitting.
+static std::string::size_type ScanLineHead(const std::string& line, bool& cmdvars, bool& argvars)
+{
+    unsigned int bracketsOpen=0;
+    bool incmd=true;
+    cmdvars=argvars=false;
+    for(std::string::size_type i=0; i<line.length(); i++)
+    {
+        if(line[i]=='{')
+        {
+            if(i>0 && (line[i-1]=='$' || line[i-1]=='?'))
+                (incmd ? cmdvars : argvars) = true;
+            bracketsOpen++;
+        }
+        else if(line[i]=='}')
+        {
+            if(!bracketsOpen) // broken line, leave it to the runtime parser
+            {
+                cmdvars=true;
+                return std::string::npos;
+            }
+            bracketsOpen--;
+        }
+        else if(line[i]=='\\')
+            i++;
+        else if(line[i]==',' && !bracketsOpen)
+            incmd=false;
+        else if(line[i]==' ' && !bracketsOpen)
+            return i;
+    }
+    return std::string::npos;
+}
+
+// true if the string contains anything ReplaceVars() would have to process
+static bool HasVars(const std::string& s)
+{
+    for(std::string::size_type i=1; i<s.length(); i++)
+        if(s[i]=='{' && (s[i-1]=='$' || s[i-1]=='?'))
+            return true;
+    return false;
+}
+
+DefTemplatePart::DefTemplatePart(const DefTemplatePart& p)
+    : type(p.type), resolve(p.resolve), first(p.first), count(p.count), text(p.text), name(p.name), var(p.var), global(p.global)
+{
+    code = p.code ? new DefScriptInstruction(*p.code) : NULL;
+}
+
+DefTemplatePart& DefTemplatePart::operator=(const DefTemplatePart& p)
+{
+    if(this != &p)
+    {
+        DefScriptInstruction *c = p.code ? new DefScriptInstruction(*p.code) : NULL;
+        delete code;
+        code = c;
+        type = p.type;
+        resolve = p.resolve;
+        first = p.first;
+        count = p.count;
+        text = p.text;
+        name = p.name;
+        var = p.var;
+        global = p.global;
+        cache = DefVarCache();
+    }
+    return *this;
+}
+
+DefTemplatePart::~DefTemplatePart()
+{
+    delete code;
+}
+
+// splits str into literal text and ${..}/?{..} slots, the level is appended to tpl.parts.
+// returns false for strings where ReplaceVars() does more than replacing the slots.
+bool DefScriptPackage::_CompileTemplate(DefTemplate& tpl, const std::string& str, unsigned char VarType, unsigned int& first, unsigned int& count)
+{
+    std::vector<DefTemplatePart> level;
+    std::string text;
+    for(std::string::size_type i=0; i<str.length(); i++)
+    {
+        if(str[i]=='\\' || str[i]=='}')
+            return false;
+        if(str[i]!='{')
+        {
+            text+=str[i];
+            continue;
+        }
+        if(i==0 || (str[i-1]!='$' && str[i-1]!='?')) // plain {..} group
+            return false;
+
+        // find the closing bracket the same way ReplaceVars() does
+        std::string::size_type j;
+        unsigned int bracketsOpen=1;
+        for(j=i+1; j<str.length(); j++)
+        {
+            if(str[j]=='\\')
+                j++;
+            else if(str[j]=='{')
+                bracketsOpen++;
+            else if(str[j]=='}' && !--bracketsOpen)
+                break;
+        }
+        if(j>=str.length())
+            return false;
+
+        text.erase(text.length()-1); // the '$' or '?'
+        if(!text.empty())
+        {
+            level.push_back(DefTemplatePart());
+            level.back().text.swap(text);
+        }
+        level.push_back(DefTemplatePart());
+        DefTemplatePart& slot = level.back();
+        slot.type = str[i-1]=='$' ? DEFSCRIPT_VAR : DEFSCRIPT_FUNC;
+        slot.text = str.substr(i-1,j-i+2);
+        slot.name = str.substr(i+1,j-i-1);
+        if(slot.name.find_first_of("{}")!=std::string::npos)
+        {
+            unsigned int size=tpl.parts.size();
+            if(_CompileTemplate(tpl,slot.name,slot.type,slot.first,slot.count))
+                slot.resolve=DEFTPL_PARTS;
+            else
+            {
+                tpl.parts.resize(size);
+                slot.resolve=DEFTPL_LEGACY;
+            }
+        }
+        else if(slot.type==DEFSCRIPT_VAR)
+        {
+            // the part of _NormalizeVarName() that does not depend on the script name
+            std::string::size_type k=slot.name.find_first_not_of("#:");
+            slot.var = k==std::string::npos ? "" : slot.name.substr(k);
+            slot.global = slot.name.find('#') < k;
+        }
+        else if(!slot.name.empty())
+        {
+            slot.code = new DefScriptInstruction;
+            _CompileLine(*slot.code,slot.name);
+        }
+        i=j;
+    }
+    if(!text.empty())
+    {
+        level.push_back(DefTemplatePart());
+        level.back().text.swap(text);
+    }
+    first=tpl.parts.size();
+    count=level.size();
+    tpl.parts.insert(tpl.parts.end(),level.begin(),level.end());
+    return true;
+}
+
+void DefScriptPackage::_CompileTemplate(DefTemplate& tpl, const std::string& str)
+{
+    tpl.parts.clear();
+    tpl.valid=_CompileTemplate(tpl,str,DEFSCRIPT_NONE,tpl.first,tpl.count);
+    if(!tpl.valid)
+        tpl.parts.clear();
+}
+
+bool DefScriptPackage::_IsCompiled(DefScript *sc)
+{
+    return sc->_compiled && sc->_code.size()==sc->Line.size();
+}
+
+// must be called by everything that changes a list, the list could contain the lines of a script
+void DefScriptPackage::_ListChanged(DefList *l)
+{
+    std::map<DefList*,DefScript*>::iterator it = _scriptlists.find(l);
+    if(it != _scriptlists.end())
+    {
+        it->second->_compiled=false;
+        it->second->_srcline.clear(); // changed by the list functions, the lines no longer match the file
+    }
+}
+
+// compiles a single line that is not a block statement into ins: cmd and args are split once,
+// the called function or script is looked up. only parts that contain variables are left for runtime.
+void DefScriptPackage::_CompileLine(DefScriptInstruction& ins, const std::string& line)
+{
+    bool cmdvars,argvars;
+    std::string::size_type sp = ScanLineHead(line,cmdvars,argvars);
+    if(cmdvars)
+    {
+        ins.op=DEFOP_LINE;
+        ins.text=line;
+        _CompileTemplate(ins.tpl,line);
+        return;
+    }
+    if(argvars)
+    {
+        ins.dynamic=true;
+        ins.text=line;
+        _CompileTemplate(ins.tpl,line);
+        SplitLine(ins.set,line.substr(0,sp)); // only used to get the cmd
+    }
+    else if(sp!=std::string::npos && HasVars(line.substr(sp+1)))
+    {
+        ins.defvars=true;
+        SplitLine(ins.set,line); // defaultarg is replaced by the raw one below
+        ins.set.defaultarg=line.substr(sp+1);
+        _CompileTemplate(ins.tpl,ins.set.defaultarg);
+        if(ins.set.arg.empty()) // SplitLine() turns the cmd into arg 0 as well if the defaultarg is empty
+        {
+            CmdSet emptydef;
+            SplitLine(emptydef,line.substr(0,sp+1));
+            ins.text=emptydef.arg[0];
+        }
+    }
+    else
+        SplitLine(ins.set,line);
+    if(!ins.dynamic)
+        ins.set.CacheValues(); // numbers in the line are converted only once
+
+    ins.op = ins.set.cmd=="return" ? DEFOP_RETURN : DEFOP_CALL;
+    ins.sym = _GetSymbol(ins.set.cmd); // the script may not be loaded yet
+}
+
+// translates the lines of a script into instructions:
+// control statements get their jump targets, all other lines are compiled by _CompileLine().
+void DefScriptPackage::_CompileScript(DefScript *sc)
+{
+    DefScriptCode& code = sc->_code;
+    if(sc->_running) // instructions of the old code are still in use
+    {
+        sc->_retired.push_back(DefScriptCode());
+        sc->_retired.back().swap(code);
+    }
+    code.clear();
+    code.resize(sc->Line.size());
+
+    std::deque<unsigned int> blocks; // open if/else/loop instructions
+    std::deque<unsigned int> exits; // exitloops waiting for their endloop, jump holds the loop line meanwhile
+
+    for(unsigned int i=0; i<sc->Line.size(); i++)
+    {
+        const std::string& line = sc->Line[i];
+        DefScriptInstruction& ins = code[i];
+        if(sc->_srcline.size()==sc->Line.size())
+            ins.srcline=sc->_srcline[i];
+
+        if(line.empty() || line[0] == '#') // skip markers and preload statements if not removed before
+            continue;
+
+        if(line=="else")
+        {
+            if(blocks.empty() || code[blocks.back()].op!=DEFOP_IF)
+            {
+                ins.op=DEFOP_ERROR;
+                ins.text="else-block without any block?!";
+                continue;
+            }
+            code[blocks.back()].jump=i+1;
+            blocks.back()=i;
+            ins.op=DEFOP_ELSE;
+            continue;
+        }
+        else if(line=="endif")
+        {
+            if(blocks.empty())
+            {
+                ins.op=DEFOP_ERROR;
+                ins.text="endif without any block";
+            }
+            else if(code[blocks.back()].op!=DEFOP_IF && code[blocks.back()].op!=DEFOP_ELSE)
+            {
+                ins.op=DEFOP_ERROR;
+                ins.text="endif: closed block is not an if block!";
+            }
+            else
+            {
+                code[blocks.back()].jump=i+1;
+                blocks.pop_back();
+            }
+            continue;
+        }
+        else if(line=="loop")
+        {
+            blocks.push_back(i); // stays DEFOP_NOP
+            continue;
+        }
+        else if(line=="endloop")
+        {
+            if(blocks.empty())
+            {
+                ins.op=DEFOP_ERROR;
+                ins.text="endloop without any block";
+            }
+            else if(code[blocks.back()].op!=DEFOP_NOP)
+            {
+                ins.op=DEFOP_ERROR;
+                ins.text="endloop: closed block is not a loop block!";
+            }
+            else
+            {
+                ins.op=DEFOP_ENDLOOP;
+                ins.jump=blocks.back()+1;
+                for(std::deque<unsigned int>::iterator it=exits.begin(); it!=exits.end(); )
+                {
+                    if(code[*it].jump==blocks.back())
+                    {
+                        code[*it].jump=i+1;
+                        it=exits.erase(it);
+                    }
+                    else
+                        it++;
+                }
+                blocks.pop_back();
+            }
+            continue;
+        }
+
+        _CompileLine(ins,line);
+        if(ins.op==DEFOP_LINE)
+            continue;
+
+        if(ins.set.cmd=="if")
+        {
+            ins.op=DEFOP_IF;
+            blocks.push_back(i);
+        }
+        else if(ins.set.cmd=="exitloop")
+        {
+            ins.op=DEFOP_EXITLOOP;
+            unsigned int b=blocks.size();
+            while(b && code[blocks[b-1]].op!=DEFOP_NOP)
+                b--;
+            if(!b)
+            {
+                ins.op=DEFOP_ERROR;
+                ins.text="exitloop outside of a loop";
+                continue;
+            }
+            ins.jump=blocks[b-1];
+            exits.push_back(i);
+        }
+    }
+
+    // blocks left open run until the end of the script
+    for(unsigned int b=0; b<blocks.size(); b++)
+        if(code[blocks[b]].op!=DEFOP_NOP)
+            code[blocks[b]].jump=code.size();
+    for(unsigned int e=0; e<exits.size(); e++)
+        code[exits[e]].jump=code.size();
+
+    sc->_compiled=true;
+}
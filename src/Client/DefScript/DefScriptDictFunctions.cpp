@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "DefScript.h"
+
+using namespace DefScriptTools;
+
+// dicts map keys to values, sets hold unique strings. both are hash based: insert, lookup and erase
+// take the same time no matter how big they are, but they have no order.
+// to walk through one, copy its keys into a list (dkeys, stolist) and use the list functions.
+
+
+// dict functions
+
+// store value @def under key @1 in dict @0, returns true if the key was new
+DefReturnResult DefScriptPackage::func_dset(CmdSet& Set)
+{
+    DefDict *d = dicts.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    std::pair<DefDict::iterator,bool> ins = d->insert(std::make_pair(Set.arg[1],Set.defaultarg));
+    if(!ins.second)
+        ins.first->second = Set.defaultarg;
+    return ins.second;
+}
+
+// return the value of key @def in dict @0, or nothing if it is not there
+DefReturnResult DefScriptPackage::func_dget(CmdSet& Set)
+{
+    DefDict *d = dicts.GetNoCreate(_NormalizeVarName(Set.arg[0],Set.myname));
+    if(!d)
+        return "";
+    DefDict::iterator it = d->find(Set.defaultarg);
+    if(it == d->end())
+        return "";
+    return it->second;
+}
+
+// returns true if dict @0 has key @def
+DefReturnResult DefScriptPackage::func_dhas(CmdSet& Set)
+{
+    DefDict *d = dicts.GetNoCreate(_NormalizeVarName(Set.arg[0],Set.myname));
+    return d && d->find(Set.defaultarg) != d->end();
+}
+
+// remove key @def from dict @0, return its value
+DefReturnResult DefScriptPackage::func_derase(CmdSet& Set)
+{
+    DefDict *d = dicts.GetNoCreate(_NormalizeVarName(Set.arg[0],Set.myname));
+    if(!d)
+        return "";
+    DefDict::iterator it = d->find(Set.defaultarg);
+    if(it == d->end())
+        return "";
+    std::string r = it->second;
+    d->erase(it);
+    return r;
+}
+
+// return key count, or nothing if the dict doesnt exist
+DefReturnResult DefScriptPackage::func_dlen(CmdSet& Set)
+{
+    DefDict *d = dicts.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(!d)
+        return "";
+    return toString((uint64)d->size());
+}
+
+DefReturnResult DefScriptPackage::func_dexists(CmdSet& Set)
+{
+    return dicts.Exists(_NormalizeVarName(Set.defaultarg,Set.myname));
+}
+
+DefReturnResult DefScriptPackage::func_ddelete(CmdSet& Set)
+{
+    dicts.Delete(_NormalizeVarName(Set.defaultarg,Set.myname));
+    return true;
+}
+
+// fill list @0 with the keys of dict @def, returns the amount of keys
+DefReturnResult DefScriptPackage::func_dkeys(CmdSet& Set)
+{
+    DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    l->clear();
+    DefDict *d = dicts.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(d)
+        for(DefDict::iterator it = d->begin(); it != d->end(); it++)
+            l->push_back(it->first);
+    _ListChanged(l);
+    return toString((uint64)l->size());
+}
+
+// fill list @0 with the values of dict @def, in the same order as dkeys
+DefReturnResult DefScriptPackage::func_dvalues(CmdSet& Set)
+{
+    DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    l->clear();
+    DefDict *d = dicts.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(d)
+        for(DefDict::iterator it = d->begin(); it != d->end(); it++)
+            l->push_back(it->second);
+    _ListChanged(l);
+    return toString((uint64)l->size());
+}
+
+// fill list @0 with key, value, key, value, ... of dict @def, returns the amount of keys
+DefReturnResult DefScriptPackage::func_dtolist(CmdSet& Set)
+{
+    DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    l->clear();
+    DefDict *d = dicts.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(d)
+    {
+        for(DefDict::iterator it = d->begin(); it != d->end(); it++)
+        {
+            l->push_back(it->first);
+            l->push_back(it->second);
+        }
+    }
+    _ListChanged(l);
+    return toString((uint64)(l->size() / 2));
+}
+
+// the reverse of dtolist: make dict @0 from list @def holding key, value, key, value, ...
+// later keys overwrite earlier ones, a trailing key without value gets an empty value. returns the amount of keys.
+DefReturnResult DefScriptPackage::func_dfromlist(CmdSet& Set)
+{
+    DefDict *d = dicts.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    d->clear();
+    DefList *l = lists.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(!l)
+        return "0";
+    for(DefList::iterator it = l->begin(); it != l->end(); )
+    {
+        std::string& val = (*d)[*it++];
+        if(it == l->end())
+        {
+            val.clear();
+            break;
+        }
+        val = *it++;
+    }
+    return toString((uint64)d->size());
+}
+
+
+// set functions
+
+// add @def to set @0, returns true if it was not in the set yet
+DefReturnResult DefScriptPackage::func_sadd(CmdSet& Set)
+{
+    DefSet *s = sets.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    return s->insert(Set.defaultarg).second;
+}
+
+// returns true if set @0 contains @def
+DefReturnResult DefScriptPackage::func_shas(CmdSet& Set)
+{
+    DefSet *s = sets.GetNoCreate(_NormalizeVarName(Set.arg[0],Set.myname));
+    return s && s->find(Set.defaultarg) != s->end();
+}
+
+// remove @def from set @0, returns true if it was in the set
+DefReturnResult DefScriptPackage::func_serase(CmdSet& Set)
+{
+    DefSet *s = sets.GetNoCreate(_NormalizeVarName(Set.arg[0],Set.myname));
+    return s && s->erase(Set.defaultarg);
+}
+
+// return element count, or nothing if the set doesnt exist
+DefReturnResult DefScriptPackage::func_slen(CmdSet& Set)
+{
+    DefSet *s = sets.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(!s)
+        return "";
+    return toString((uint64)s->size());
+}
+
+DefReturnResult DefScriptPackage::func_sexists(CmdSet& Set)
+{
+    return sets.Exists(_NormalizeVarName(Set.defaultarg,Set.myname));
+}
+
+DefReturnResult DefScriptPackage::func_sdelete(CmdSet& Set)
+{
+    sets.Delete(_NormalizeVarName(Set.defaultarg,Set.myname));
+    return true;
+}
+
+// fill list @0 with the elements of set @def, returns the amount of elements
+DefReturnResult DefScriptPackage::func_stolist(CmdSet& Set)
+{
+    DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    l->clear();
+    DefSet *s = sets.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(s)
+        l->insert(l->end(), s->begin(), s->end());
+    _ListChanged(l);
+    return toString((uint64)l->size());
+}
+
+// make set @0 from the elements of list @def, duplicates are dropped. returns the amount of elements.
+DefReturnResult DefScriptPackage::func_sfromlist(CmdSet& Set)
+{
+    DefSet *s = sets.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    s->clear();
+    DefList *l = lists.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(l)
+        s->insert(l->begin(), l->end());
+    return toString((uint64)s->size());
+}
@@ -119,7 +119,8 @@ DefReturnResult DefScriptPackage::func_set(CmdSet& Set)
         //    printf("Can't assign value to a macro!\n");
         return r;
     }
-    std::string vname,vval=Set.defaultarg;
+    std::string vname;
+    const DefValue& vval=Set.DefaultValue(); // "set,x ${y}" copies the numeric forms of y along
     vname=_NormalizeVarName(Set.arg[0], Set.myname);
 
    //if(!stricmp(Set.arg[1].c_str(),"onfail") && vval.find("${")!=std::string::npos)
@@ -180,7 +181,7 @@ DefReturnResult DefScriptPackage::func_setscriptpermission(CmdSet& Set)
 DefReturnResult DefScriptPackage::func_toint(CmdSet& Set)
 {
     DefReturnResult r;
-    std::string num=toString(toUint64(Set.defaultarg));
+    DefValue num(Set.DefaultValue().u64());
     if(!Set.arg[0].empty())
     {
         std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
@@ -198,12 +199,12 @@ DefReturnResult DefScriptPackage::func_add(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    ldbl a=toNumber(variables.Get(vname));
-    ldbl b=toNumber(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    ldbl a=v->value.num();
+    ldbl b=Set.DefaultValue().num();
     a+=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -215,12 +216,12 @@ DefReturnResult DefScriptPackage::func_sub(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    ldbl a=toNumber(variables.Get(vname));
-    ldbl b=toNumber(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    ldbl a=v->value.num();
+    ldbl b=Set.DefaultValue().num();
     a-=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -232,12 +233,12 @@ DefReturnResult DefScriptPackage::func_mul(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    ldbl a=toNumber(variables.Get(vname));
-    ldbl b=toNumber(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    ldbl a=v->value.num();
+    ldbl b=Set.DefaultValue().num();
     a*=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -249,15 +250,15 @@ DefReturnResult DefScriptPackage::func_div(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    ldbl a=toNumber(variables.Get(vname));
-    ldbl b=toNumber(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    ldbl a=v->value.num();
+    ldbl b=Set.DefaultValue().num();
     if(b==0)
         a=0;
     else
         a/=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -269,15 +270,15 @@ DefReturnResult DefScriptPackage::func_mod(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    uint64 a=toUint64(variables.Get(vname));
-    uint64 b=toUint64(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    uint64 a=v->value.u64();
+    uint64 b=Set.DefaultValue().u64();
     if(b==0)
         a=0;
     else
         a%=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -289,12 +290,12 @@ DefReturnResult DefScriptPackage::func_pow(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    ldbl a=toNumber(variables.Get(vname));
-    ldbl b=toNumber(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    ldbl a=v->value.num();
+    ldbl b=Set.DefaultValue().num();
     a=pow(a,b);
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -306,12 +307,12 @@ DefReturnResult DefScriptPackage::func_bitor(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    uint64 a=toUint64(variables.Get(vname));
-    uint64 b=toUint64(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    uint64 a=v->value.u64();
+    uint64 b=Set.DefaultValue().u64();
     a|=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -323,12 +324,12 @@ DefReturnResult DefScriptPackage::func_bitand(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    uint64 a=toUint64(variables.Get(vname));
-    uint64 b=toUint64(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    uint64 a=v->value.u64();
+    uint64 b=Set.DefaultValue().u64();
     a&=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
@@ -340,18 +341,18 @@ DefReturnResult DefScriptPackage::func_bitxor(CmdSet& Set)
         return r;
     }
 
-    std::string vname=_NormalizeVarName(Set.arg[0], Set.myname);
-    uint64 a=toUint64(variables.Get(vname));
-    uint64 b=toUint64(Set.defaultarg);
+    Var *v=variables.GetSlot(_NormalizeVarName(Set.arg[0], Set.myname));
+    uint64 a=v->value.u64();
+    uint64 b=Set.DefaultValue().u64();
     a^=b;
-    variables.Set(vname,toString(a));
-    r.ret=toString(a);
+    r.ret=DefValue(a);
+    variables.Set(v,r.ret);
     return r;
 }
 
 DefReturnResult DefScriptPackage::func_addevent(CmdSet& Set)
 {
-    GetEventMgr()->Add(Set.arg[0],Set.defaultarg,(clock_t)toNumber(Set.arg[1]),Set.myname.c_str(),isTrue(Set.arg[2]));
+    GetEventMgr()->Add(Set.arg[0],Set.defaultarg,(uint32)Set.ArgValue(1).num(),Set.myname.c_str(),isTrue(Set.arg[2]));
     return true;
 }
 
@@ -364,7 +365,7 @@ DefReturnResult DefScriptPackage::func_removeevent(CmdSet& Set)
 DefReturnResult DefScriptPackage::func_strlen(CmdSet& Set)
 {
     DefReturnResult r;
-    r.ret=toString((uint64)Set.defaultarg.length());
+    r.ret=DefValue((uint64)Set.defaultarg.length());
     return r;
 }
 
@@ -393,22 +394,22 @@ DefReturnResult DefScriptPackage::func_equal(CmdSet& Set)
 
 DefReturnResult DefScriptPackage::func_smaller(CmdSet& Set)
 {
-    return toNumber(Set.arg[0]) < toNumber(Set.defaultarg);
+    return Set.ArgValue(0).num() < Set.DefaultValue().num();
 }
 
 DefReturnResult DefScriptPackage::func_bigger(CmdSet& Set)
 {
-    return toNumber(Set.arg[0]) > toNumber(Set.defaultarg);
+    return Set.ArgValue(0).num() > Set.DefaultValue().num();
 }
 
 DefReturnResult DefScriptPackage::func_smaller_eq(CmdSet& Set)
 {
-    return toNumber(Set.arg[0]) <= toNumber(Set.defaultarg);
+    return Set.ArgValue(0).num() <= Set.DefaultValue().num();
 }
 
 DefReturnResult DefScriptPackage::func_bigger_eq(CmdSet& Set)
 {
-    return toNumber(Set.arg[0]) >= toNumber(Set.defaultarg);
+    return Set.ArgValue(0).num() >= Set.DefaultValue().num();
 }
 
 DefReturnResult DefScriptPackage::func_not(CmdSet& Set)
@@ -427,7 +428,7 @@ DefReturnResult DefScriptPackage::func_tohex(CmdSet& Set)
     DefReturnResult r;
     char buf[50];
     bool full=stringToLower(Set.arg[0])=="full";
-    uint64 u=toUint64(Set.defaultarg);
+    uint64 u=Set.DefaultValue().u64();
 #if COMPILER == COMPILER_MICROSOFT
     sprintf(buf,"%016I64X",u);
 #else
@@ -444,7 +445,7 @@ DefReturnResult DefScriptPackage::func_tohex(CmdSet& Set)
 DefReturnResult DefScriptPackage::func_abs(CmdSet& Set)
 {
     DefReturnResult r;
-    r.ret=toString(fabs(toNumber(Set.defaultarg)));
+    r.ret=DefValue(ldbl(fabs(Set.DefaultValue().num())));
     return r;
 }
 
@@ -473,8 +474,8 @@ DefReturnResult DefScriptPackage::func_substr(CmdSet& Set)
     else
     {
         unsigned int start,len;
-        len=(unsigned int)toUint64(Set.arg[0]);
-        start=(unsigned int)toUint64(Set.arg[1]);
+        len=(unsigned int)Set.ArgValue(0).u64();
+        start=(unsigned int)Set.ArgValue(1).u64();
         if(start+len>Set.defaultarg.length())
             len=Set.defaultarg.length()-start;
         r.ret=Set.defaultarg.substr(start,len);
@@ -500,8 +501,8 @@ DefReturnResult DefScriptPackage::func_random(CmdSet& Set)
 {
     DefReturnResult r;
     int min,max;
-    min=(int)toUint64(Set.arg[0]);
-    max=(int)toUint64(Set.defaultarg);
+    min=(int)Set.ArgValue(0).u64();
+    max=(int)Set.DefaultValue().u64();
     r.ret=toString(min + ( rand() % (max - min + 1)) );
     return r;
 }
@@ -533,10 +534,94 @@ DefReturnResult DefScriptPackage::func_scriptexists(CmdSet& Set)
 
 DefReturnResult DefScriptPackage::func_funcexists(CmdSet& Set)
 {
-    for(DefScriptFunctionTable::iterator i = _functable.begin(); i != _functable.end(); i++)
-    {
-        if(i->name == stringToLower(Set.defaultarg))
-            return true;
-    }
-    return false;
+    return HasFunc(stringToLower(Set.defaultarg));
+}
+
+DefReturnResult DefScriptPackage::func_profstart(CmdSet& Set)
+{
+    _profiler.Start();
+    return true;
+}
+
+DefReturnResult DefScriptPackage::func_profstop(CmdSet& Set)
+{
+    _profiler.Stop();
+    return true;
+}
+
+DefReturnResult DefScriptPackage::func_profreset(CmdSet& Set)
+{
+    _profiler.Reset();
+    return true;
+}
+
+// writes the sorted summary into the given file, or prints it if no file is given
+DefReturnResult DefScriptPackage::func_profsummary(CmdSet& Set)
+{
+    return _profiler.WriteSummary(Set.defaultarg);
+}
+
+// writes collapsed stacks for flamegraph tools into the given file
+DefReturnResult DefScriptPackage::func_profflame(CmdSet& Set)
+{
+    if(Set.defaultarg.empty())
+        return false;
+    return _profiler.WriteCollapsed(Set.defaultarg);
+}
+
+// add a rule to matcher @0: if text matches pattern @def in mode @2 (NONE, ANY, ALL, EXACT, EXACT_PARTIAL), mmatch reports id @1
+DefReturnResult DefScriptPackage::func_madd(CmdSet& Set)
+{
+    unsigned char mode = DefMatcher::ModeByName(Set.arg[2]);
+    if(mode == DEFMATCH_INVALID)
+        return false;
+    return matchers.Get(_NormalizeVarName(Set.arg[0],Set.myname))->Add(Set.arg[1],mode,Set.defaultarg);
+}
+
+// remove all rules with id @def from matcher @0, returns how many
+DefReturnResult DefScriptPackage::func_mremove(CmdSet& Set)
+{
+    DefMatcher *m = matchers.GetNoCreate(_NormalizeVarName(Set.arg[0],Set.myname));
+    if(!m)
+        return "0";
+    return toString((uint64)m->Remove(Set.defaultarg));
+}
+
+// the chars in @def separate words for matcher @0
+DefReturnResult DefScriptPackage::func_mdelim(CmdSet& Set)
+{
+    matchers.Get(_NormalizeVarName(Set.arg[0],Set.myname))->SetDelimiters(Set.defaultarg);
+    return true;
+}
+
+// fill list @1 with the ids of the rules of matcher @0 that text @def matches, returns the amount
+DefReturnResult DefScriptPackage::func_mmatch(CmdSet& Set)
+{
+    DefList *l = lists.Get(_NormalizeVarName(Set.arg[1],Set.myname));
+    l->clear();
+    DefMatcher *m = matchers.GetNoCreate(_NormalizeVarName(Set.arg[0],Set.myname));
+    if(m)
+        m->Match(Set.defaultarg,*l);
+    _ListChanged(l);
+    return toString((uint64)l->size());
+}
+
+// return rule count, or nothing if the matcher doesnt exist
+DefReturnResult DefScriptPackage::func_mlen(CmdSet& Set)
+{
+    DefMatcher *m = matchers.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    if(!m)
+        return "";
+    return toString((uint64)m->Size());
+}
+
+DefReturnResult DefScriptPackage::func_mexists(CmdSet& Set)
+{
+    return matchers.Exists(_NormalizeVarName(Set.defaultarg,Set.myname));
+}
+
+DefReturnResult DefScriptPackage::func_mdelete(CmdSet& Set)
+{
+    matchers.Delete(_NormalizeVarName(Set.defaultarg,Set.myname));
+    return true;
 }
@@ -10,6 +10,7 @@ DefReturnResult DefScriptPackage::func_lpushback(CmdSet& Set)
 {
 	DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
 	l->push_back(Set.defaultarg);
+    _ListChanged(l);
 	return true;
 }
 
@@ -17,6 +18,7 @@ DefReturnResult DefScriptPackage::func_lpushfront(CmdSet& Set)
 {
 	DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
 	l->push_front(Set.defaultarg);
+    _ListChanged(l);
 	return true;
 }
 
@@ -28,6 +30,7 @@ DefReturnResult DefScriptPackage::func_lpopback(CmdSet& Set)
         return "";
 	r= l->back();
 	l->pop_back();
+    _ListChanged(l);
 	return r;
 }
 
@@ -39,6 +42,7 @@ DefReturnResult DefScriptPackage::func_lpopfront(CmdSet& Set)
         return "";
 	r = l->front();
 	l->pop_front();
+    _ListChanged(l);
 	return r;
 }
 
@@ -51,7 +55,10 @@ DefReturnResult DefScriptPackage::func_ldelete(CmdSet& Set)
         printf("DefScript: WARNING: ldelete used on a script list, clearing instead! (called by '%s', list '%s')\n",Set.myname.c_str(), lname.c_str());
         DefList *l = lists.GetNoCreate(lname);
         if(l)
+        {
             l->clear();
+            _ListChanged(l);
+        }
         return true;
     }
 	lists.Delete(lname);
@@ -91,6 +98,7 @@ DefReturnResult DefScriptPackage::func_linsert(CmdSet& Set)
 		l->insert(it,Set.defaultarg); // ... else insert at correct position
 		result = true;
 	}
+    _ListChanged(l);
 	return result;
 }
 
@@ -101,6 +109,7 @@ DefReturnResult DefScriptPackage::func_lsplit(CmdSet& Set)
 	// 1st create a new list, or get an already existing one and clear it
 	DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
     l->clear();
+    _ListChanged(l);
 	if(Set.defaultarg.empty()) // we cant split an empty string, return nothing, and keep empty list
 		return "";
 
@@ -137,6 +146,7 @@ DefReturnResult DefScriptPackage::func_lcsplit(CmdSet& Set)
 	// 1st create a new list, or get an already existing one and clear it
 	DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
     l->clear();
+    _ListChanged(l);
 	if(Set.defaultarg.empty()) // we cant split an empty string, return nothing, and keep empty list
 		return "";
 
@@ -203,6 +213,8 @@ DefReturnResult DefScriptPackage::func_lclean(CmdSet& Set)
         }
         i++;
     }
+    if(r)
+        _ListChanged(l);
     return toString((uint64)r);
 }
 
@@ -248,6 +260,8 @@ DefReturnResult DefScriptPackage::func_lmclean(CmdSet& Set)
             }
         }
     }
+    if(r)
+        _ListChanged(l);
     return toString((uint64)r);
 }
 
@@ -266,6 +280,7 @@ DefReturnResult DefScriptPackage::func_lerase(CmdSet& Set)
     advance(it,pos);
     r = *it;
     l->erase(it); // ... else erase at correct position
+    _ListChanged(l);
 
     return r;
 }
@@ -276,6 +291,7 @@ DefReturnResult DefScriptPackage::func_lsort(CmdSet& Set)
     if(!l)
         return false;
     sort(l->begin(),l->end());
+    _ListChanged(l);
     return true;
 }
 
@@ -0,0 +1,275 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <ctype.h>
+#include "DefScriptDefines.h"
+#include "UnorderedMap.h"
+#include "DefScriptMatcher.h"
+
+// what a term needs around it to count as a hit
+enum DefMatchTermType
+{
+    DEFTERM_SUB,    // nothing
+    DEFTERM_WORD,   // a delimiter or the end of the text on both sides
+    DEFTERM_EXACT   // the whole text
+};
+
+static inline unsigned char DefMatchFold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+DefMatcher::DefMatcher()
+{
+    for(unsigned int c = 0; c < 256; c++)
+        _delim[c] = c < 128 && (isspace(c) || ispunct(c));
+    _stamp = 0;
+    _dirty = true;
+}
+
+// the condition names of the chat AI scripts. "PARTIAL" is an alias for EXACT_PARTIAL
+unsigned char DefMatcher::ModeByName(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), toupper);
+    if(s.empty() || s == "NONE")
+        return DEFMATCH_NONE;
+    if(s == "ANY")
+        return DEFMATCH_ANY;
+    if(s == "ALL")
+        return DEFMATCH_ALL;
+    if(s == "EXACT")
+        return DEFMATCH_EXACT;
+    if(s == "EXACT_PARTIAL" || s == "PARTIAL")
+        return DEFMATCH_PARTIAL;
+    return DEFMATCH_INVALID;
+}
+
+// ids do not have to be unique, every rule that hits is reported
+bool DefMatcher::Add(const std::string& id, unsigned char mode, const std::string& pattern)
+{
+    if(mode >= DEFMATCH_INVALID)
+        return false;
+    Rule r;
+    r.id = id;
+    r.mode = mode;
+    r.pattern = pattern;
+    r.needed = 0;
+    _rules.push_back(r);
+    _dirty = true;
+    return true;
+}
+
+// removes all rules with that id, returns how many
+unsigned int DefMatcher::Remove(const std::string& id)
+{
+    unsigned int n = 0;
+    for(std::vector<Rule>::iterator it = _rules.begin(); it != _rules.end(); )
+    {
+        if(it->id == id)
+        {
+            it = _rules.erase(it);
+            n++;
+        }
+        else
+            it++;
+    }
+    if(n)
+        _dirty = true;
+    return n;
+}
+
+// patterns are split into words again if the delimiters change, so only a real change causes a rebuild
+void DefMatcher::SetDelimiters(const std::string& s)
+{
+    bool d[256] = { false };
+    for(unsigned int i = 0; i < s.length(); i++)
+        d[(unsigned char)s[i]] = true;
+    if(std::equal(d, d + 256, _delim))
+        return;
+    std::copy(d, d + 256, _delim);
+    _dirty = true;
+}
+
+int DefMatcher::_Child(int node, unsigned char c) const
+{
+    const std::vector<std::pair<unsigned char,int> >& ch = _nodes[node].child;
+    for(unsigned int i = 0; i < ch.size() && ch[i].first <= c; i++)
+        if(ch[i].first == c)
+            return ch[i].second;
+    return -1;
+}
+
+void DefMatcher::_AddTerm(const std::string& s, unsigned char type, unsigned int rule)
+{
+    int node = 0;
+    for(unsigned int i = 0; i < s.length(); i++)
+    {
+        unsigned char c = s[i];
+        int next = _Child(node, c);
+        if(next < 0)
+        {
+            next = _nodes.size();
+            _nodes.push_back(Node());
+            _nodes[next].fail = 0;
+            _nodes[next].out = -1;
+            _nodes[next].term = -1;
+            std::vector<std::pair<unsigned char,int> >& ch = _nodes[node].child;
+            ch.insert(std::lower_bound(ch.begin(), ch.end(), std::make_pair(c, -1)), std::make_pair(c, next));
+        }
+        node = next;
+    }
+    // the same string may be used in another way by another rule, it is then a term of its own
+    int t;
+    for(t = _nodes[node].term; t >= 0; t = _terms[t].next)
+        if(_terms[t].type == type)
+            break;
+    if(t < 0)
+    {
+        t = _terms.size();
+        _terms.push_back(Term());
+        _terms[t].type = type;
+        _terms[t].len = s.length();
+        _terms[t].next = _nodes[node].term;
+        _nodes[node].term = t;
+    }
+    if(_terms[t].rules.empty() || _terms[t].rules.back() != rule)
+        _terms[t].rules.push_back(rule);
+}
+
+void DefMatcher::_Build(void)
+{
+    _nodes.clear();
+    _terms.clear();
+    _always.clear();
+    _nodes.push_back(Node());
+    _nodes[0].fail = 0;
+    _nodes[0].out = -1;
+    _nodes[0].term = -1;
+
+    for(unsigned int r = 0; r < _rules.size(); r++)
+    {
+        Rule& rule = _rules[r];
+        std::string p(rule.pattern);
+        for(unsigned int i = 0; i < p.length(); i++)
+            p[i] = DefMatchFold(p[i]);
+        rule.needed = 0;
+
+        if(rule.mode == DEFMATCH_NONE)
+        {
+            _always.push_back(r);
+        }
+        else if(rule.mode == DEFMATCH_EXACT || rule.mode == DEFMATCH_PARTIAL)
+        {
+            if(p.empty())
+                continue;
+            _AddTerm(p, rule.mode == DEFMATCH_EXACT ? DEFTERM_EXACT : DEFTERM_SUB, r);
+            rule.needed = 1;
+        }
+        else // ANY, ALL: one term per different word
+        {
+            UNORDERED_SET<std::string> words;
+            unsigned int i = 0;
+            while(i < p.length())
+            {
+                while(i < p.length() && _delim[(unsigned char)p[i]])
+                    i++;
+                unsigned int start = i;
+                while(i < p.length() && !_delim[(unsigned char)p[i]])
+                    i++;
+                if(i > start && words.insert(p.substr(start, i - start)).second)
+                    _AddTerm(p.substr(start, i - start), DEFTERM_WORD, r);
+            }
+            if(!words.empty())
+                rule.needed = rule.mode == DEFMATCH_ANY ? 1 : words.size();
+        }
+    }
+
+    // fail links, breadth first so that the fail target of a node is always done before the node itself
+    std::deque<int> todo;
+    todo.push_back(0);
+    while(!todo.empty())
+    {
+        int node = todo.front();
+        todo.pop_front();
+        for(unsigned int i = 0; i < _nodes[node].child.size(); i++)
+        {
+            unsigned char c = _nodes[node].child[i].first;
+            int next = _nodes[node].child[i].second;
+            int f = _nodes[node].fail;
+            int target = -1;
+            if(node)
+            {
+                while((target = _Child(f, c)) < 0 && f)
+                    f = _nodes[f].fail;
+            }
+            _nodes[next].fail = target < 0 ? 0 : target;
+            _nodes[next].out = _nodes[next].term >= 0 ? next : _nodes[_nodes[next].fail].out;
+            todo.push_back(next);
+        }
+    }
+
+    _termstamp.assign(_terms.size(), 0);
+    _rulestamp.assign(_rules.size(), 0);
+    _rulecount.assign(_rules.size(), 0);
+    _stamp = 0;
+    _dirty = false;
+}
+
+// appends the ids of all rules that hit to the list, in the order the rules were added. returns their amount.
+unsigned int DefMatcher::Match(const std::string& text, std::deque<std::string>& hits)
+{
+    if(_dirty)
+        _Build();
+    if(!++_stamp) // wrapped around, old stamps could look current
+    {
+        std::fill(_termstamp.begin(), _termstamp.end(), 0);
+        std::fill(_rulestamp.begin(), _rulestamp.end(), 0);
+        _stamp = 1;
+    }
+
+    std::vector<unsigned int> hit(_always);
+    unsigned int len = text.length();
+    int node = 0;
+    for(unsigned int i = 0; i < len; i++)
+    {
+        unsigned char c = DefMatchFold(text[i]);
+        int next;
+        while((next = _Child(node, c)) < 0 && node)
+            node = _nodes[node].fail;
+        node = next < 0 ? 0 : next;
+
+        for(int o = _nodes[node].out; o >= 0; o = _nodes[_nodes[o].fail].out)
+        {
+            for(int t = _nodes[o].term; t >= 0; t = _terms[t].next)
+            {
+                Term& term = _terms[t];
+                if(_termstamp[t] == _stamp)
+                    continue;
+                unsigned int end = i + 1, start = end - term.len;
+                if(term.type == DEFTERM_EXACT && (start || end != len))
+                    continue;
+                if(term.type == DEFTERM_WORD && !((!start || _delim[(unsigned char)text[start - 1]])
+                                               && (end == len || _delim[(unsigned char)text[end]])))
+                    continue;
+                _termstamp[t] = _stamp;
+                for(unsigned int k = 0; k < term.rules.size(); k++)
+                {
+                    unsigned int r = term.rules[k];
+                    if(_rulestamp[r] != _stamp)
+                    {
+                        _rulestamp[r] = _stamp;
+                        _rulecount[r] = 0;
+                    }
+                    if(++_rulecount[r] == _rules[r].needed)
+                        hit.push_back(r);
+                }
+            }
+        }
+    }
+
+    std::sort(hit.begin(), hit.end());
+    for(unsigned int i = 0; i < hit.size(); i++)
+        hits.push_back(_rules[hit[i]].id);
+    return hit.size();
+}
@@ -0,0 +1,70 @@
+#ifndef DEFSCRIPTMATCHER_H
+#define DEFSCRIPTMATCHER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include "DefScriptDefines.h"
+
+enum DefMatchMode
+{
+    DEFMATCH_NONE,      // always hits
+    DEFMATCH_ANY,       // any word of the pattern is a word of the text
+    DEFMATCH_ALL,       // every word of the pattern is a word of the text, in any order
+    DEFMATCH_EXACT,     // the text is the pattern
+    DEFMATCH_PARTIAL,   // the pattern is somewhere in the text
+    DEFMATCH_INVALID
+};
+
+// matches a text against many patterns at once. each rule has an id, a mode and a pattern.
+// all pattern strings go into one Aho-Corasick automaton, built on the first Match() after the rules changed,
+// so a text is scanned only once no matter how many rules there are.
+// case is ignored for ASCII letters. words are separated by delimiter chars, which are whitespace and
+// ASCII punctuation unless set otherwise; bytes >= 128 are never delimiters by default, so UTF-8 letters stay in their words.
+class DefMatcher
+{
+public:
+    DefMatcher();
+    static unsigned char ModeByName(std::string);
+    bool Add(const std::string& id, unsigned char mode, const std::string& pattern);
+    unsigned int Remove(const std::string& id);
+    void SetDelimiters(const std::string&);
+    unsigned int Match(const std::string& text, std::deque<std::string>& hits);
+    inline unsigned int Size(void) const { return _rules.size(); }
+
+private:
+    struct Rule
+    {
+        std::string id, pattern;
+        unsigned char mode;
+        unsigned int needed; // amount of different terms that must hit
+    };
+    struct Term
+    {
+        unsigned char type;
+        unsigned int len;
+        int next; // another term that ends at the same node, or -1
+        std::vector<unsigned int> rules;
+    };
+    struct Node
+    {
+        std::vector<std::pair<unsigned char,int> > child; // sorted by char
+        int fail; // longest proper suffix that is also in the trie
+        int out; // this or the nearest node on the fail chain where terms end, or -1
+        int term; // first term ending here, or -1
+    };
+    void _Build(void);
+    void _AddTerm(const std::string&, unsigned char type, unsigned int rule);
+    int _Child(int node, unsigned char c) const;
+
+    std::vector<Rule> _rules;
+    std::vector<Term> _terms;
+    std::vector<Node> _nodes;
+    std::vector<unsigned int> _always; // rules in DEFMATCH_NONE mode
+    std::vector<unsigned int> _termstamp, _rulestamp, _rulecount; // per Match() call state, valid if the stamp is current
+    unsigned int _stamp;
+    bool _delim[256];
+    bool _dirty;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "DefScriptDefines.h"
+#include "DefScriptTools.h"
+#include "DefScriptProfiler.h"
+
+using namespace DefScriptTools;
+
+static const char *DefProfTypeName[] = { "script", "line", "func", "event" };
+
+DefScriptProfiler::DefScriptProfiler()
+{
+    _active = false;
+}
+
+void DefScriptProfiler::Start(void)
+{
+    _active = true;
+}
+
+// frames that are running keep being measured until they return
+void DefScriptProfiler::Stop(void)
+{
+    _active = false;
+}
+
+// the stats of frames that are on the stack must stay, they are only zeroed
+void DefScriptProfiler::Reset(void)
+{
+    for(DefProfStatsMap::iterator i = _stats.begin(); i != _stats.end(); i++)
+    {
+        i->second.calls = 0;
+        i->second.incl = 0;
+        i->second.excl = 0;
+    }
+    _stacks.clear();
+}
+
+void DefScriptProfiler::Enter(unsigned char type, const std::string& name, int line)
+{
+    std::string fname(name);
+    if(line > 0)
+        fname += ':' + toString(line);
+    else if(line < 0) // added at runtime, "name:+position"
+        fname += ":+" + toString(-line);
+    else if(type == DEFPROF_FUNC)
+        fname += "()";
+    else if(type == DEFPROF_EVENT)
+        fname.insert(0,"event:");
+    std::replace(fname.begin(), fname.end(), ';', ':'); // ';' separates frames
+    std::replace(fname.begin(), fname.end(), '\n', ' ');
+
+    DefProfStats& st = _stats[fname];
+    if(st.name.empty()) // new entry
+    {
+        st.type = type;
+        st.name = fname;
+    }
+    st.calls++;
+    st.active++;
+
+    Frame f;
+    f.stats = &st;
+    f.pathlen = _path.length();
+    f.children = 0;
+    if(!_path.empty())
+        _path += ';';
+    _path += fname;
+    _stack.push_back(f);
+    _stack.back().start = getMonotonicUsec(); // last, so that the bookkeeping above is not measured
+}
+
+void DefScriptProfiler::Leave(void)
+{
+    uint64 now = getMonotonicUsec();
+    if(_stack.empty())
+        return;
+    Frame& f = _stack.back();
+    uint64 total = now - f.start;
+    uint64 self = total > f.children ? total - f.children : 0;
+    if(!--f.stats->active)
+        f.stats->incl += total;
+    f.stats->excl += self;
+    _stacks[_path] += self;
+    _path.erase(f.pathlen);
+    _stack.pop_back();
+    if(!_stack.empty())
+        _stack.back().children += total;
+}
+
+// one line per call path: "frame;frame;frame <exclusive microseconds>", the input format of flamegraph.pl
+bool DefScriptProfiler::WriteCollapsed(std::string fn)
+{
+    FILE *fh = fopen(fn.c_str(), "w");
+    if(!fh)
+        return false;
+    for(DefProfStackMap::iterator i = _stacks.begin(); i != _stacks.end(); i++)
+        if(i->second)
+            fprintf(fh, "%s " I64FMTD "\n", i->first.c_str(), i->second);
+    fclose(fh);
+    return true;
+}
+
+static bool DefProfSortByExcl(const DefProfStats *a, const DefProfStats *b)
+{
+    return a->excl != b->excl ? a->excl > b->excl : a->incl > b->incl;
+}
+
+// all measured scripts, lines, functions and events, the most expensive ones (by exclusive time) first.
+// writes to stdout if no file name is given.
+bool DefScriptProfiler::WriteSummary(std::string fn)
+{
+    FILE *fh = fn.empty() ? stdout : fopen(fn.c_str(), "w");
+    if(!fh)
+        return false;
+
+    std::vector<const DefProfStats*> sorted;
+    uint64 total = 0;
+    for(DefProfStatsMap::iterator i = _stats.begin(); i != _stats.end(); i++)
+    {
+        if(!i->second.calls)
+            continue;
+        sorted.push_back(&(i->second));
+        total += i->second.excl;
+    }
+    std::sort(sorted.begin(), sorted.end(), DefProfSortByExcl);
+
+    fprintf(fh, "%-6s %12s %12s %12s %6s %10s  %s\n", "type", "calls", "incl ms", "excl ms", "excl%", "avg us", "name");
+    for(unsigned int i = 0; i < sorted.size(); i++)
+    {
+        const DefProfStats *st = sorted[i];
+        fprintf(fh, "%-6s %12s %12.3f %12.3f %6.2f %10.1f  %s\n",
+            DefProfTypeName[st->type],
+            toString(st->calls).c_str(),
+            st->incl / 1000.0,
+            st->excl / 1000.0,
+            total ? st->excl * 100.0 / total : 0.0,
+            double(st->incl) / st->calls,
+            st->name.c_str());
+    }
+    if(fh != stdout)
+        fclose(fh);
+    return true;
+}
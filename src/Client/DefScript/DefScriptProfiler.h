@@ -0,0 +1,80 @@
+#ifndef DEFSCRIPTPROFILER_H
+#define DEFSCRIPTPROFILER_H
+
+#include <string>
+#include <vector>
+#include "DefScriptDefines.h"
+#include "UnorderedMap.h"
+
+enum DefProfNodeType
+{
+    DEFPROF_SCRIPT,
+    DEFPROF_LINE,
+    DEFPROF_FUNC,
+    DEFPROF_EVENT
+};
+
+struct DefProfStats
+{
+    DefProfStats() { type=DEFPROF_SCRIPT; calls=0; incl=0; excl=0; active=0; }
+    unsigned char type;
+    std::string name;
+    uint64 calls;
+    uint64 incl, excl; // microseconds
+    unsigned int active; // how often it is on the stack right now, recursive calls count into incl only once
+};
+
+typedef UNORDERED_MAP<std::string,DefProfStats> DefProfStatsMap;
+typedef UNORDERED_MAP<std::string,uint64> DefProfStackMap;
+
+// measures call counts and inclusive/exclusive wall time of scripts, script lines, builtin functions and events.
+// every measured call is a frame on a stack, so nested script calls show up with their full call path.
+class DefScriptProfiler
+{
+public:
+    DefScriptProfiler();
+    inline bool IsActive(void) const { return _active; }
+    void Start(void);
+    void Stop(void);
+    void Reset(void);
+    // line: number of a script line in its file, or minus its position in the script if it does not come from a file
+    void Enter(unsigned char type, const std::string& name, int line = 0);
+    void Leave(void);
+    bool WriteCollapsed(std::string fn);
+    bool WriteSummary(std::string fn);
+
+private:
+    struct Frame
+    {
+        DefProfStats *stats;
+        std::string::size_type pathlen; // length of _path before this frame was added
+        uint64 start, children;
+    };
+    std::vector<Frame> _stack;
+    std::string _path; // names of all frames on the stack separated by ';', as flamegraph tools expect it
+    DefProfStatsMap _stats;
+    DefProfStackMap _stacks; // exclusive time per call path
+    bool _active;
+};
+
+// measures the scope it lives in, if the profiler was running when it started
+class DefProfScope
+{
+public:
+    DefProfScope(DefScriptProfiler& p, unsigned char type, const std::string& name, int line = 0)
+    {
+        _p = p.IsActive() ? &p : NULL;
+        if(_p)
+            _p->Enter(type,name,line);
+    }
+    ~DefProfScope()
+    {
+        if(_p)
+            _p->Leave();
+    }
+
+private:
+    DefScriptProfiler *_p;
+};
+
+#endif
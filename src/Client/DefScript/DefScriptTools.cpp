@@ -10,6 +10,13 @@
 #include "DefScriptDefines.h"
 #include "DefScriptTools.h"
 
+#if PLATFORM == PLATFORM_WIN32
+#   include <windows.h>
+#else
+#   include <time.h>
+#   include <sys/time.h>
+#endif
+
 
 std::string DefScriptTools::stringToLower(std::string s)
 {
@@ -152,3 +159,26 @@ inline long double DefScriptTools::Round(long double z,unsigned int n)
     static long double v[] = { 1, 10, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16 };
     return floor(z * v[n] + 0.5) / v[n];
 }
+
+// microseconds since an arbitrary point in time. unlike clock() this is wall time, not cpu time,
+// and it never goes backwards when the system clock is changed.
+uint64 DefScriptTools::getMonotonicUsec(void)
+{
+#if PLATFORM == PLATFORM_WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if(!freq.QuadPart && !QueryPerformanceFrequency(&freq))
+        freq.QuadPart = -1;
+    if(freq.QuadPart < 0 || !QueryPerformanceCounter(&now)) // no performance counter, ms resolution has to do
+        return uint64(GetTickCount()) * 1000;
+    return uint64(now.QuadPart / freq.QuadPart) * 1000000 + uint64(now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else // no monotonic clock available, fall back to the system time
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return uint64(tv.tv_sec) * 1000000 + tv.tv_usec;
+#endif
+}
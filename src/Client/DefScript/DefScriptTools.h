@@ -22,6 +22,7 @@ namespace DefScriptTools
     bool isTrue(std::string);
     uint64 toUint64(std::string);
     uint64 atoi64(std::string);
+    uint64 getMonotonicUsec(void);
 	inline long double Round(long double z,unsigned int n);
 }
 
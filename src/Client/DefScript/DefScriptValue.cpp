@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string>
+#include <math.h>
+#include <ctype.h>
+#include "DefScriptDefines.h"
+#include "DefScriptTools.h"
+#include "DefScriptValue.h"
+
+using namespace DefScriptTools;
+
+// integers below this are kept as numbers only, toString() prints them exactly and toNumber() reads them back unchanged.
+// larger values lose digits in the rounding of toString(), for them the string is made at once.
+#define DEFVAL_EXACT_INT 536870912 // 2^29
+
+DefValue::DefValue(ldbl n)
+{
+    if(n > -DEFVAL_EXACT_INT && n < DEFVAL_EXACT_INT && n == floor(n))
+    {
+        _num = n ? n : 0; // toString() prints -0 as 0
+        _has = DEFVAL_NUM;
+    }
+    else
+    {
+        _str = toString(n);
+        _has = DEFVAL_STR;
+    }
+}
+
+DefValue::DefValue(uint64 u)
+{
+    if(u < (uint64)DEFVAL_EXACT_INT)
+    {
+        _num = (ldbl)u;
+        _has = DEFVAL_NUM;
+    }
+    else
+    {
+        _str = toString(u);
+        _has = DEFVAL_STR;
+    }
+    _u64 = u;
+    _has |= DEFVAL_U64;
+}
+
+const std::string& DefValue::str(void) const
+{
+    if(!(_has & DEFVAL_STR))
+    {
+        char buf[16];
+        sprintf(buf,"%d",(int)_num);
+        _str = buf;
+        _has |= DEFVAL_STR;
+    }
+    return _str;
+}
+
+ldbl DefValue::num(void) const
+{
+    if(!(_has & DEFVAL_NUM))
+    {
+        _num = toNumber(_str);
+        _has |= DEFVAL_NUM;
+    }
+    return _num;
+}
+
+uint64 DefValue::u64(void) const
+{
+    if(!(_has & DEFVAL_U64))
+    {
+        if(_has & DEFVAL_STR)
+            _u64 = toUint64(_str);
+        else // what toUint64() makes of the printed integer
+            _u64 = _num < 0 ? (uint64)(-1) - (uint64)(-_num) : (uint64)_num;
+        _has |= DEFVAL_U64;
+    }
+    return _u64;
+}
+
+bool DefValue::isTrue(void) const
+{
+    if(_has & DEFVAL_STR)
+        return DefScriptTools::isTrue(_str);
+    return _num != 0;
+}
+
+bool DefValue::Cache(void) const
+{
+    const std::string& s = str();
+    if(s.empty() || !(isdigit((unsigned char)s[0]) || s[0]=='-' || s[0]=='.'))
+        return false;
+    num();
+    u64();
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef DEFSCRIPTVALUE_H
+#define DEFSCRIPTVALUE_H
+
+#include <string>
+#include "DefScriptDefines.h"
+
+enum DefValueForm
+{
+    DEFVAL_STR = 0x01,
+    DEFVAL_NUM = 0x02,
+    DEFVAL_U64 = 0x04
+};
+
+// a value as scripts see it. to scripts everything is a string, but a value can be created from a number
+// and its numeric forms are converted on first use and kept, so a value used in calculations over and over
+// is parsed only once. num() and u64() always equal toNumber()/toUint64() of str(),
+// no matter which form the value was created from.
+class DefValue
+{
+public:
+    DefValue() { _has=DEFVAL_STR; }
+    DefValue(const std::string& s) : _str(s) { _has=DEFVAL_STR; }
+    DefValue(const char *s) : _str(s) { _has=DEFVAL_STR; }
+    explicit DefValue(ldbl);
+    explicit DefValue(uint64);
+
+    const std::string& str(void) const;
+    ldbl num(void) const; // float and integer form, like toNumber()
+    uint64 u64(void) const; // integer and GUID form, like toUint64()
+    bool isTrue(void) const;
+    bool Cache(void) const; // converts numeric-looking strings now, so that copies of the value have the numbers already
+    inline bool IsNumberOnly(void) const { return !(_has & DEFVAL_STR); } // no string made yet, str() is a plain integer
+    inline void clear(void) { _str.clear(); _has=DEFVAL_STR; }
+    inline bool empty(void) const { return str().empty(); }
+    inline std::string::size_type size(void) const { return str().size(); }
+    inline const char *c_str(void) const { return str().c_str(); }
+    inline operator const std::string&() const { return str(); }
+
+private:
+    mutable std::string _str;
+    mutable ldbl _num;
+    mutable uint64 _u64;
+    mutable unsigned char _has; // DefValueForm bits of the forms that are valid
+};
+
+#endif
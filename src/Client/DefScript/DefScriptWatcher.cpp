@@ -0,0 +1,96 @@
+#include <string>
+#include <map>
+#include <set>
+#include "DefScriptDefines.h"
+#include "DefScriptTools.h"
+#include "DefScriptWatcher.h"
+
+#ifdef DEFSCRIPT_INOTIFY
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <errno.h>
+#endif
+
+using namespace DefScriptTools;
+
+DefScriptWatcher::DefScriptWatcher()
+{
+    _fd = -1;
+}
+
+DefScriptWatcher::~DefScriptWatcher()
+{
+    Clear();
+}
+
+bool DefScriptWatcher::Watch(std::string dir)
+{
+#ifdef DEFSCRIPT_INOTIFY
+    if(dir.empty())
+        dir = "./";
+    if(dir[dir.length()-1] != '/')
+        dir += '/';
+    if(_fd < 0)
+    {
+        _fd = inotify_init();
+        if(_fd < 0)
+            return false;
+        fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+        fcntl(_fd, F_SETFD, FD_CLOEXEC);
+    }
+    // editors save in place (close after write) or write a temp file and rename it over the old one (moved to)
+    int wd = inotify_add_watch(_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+    if(wd < 0)
+        return false;
+    _dirs[wd] = dir;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void DefScriptWatcher::Clear(void)
+{
+#ifdef DEFSCRIPT_INOTIFY
+    if(_fd >= 0)
+        close(_fd); // also removes all watches
+#endif
+    _fd = -1;
+    _dirs.clear();
+}
+
+bool DefScriptWatcher::Poll(std::set<std::string>& files)
+{
+    bool complete = true;
+#ifdef DEFSCRIPT_INOTIFY
+    if(_fd < 0)
+        return true;
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    while(true)
+    {
+        ssize_t len = read(_fd, buf, sizeof(buf));
+        if(len <= 0) // EAGAIN: nothing more to read
+            break;
+        for(char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+        {
+            struct inotify_event *ev = (struct inotify_event*)p;
+            if(ev->mask & IN_Q_OVERFLOW)
+            {
+                complete = false;
+                continue;
+            }
+            if(!ev->len || (ev->mask & IN_ISDIR))
+                continue;
+            std::map<int,std::string>::iterator it = _dirs.find(ev->wd);
+            if(it == _dirs.end())
+                continue;
+            std::string fn(ev->name);
+            if(fn.length() < 5 || stringToLower(fn.substr(fn.length() - 4)) != ".def")
+                continue;
+            files.insert(it->second + fn);
+        }
+    }
+#endif
+    return complete;
+}
@@ -0,0 +1,32 @@
+#ifndef DEFSCRIPTWATCHER_H
+#define DEFSCRIPTWATCHER_H
+
+#include <string>
+#include <map>
+#include <set>
+#include "DefScriptDefines.h"
+
+#if PLATFORM == PLATFORM_UNIX && defined(__linux__)
+#  define DEFSCRIPT_INOTIFY
+#endif
+
+// reports .def files that were written, created, moved or deleted in the watched directories (not recursive).
+// uses inotify; on systems without it nothing can be watched and Watch() fails.
+class DefScriptWatcher
+{
+public:
+    DefScriptWatcher();
+    ~DefScriptWatcher();
+    bool Watch(std::string dir);
+    void Clear(void);
+    inline bool IsActive(void) const { return !_dirs.empty(); }
+    // adds the path of every file that changed since the last call, never blocks.
+    // returns false if there were too many changes at once and some were lost
+    bool Poll(std::set<std::string>& files);
+
+private:
+    int _fd;
+    std::map<int,std::string> _dirs; // watch descriptor -> directory, ending with '/'
+};
+
+#endif
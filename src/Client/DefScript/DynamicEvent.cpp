@@ -1,102 +1,167 @@
 #include "DefScript.h"
 #include "DynamicEvent.h"
 
+using namespace DefScriptTools;
+
 struct DefScript_DynamicEvent
 {
-	std::string name, cmd, parent;
-	clock_t counter, interval;
-    bool ran; // if a script has an execution time longer then the interval, and modifies an event, need to check if the event was already triggered, to prevent endless loop
+	std::string name, parent;
+    DefScriptInstruction code; // the command, compiled when the event is added
+	uint64 due, interval; // monotonic time in microseconds
+    uint64 seq;
+    unsigned int heappos;
+    bool running, removed; // an event removed while it runs is deleted when it returns
 };
 
+static inline bool DefEventEarlier(const DefScript_DynamicEvent *a, const DefScript_DynamicEvent *b)
+{
+    return a->due != b->due ? a->due < b->due : a->seq < b->seq;
+}
+
 DefScript_DynamicEventMgr::DefScript_DynamicEventMgr(DefScriptPackage *pack)
 {
 	_pack = pack;
-	_lastclock = clock();
-    _events_changed = false;
+    _seq = 0;
 }
 
 DefScript_DynamicEventMgr::~DefScript_DynamicEventMgr()
 {
+    _heap.clear();
     _storage.Clear();
 }
 
-void DefScript_DynamicEventMgr::Add(std::string name, std::string script, clock_t interval, const char *parent, bool force)
+void DefScript_DynamicEventMgr::Add(std::string name, std::string script, uint32 interval, const char *parent, bool force)
 {
     _DEFSC_DEBUG( printf("DEFSCRIPT: Add Event %s, interval=%u, parent=%s\n",name.c_str(),interval,parent?parent:""); printf("DEFSCRIPT: EventRun='%s'\n",script.c_str()); )
     if(name.empty() || script.empty() || interval==0)
         return;
-    if(_storage.Exists(name) && !force)
-        return;
+    if(_storage.Exists(name))
+    {
+        if(!force)
+            return;
+        Remove(name);
+    }
 
-    DefScript_DynamicEvent *e = _storage.Get(name);
+    DefScript_DynamicEvent *e = new DefScript_DynamicEvent;
     e->name = name;
-    e->cmd = script;
-    e->interval = interval;
     e->parent = parent?parent:"";
-    e->counter = 0;
-    e->ran = false;
-    _events_changed = true;
+    _pack->_CompileLine(e->code,script);
+    e->interval = uint64(interval) * 1000;
+    e->due = getMonotonicUsec() + e->interval;
+    e->seq = _seq++;
+    e->running = false;
+    e->removed = false;
+    _storage.Assign(name,e);
+    _Push(e);
 }
 
 void DefScript_DynamicEventMgr::Remove(std::string name)
 {
-    _storage.Delete(name);
-    _events_changed = true;
+    DefScript_DynamicEvent *e = _storage.GetNoCreate(name);
+    if(!e)
+        return;
+    _storage.Unlink(name);
+    _Erase(e);
+    if(e->running)
+        e->removed = true;
+    else
+        delete e;
 }
 
+// runs every event that is due. an event runs at most once per call, if it is late it is not run
+// again to catch up, but stays in its interval.
 void DefScript_DynamicEventMgr::Update(void)
 {
-    bool decr_timer = false;
-    clock_t diff = clock() - _lastclock;
-    _lastclock = clock();
+    uint64 now = getMonotonicUsec();
     DefScript *sc;
     DefScript_DynamicEvent *e;
-    _events_changed = false;
 
-    for(std::map<std::string,DefScript_DynamicEvent*>::iterator i = _storage.GetMap().begin(); i != _storage.GetMap().end(); i++ )
+    while(!_heap.empty() && _heap[0]->due <= now)
     {
-        i->second->ran = false;
-    }
+        e = _heap[0];
+        // reschedule before running, the event may remove or re-add itself or others
+        e->due = now - (now - e->due) % e->interval + e->interval;
+        _SiftDown(0);
 
-    for(std::map<std::string,DefScript_DynamicEvent*>::iterator i = _storage.GetMap().begin(); i != _storage.GetMap().end(); )
-    {
-        e = i->second;
         sc = NULL;
+        e->running = true;
 		try
 		{
-			e->counter += diff;
-			if(e->counter >= e->interval && !e->ran)
-			{
-				decr_timer = true;
-
-				if(!e->parent.empty())
-					sc = _pack->GetScript(e->parent);
-
-				if(sc)
-					_pack->RunSingleLineFromScript(e->cmd,sc);
-				else
-					_pack->RunSingleLine(e->cmd);
-			}
+            DefProfScope prof(_pack->GetProfiler(),DEFPROF_EVENT,e->name);
+
+            if(!e->parent.empty())
+                sc = _pack->GetScript(e->parent);
+
+            _pack->_RunCompiledLine(e->code,sc);
 		}
 		catch (...)
 		{
 			printf("Error in DefScript_DynamicEventMgr::Update()\n");
+            e->running = false;
+            if(e->removed)
+                delete e;
             return;
 		}
-        if(decr_timer)
-        {
-            e->counter %= e->interval;
-            e->ran = true;
-            decr_timer = false;
-        }
-        if(_events_changed)
-        {
-            _events_changed = false;
-            i = _storage.GetMap().begin();
-        }
-        else
-        {
-            i++;
-        }
+        e->running = false;
+        if(e->removed)
+            delete e;
     }
 }
+
+void DefScript_DynamicEventMgr::_Push(DefScript_DynamicEvent *e)
+{
+    _heap.push_back(e);
+    e->heappos = _heap.size() - 1;
+    _SiftUp(e->heappos);
+}
+
+void DefScript_DynamicEventMgr::_Erase(DefScript_DynamicEvent *e)
+{
+    unsigned int pos = e->heappos;
+    DefScript_DynamicEvent *last = _heap.back();
+    _heap.pop_back();
+    if(last == e)
+        return;
+    _Place(last,pos);
+    _SiftUp(pos);
+    _SiftDown(last->heappos);
+}
+
+void DefScript_DynamicEventMgr::_SiftUp(unsigned int pos)
+{
+    DefScript_DynamicEvent *e = _heap[pos];
+    while(pos)
+    {
+        unsigned int parent = (pos - 1) / 2;
+        if(!DefEventEarlier(e, _heap[parent]))
+            break;
+        _Place(_heap[parent],pos);
+        pos = parent;
+    }
+    _Place(e,pos);
+}
+
+void DefScript_DynamicEventMgr::_SiftDown(unsigned int pos)
+{
+    DefScript_DynamicEvent *e = _heap[pos];
+    unsigned int size = _heap.size();
+    while(true)
+    {
+        unsigned int child = pos * 2 + 1;
+        if(child >= size)
+            break;
+        if(child + 1 < size && DefEventEarlier(_heap[child + 1], _heap[child]))
+            child++;
+        if(!DefEventEarlier(_heap[child], e))
+            break;
+        _Place(_heap[child],pos);
+        pos = child;
+    }
+    _Place(e,pos);
+}
+
+inline void DefScript_DynamicEventMgr::_Place(DefScript_DynamicEvent *e, unsigned int pos)
+{
+    _heap[pos] = e;
+    e->heappos = pos;
+}
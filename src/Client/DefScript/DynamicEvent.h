@@ -1,10 +1,11 @@
 #ifndef _DEF_DYNAMICEVENT_H
 #define _DEF_DYNAMICEVENT_H
 
-#include <time.h>
 #include <list>
+#include <vector>
 #include <string>
 
+#include "DefScriptDefines.h"
 #include "TypeStorage.h"
 
 struct DefScript_DynamicEvent;
@@ -17,15 +18,20 @@ class DefScript_DynamicEventMgr
 public:
     DefScript_DynamicEventMgr(DefScriptPackage *pack);
     ~DefScript_DynamicEventMgr();
-    void Add(std::string name, std::string script, clock_t interval, const char *parent, bool force = false);
+    void Add(std::string name, std::string script, uint32 interval, const char *parent, bool force = false); // interval in ms
 	void Remove(std::string name);
 	void Update(void);
 	
 private:
+    void _Push(DefScript_DynamicEvent*);
+    void _Erase(DefScript_DynamicEvent*);
+    void _SiftUp(unsigned int);
+    void _SiftDown(unsigned int);
+    void _Place(DefScript_DynamicEvent*, unsigned int);
 	DefDynamicEventStorage _storage;
-	clock_t _lastclock;
+    std::vector<DefScript_DynamicEvent*> _heap; // min-heap on the time an event is due next, earliest at [0]
+    uint64 _seq; // orders events that are due at the same time by when they were added
     DefScriptPackage *_pack;
-    bool _events_changed; // this one helps to detect if a script called from an event has modified the event storage (risk of iterator invalidation!)
 };
 
 #endif
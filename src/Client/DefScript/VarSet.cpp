@@ -8,75 +8,105 @@
 
 VarSet::VarSet()
 {
+    _gen=0;
 }
 
 VarSet::~VarSet()
 {
-	Clear();
+    Clear();
 }
 
-std::string VarSet::Get(std::string varname)
+Var *VarSet::Find(const std::string& varname)
 {
-    for(std::deque<Var>::iterator i=buffer.begin();i!=buffer.end();i++)
-		if( i->name==varname )
-			return i->value;
+    VarMap::iterator i=_names.find(varname);
+    return i==_names.end() ? NULL : i->second;
+}
+
+Var *VarSet::GetSlot(const std::string& varname)
+{
+    Var *&v=_names[varname];
+    if(!v)
+    {
+        v=new Var;
+        v->name=varname;
+        _gen++;
+    }
+    return v;
+}
+
+std::string VarSet::Get(const std::string& varname)
+{
+    Var *v=Find(varname);
+    if(v && v->IsSet())
+        return v->value.str();
     return ""; // if var has not been set return empty string
 }
 
-void VarSet::Set(std::string varname, std::string varvalue)
+void VarSet::Set(const std::string& varname, const DefValue& varvalue)
 {
 	if(varname.empty())
         return;
-	for(std::deque<Var>::iterator i = buffer.begin();i!=buffer.end();i++)
+    Set(GetSlot(varname),varvalue);
+}
+
+void VarSet::Set(Var *v, const DefValue& varvalue)
+{
+    if(v->name.empty())
+        return;
+    v->value=varvalue;
+    if(!v->IsSet())
     {
-		if( i->name==varname )
-        {
-			i->value=varvalue;
-			return;
-		}
-	}
-    Var v;
-    v.name=varname;
-    v.value=varvalue;
-    buffer.push_back(v);
-	return;
+        v->pos=_vars.size();
+        _vars.push_back(v);
+    }
 }
 
 unsigned int VarSet::Size(void)
 {
-    return buffer.size();
+    return _vars.size();
 }
 
-bool VarSet::Exists(std::string varname)
+bool VarSet::Exists(const std::string& varname)
 {
-	for(std::deque<Var>::iterator i = buffer.begin();i!=buffer.end();i++)
-        if(i->name==varname)
-            return true;
-	return false;
+    Var *v=Find(varname);
+    return v && v->IsSet();
 }
 
-void VarSet::Unset(std::string varname)
+void VarSet::Unset(const std::string& varname)
 {
     if ( varname.empty() )
         return;
-	for(std::deque<Var>::iterator i = buffer.begin();i!=buffer.end();i++)
+    Var *v=Find(varname);
+    if(v)
+        Unset(v);
+}
+
+// removed from the index list by moving the last one into its place, then freed
+void VarSet::Unset(Var *v)
+{
+    if(v->IsSet())
     {
-		if(i->name==varname)
-        {
-			buffer.erase(i);
-			return;
-		}
-	}
+        _vars[v->pos]=_vars.back();
+        _vars[v->pos]->pos=v->pos;
+        _vars.pop_back();
+    }
+    _names.erase(v->name);
+    delete v;
+    _gen++;
 }
 
 void VarSet::Clear(void)
 {
-    buffer.clear();
+    for(VarMap::iterator i=_names.begin();i!=_names.end();i++)
+        delete i->second;
+    _names.clear();
+    _vars.clear();
+    _gen++;
 }
 
 Var VarSet::operator[](unsigned int id)
  {
-     return buffer.at(id);
+     return *_vars.at(id);
  }
 	
 bool VarSet::ReadVarsFromFile(std::string fn)
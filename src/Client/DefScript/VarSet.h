@@ -2,30 +2,50 @@
 #define __VARSET_H
 
 #include <string>
-#include <deque>
+#include <vector>
+#include "UnorderedMap.h"
+#include "DefScriptValue.h"
 
+#define VAR_UNSET 0xFFFFFFFF
 
+// there is exactly one Var per name. it is freed when the variable is unset, so a Var* must not be kept
+// across anything that could unset it (running script code, for example), unless VarSet::Generation() is checked.
 struct Var {
-    std::string name, value;
+    Var() { pos=VAR_UNSET; }
+    std::string name;
+    DefValue value; // keeps its numeric forms, see DefValue
+    unsigned int pos; // index in VarSet::operator[], VAR_UNSET if the variable does not exist
+    inline bool IsSet(void) const { return pos != VAR_UNSET; }
 };
-	
+
+typedef UNORDERED_MAP<std::string,Var*> VarMap;
 
 class VarSet {
 public:
-    void Set(std::string,std::string);
-    std::string Get(std::string);
+    void Set(const std::string&,const DefValue&);
+    std::string Get(const std::string&);
 	void Clear(void);
-	void Unset(std::string);
+	void Unset(const std::string&);
 	unsigned int Size(void);
-	bool Exists(std::string);
+	bool Exists(const std::string&);
     bool ReadVarsFromFile(std::string fn);
-    Var operator[](unsigned int id);
+    Var operator[](unsigned int id); // iteration order is undefined, it changes when a variable is unset
+    Var *Find(const std::string&); // NULL if the variable does not exist, check IsSet() anyway
+    Var *GetSlot(const std::string&); // like Find(), but creates an unset Var if necessary, which Set() or Unset() must follow
+    void Set(Var*,const DefValue&);
+    void Unset(Var*); // deletes the Var
+    // changes whenever a Var is created or freed. as long as it stays the same, every name still has the Var
+    // (or no Var) it had before, so a Var* found earlier can be used instead of looking the name up again
+    inline unsigned int Generation(void) const { return _gen; }
 	VarSet();
 	~VarSet();
 	// far future: MergeWith(VarSet,bool overwrite);
 
 private:
-    std::deque<Var> buffer;
+    VarMap _names;
+    std::vector<Var*> _vars; // variables that are set, Var::pos is the index here
+    unsigned int _gen;
+    VarSet(const VarSet&); // not copyable, owns the Vars
     std::string toLower(std::string);
     std::string toUpper(std::string);
 
@@ -35,7 +35,9 @@ void DefScriptPackage::_InitDefScriptInterface(void)
     AddFunc("queryitem",&DefScriptPackage::SCqueryitem);
     AddFunc("target",&DefScriptPackage::SCtarget);
     AddFunc("getscpvalue",&DefScriptPackage::SCGetScpValue);
+    AddFunc("lgetscpindexes",&DefScriptPackage::SCGetScpIndexes);
     AddFunc("getplayerguid",&DefScriptPackage::SCGetPlayerGuid);
+    AddFunc("getplayerguids",&DefScriptPackage::SCGetPlayerGuids);
     AddFunc("getname",&DefScriptPackage::SCGetName);
     AddFunc("getentry",&DefScriptPackage::SCGetEntry);
     AddFunc("getitemprotovalue",&DefScriptPackage::SCGetItemProtoValue);
@@ -63,6 +65,9 @@ void DefScriptPackage::_InitDefScriptInterface(void)
     AddFunc("loaddb",&DefScriptPackage::SCLoadDB);
     AddFunc("adddbpath",&DefScriptPackage::SCAddDBPath);
     AddFunc("preloadfile",&DefScriptPackage::SCPreloadFile);
+    AddFunc("watchfields",&DefScriptPackage::SCWatchFields);
+    AddFunc("unwatchfields",&DefScriptPackage::SCUnwatchFields);
+    AddFunc("objecteventfilter",&DefScriptPackage::SCObjectEventFilter);
 }
 
 DefReturnResult DefScriptPackage::SCshdn(CmdSet& Set)
@@ -377,7 +382,7 @@ DefReturnResult DefScriptPackage::SCqueryitem(CmdSet& Set)
     if(!id)
         return false;
 
-    ((PseuInstance*)parentMethod)->GetWSession()->SendQueryItem(id,0);
+    ((PseuInstance*)parentMethod)->GetWSession()->SendQueryItem(id,0,QUERY_PRIO_HIGH); // a script waits for it
     return true;
 }
 
@@ -473,26 +478,29 @@ DefReturnResult DefScriptPackage::SCGetScpValue(CmdSet& Set)
     if( (!entry.empty()) && (!dbname.empty()) )
     {
         SCPDatabase *db = dbmgr.GetDB(dbname);
-        if(db)
+        SCPFieldDef fd;
+        if(db && db->GetFieldDef(entry.c_str(), fd)) // look up the field once, then access it directly
         {
-            uint32 ftype = db->GetFieldType((char*)entry.c_str());
-            switch(ftype)
+            switch(fd.type)
             {
                 case SCP_TYPE_INT:
                 {
-                    return DefScriptTools::toString(db->GetInt(keyid,(char*)entry.c_str()));
+                    return DefScriptTools::toString(db->GetInt(keyid,fd.id));
                 }
                 case SCP_TYPE_FLOAT: 
                 {
-                    return DefScriptTools::toString(db->GetFloat(keyid,(char*)entry.c_str()));
+                    return DefScriptTools::toString(db->GetFloat(keyid,fd.id));
                 }
                 case SCP_TYPE_STRING:
                 {
-                    return std::string(db->GetString(keyid,(char*)entry.c_str()));
+                    return std::string(db->GetString(keyid,fd.id));
                 }
-                default: logerror("GetSCPValue: field '%s' does not exist in DB '%s'!",entry.c_str(),dbname.c_str());
             }
         }
+        else if(db)
+        {
+            logerror("GetSCPValue: field '%s' does not exist in DB '%s'!",entry.c_str(),dbname.c_str());
+        }
         else
         {
             logerror("GetSCPValue: No such DB: '%s'",dbname.c_str());
@@ -502,6 +510,44 @@ DefReturnResult DefScriptPackage::SCGetScpValue(CmdSet& Set)
     return "";
 }
 
+// lGetScpIndexes,list,db,field[,exact] value
+// fills the list with the indexes of all rows whose field equals value and returns their count.
+// strings are compared ignoring case, unless exact is true. uses the per-column search index of the DB.
+DefReturnResult DefScriptPackage::SCGetScpIndexes(CmdSet& Set)
+{
+    SCPDatabase *db = ((PseuInstance*)parentMethod)->dbmgr.GetDB(Set.arg[1]);
+    if(!db)
+    {
+        logerror("GetSCPIndexes: No such DB: '%s'",Set.arg[1].c_str());
+        return "";
+    }
+    SCPFieldDef fd;
+    if(!db->GetFieldDef(Set.arg[2].c_str(), fd))
+    {
+        logerror("GetSCPIndexes: field '%s' does not exist in DB '%s'!",Set.arg[2].c_str(),Set.arg[1].c_str());
+        return "";
+    }
+    SCPIndexList result;
+    switch(fd.type)
+    {
+        case SCP_TYPE_INT:
+            db->GetFieldsByUint32Value(fd.id, (uint32)DefScriptTools::toUint64(Set.defaultarg), result);
+            break;
+        case SCP_TYPE_STRING:
+            db->GetFieldsByStringValue(fd.id, Set.defaultarg.c_str(), result, !DefScriptTools::isTrue(Set.arg[3]));
+            break;
+        default:
+            logerror("GetSCPIndexes: field '%s' in DB '%s' can't be searched",Set.arg[2].c_str(),Set.arg[1].c_str());
+            return "";
+    }
+    DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    l->clear();
+    for(uint32 i = 0; i < result.size(); i++)
+        l->push_back(DefScriptTools::toString((uint64)result[i]));
+    _ListChanged(l);
+    return DefScriptTools::toString((uint64)l->size());
+}
+
 DefReturnResult DefScriptPackage::SCGetPlayerGuid(CmdSet& Set)
 {
     if(!(((PseuInstance*)parentMethod)->GetWSession()))
@@ -522,6 +568,39 @@ DefReturnResult DefScriptPackage::SCGetPlayerGuid(CmdSet& Set)
     return r;
 }
 
+// getplayerguids,<list> <list of names>
+// fills <list> with the guids of all names (same order, 0 if unknown). returns the amount of known names.
+DefReturnResult DefScriptPackage::SCGetPlayerGuids(CmdSet& Set)
+{
+    WorldSession *ws = ((PseuInstance*)parentMethod)->GetWSession();
+    if(!ws)
+    {
+        logerror("Invalid Script call: SCGetPlayerGuids: WorldSession not valid");
+        DEF_RETURN_ERROR;
+    }
+    DefList *names = lists.GetNoCreate(_NormalizeVarName(Set.defaultarg,Set.myname));
+    DefList *l = lists.Get(_NormalizeVarName(Set.arg[0],Set.myname));
+    l->clear();
+    if(!names)
+    {
+        _ListChanged(l);
+        return "0";
+    }
+
+    std::vector<std::string> namevec(names->begin(), names->end());
+    std::vector<uint64> guids;
+    ws->plrNameCache.GetGuids(namevec, guids);
+    uint32 found = 0;
+    for(uint32 i = 0; i < guids.size(); i++)
+    {
+        l->push_back(DefScriptTools::toString(guids[i]));
+        if(guids[i])
+            found++;
+    }
+    _ListChanged(l);
+    return DefScriptTools::toString((uint64)found);
+}
+
 DefReturnResult DefScriptPackage::SCGetName(CmdSet& Set)
 {
     WorldSession *ws = ((PseuInstance*)parentMethod)->GetWSession();
@@ -899,6 +978,7 @@ DefReturnResult DefScriptPackage::SCGetFileList(CmdSet& Set)
             i++;
         }
     }
+    _ListChanged(l);
     return toString((uint64)l->size());
 }
 
@@ -1314,6 +1394,72 @@ DefReturnResult DefScriptPackage::SCPreloadFile(CmdSet& Set)
     return true;
 }
 
+// watchfields,<script>[,<guid>[,<typeid>]] <field> [<field> ...]
+// calls <script> once per tick for every matching object that had one of the given fields changed.
+// guid 0 or empty matches any object, typeid 0 or empty matches any type.
+// the script gets: @def: guid, @0: typeid, @1..@n: the changed fields. returns the watch id.
+DefReturnResult DefScriptPackage::SCWatchFields(CmdSet& Set)
+{
+    WorldSession *ws = ((PseuInstance*)parentMethod)->GetWSession();
+    if(!ws)
+    {
+        logerror("Invalid Script call: SCWatchFields: WorldSession not valid");
+        DEF_RETURN_ERROR;
+    }
+    std::string script = DefScriptTools::stringToLower(Set.arg[0]);
+    if(script.empty())
+        return "";
+
+    std::vector<uint16> fields;
+    std::stringstream ss(Set.defaultarg);
+    std::string f;
+    while(ss >> f)
+        fields.push_back((uint16)DefScriptTools::toUint64(f));
+    if(fields.empty())
+        return "";
+
+    uint64 guid = DefScriptTools::toUint64(Set.arg[1]);
+    uint8 typeId = (uint8)DefScriptTools::toUint64(Set.arg[2]);
+    return toString(ws->objmgr.AddFieldWatch(fields, script, guid, typeId));
+}
+
+DefReturnResult DefScriptPackage::SCUnwatchFields(CmdSet& Set)
+{
+    WorldSession *ws = ((PseuInstance*)parentMethod)->GetWSession();
+    if(!ws)
+    {
+        logerror("Invalid Script call: SCUnwatchFields: WorldSession not valid");
+        DEF_RETURN_ERROR;
+    }
+    return ws->objmgr.RemoveFieldWatch((uint32)DefScriptTools::toUint64(Set.defaultarg));
+}
+
+// objecteventfilter[,<typeid>[,<typeid> ...]] [<entry> [<entry> ...]]
+// restricts the object creation/deletion scripts to the given types and entries.
+// no typeids = any type, no entries = any entry. without any args the filter is removed.
+DefReturnResult DefScriptPackage::SCObjectEventFilter(CmdSet& Set)
+{
+    WorldSession *ws = ((PseuInstance*)parentMethod)->GetWSession();
+    if(!ws)
+    {
+        logerror("Invalid Script call: SCObjectEventFilter: WorldSession not valid");
+        DEF_RETURN_ERROR;
+    }
+    uint32 typemask = 0;
+    for(_CmdSetArgMap::iterator it = Set.arg.begin(); it != Set.arg.end(); it++)
+        if(it->second.length())
+            typemask |= 1 << (DefScriptTools::toUint64(it->second) & 0x1F);
+
+    std::set<uint32> entries;
+    std::stringstream ss(Set.defaultarg);
+    std::string e;
+    while(ss >> e)
+        entries.insert((uint32)DefScriptTools::toUint64(e));
+
+    ws->objmgr.SetObjectEventFilter(typemask, entries);
+    return true;
+}
+
 void DefScriptPackage::My_LoadUserPermissions(VarSet &vs)
 {
     static const char *prefix = "USERS::";
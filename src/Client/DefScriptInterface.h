@@ -8,7 +8,6 @@
 
 
 
-DefScriptFunctionTable *_GetSCTable(void);
 
 
 
@@ -25,8 +25,10 @@ DefReturnResult SCcastspell(CmdSet&);
 DefReturnResult SCqueryitem(CmdSet&);
 DefReturnResult SCtarget(CmdSet&);
 DefReturnResult SCGetScpValue(CmdSet&);
+DefReturnResult SCGetScpIndexes(CmdSet&);
 DefReturnResult SCGetName(CmdSet&);
 DefReturnResult SCGetPlayerGuid(CmdSet&);
+DefReturnResult SCGetPlayerGuids(CmdSet&);
 DefReturnResult SCGetEntry(CmdSet&);
 DefReturnResult SCGetItemProtoValue(CmdSet&);
 DefReturnResult SCGetObjectType(CmdSet&);
@@ -53,6 +55,9 @@ DefReturnResult SCLoadDB(CmdSet&);
 DefReturnResult SCAddDBPath(CmdSet&);
 DefReturnResult SCGetPos(CmdSet&);
 DefReturnResult SCPreloadFile(CmdSet&);
+DefReturnResult SCWatchFields(CmdSet&);
+DefReturnResult SCUnwatchFields(CmdSet&);
+DefReturnResult SCObjectEventFilter(CmdSet&);
 
 
 void my_print(const char *fmt, ...);
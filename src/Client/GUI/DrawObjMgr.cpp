@@ -2,6 +2,7 @@
 #include "log.h"
 #include "DrawObject.h"
 #include "DrawObjMgr.h"
+#include "ObjMgr.h"
 
 DrawObjMgr::DrawObjMgr()
 {
@@ -31,6 +32,10 @@ void DrawObjMgr::Clear(void)
     {
         _del.next();
     }
+    while(_delbatch.size())
+    {
+        _delbatch.next();
+    }
 }
 
 void DrawObjMgr::Add(uint64 objguid, DrawObject *o)
@@ -43,6 +48,13 @@ void DrawObjMgr::Delete(uint64 guid)
     _del.add(guid);
 }
 
+// queue a whole bunch of objects for deletion, with only one lock
+void DrawObjMgr::Delete(std::vector<uint64>& guids)
+{
+    if(guids.size())
+        _delbatch.add(guids);
+}
+
 void DrawObjMgr::UnlinkAll(void)
 {
     DEBUG( logdebug("DrawObjMgr::UnlinkAll(), %u DrawObjects...", _storage.size() ) );
@@ -52,7 +64,7 @@ void DrawObjMgr::UnlinkAll(void)
     }
 }
 
-void DrawObjMgr::Update(void)
+void DrawObjMgr::Update(const ObjectSnapshot *snap)
 {
     //ZThread::FastMutex mut;
 
@@ -86,11 +98,24 @@ void DrawObjMgr::Update(void)
             DEBUG(logdebug("DrawObjMgr: ERROR: removable DrawObject "I64FMT" not exising",guid));
         }
     }
+    while(_delbatch.size())
+    {
+        std::vector<uint64> guids = _delbatch.next();
+        for(uint32 i = 0; i < guids.size(); i++)
+        {
+            DrawObjStorage::iterator it = _storage.find(guids[i]);
+            if(it != _storage.end())
+            {
+                delete it->second;
+                _storage.erase(it);
+            }
+        }
+    }
 
     // now draw everything
     for(DrawObjStorage::iterator i = _storage.begin(); i != _storage.end(); i++)
     {
-        i->second->Draw();
+        i->second->Draw(snap);
     }
 
     //mut.release();
@@ -4,6 +4,7 @@
 #include <utility>
 
 class DrawObject;
+class ObjectSnapshot;
 
 typedef std::map<uint64,DrawObject*> DrawObjStorage;
 
@@ -14,8 +15,9 @@ public:
     ~DrawObjMgr();
     void Add(uint64,DrawObject*);
     void Delete(uint64);
+    void Delete(std::vector<uint64>&);
     void Clear(void);
-    void Update(void); // Threadsafe! delete code must be called from here!
+    void Update(const ObjectSnapshot *snap); // Threadsafe! delete code must be called from here!
     uint32 StorageSize(void) { return _storage.size(); }
     void UnlinkAll(void);
     DrawObject *Get(uint64);
@@ -23,6 +25,7 @@ public:
 private:
     DrawObjStorage _storage;
     ZThread::LockedQueue<uint64,ZThread::FastMutex> _del;
+    ZThread::LockedQueue<std::vector<uint64>,ZThread::FastMutex> _delbatch;
     ZThread::LockedQueue<std::pair<uint64,DrawObject*>,ZThread::FastMutex > _add;
 
 };
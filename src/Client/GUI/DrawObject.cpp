@@ -3,9 +3,9 @@
 #include "DrawObject.h"
 #include "PseuWoW.h"
 #include "Object.h"
-#include "Player.h"
 #include "GameObject.h"
 #include "WorldSession.h"
+#include "ObjMgr.h"
 
 using namespace irr;
 
@@ -16,14 +16,14 @@ DrawObject::DrawObject(irr::IrrlichtDevice *device, Object *obj, PseuInstance *i
     _device = device;
     _smgr = device->getSceneManager();
     _guienv = device->getGUIEnvironment();
-    _obj = obj;
+    _guid = obj->GetGUID();
     _instance = ins;
-    DEBUG( logdebug("create DrawObject() this=%X obj=%X name='%s' smgr=%X",this,_obj,_obj->GetName().c_str(),_smgr) );
+    DEBUG( logdebug("create DrawObject() this=%X obj=%X name='%s' smgr=%X",this,obj,obj->GetName().c_str(),_smgr) );
 }
 
 DrawObject::~DrawObject()
 {
-    DEBUG( logdebug("~DrawObject() this=0x%X obj=0x%X smgr=%X",this,_obj,_smgr) );
+    DEBUG( logdebug("~DrawObject() this=0x%X guid="I64FMT" smgr=%X",this,_guid,_smgr) );
     if(cube)
     {
         text->remove();
@@ -37,22 +37,17 @@ void DrawObject::Unlink(void)
     text = NULL;
 }
 
-void DrawObject::_Init(void)
+void DrawObject::_Init(const ObjectSnapshot *snap, const ObjectSnapshotEntry *e)
 {
-    if(_obj->IsPlayer())
-    {
-        Player *p = (Player*)_obj;
-        DEBUG(logdebug("Player: race=%u gender=%u face=%u skin=%u traits=%u hair=%u haircol=%u",
-            p->GetRace(),p->GetGender(),p->GetFaceId(),p->GetSkinId(),p->GetFaceTraitsId(),p->GetHairStyleId(),p->GetHairColorId()));
-    }
-
-    if(!cube && _obj->IsWorldObject()) // only world objects have coords and can be drawn
+    bool isunit = e->typeId == TYPEID_UNIT || e->typeId == TYPEID_PLAYER;
+    bool isworldobj = isunit || e->typeId == TYPEID_GAMEOBJECT || e->typeId == TYPEID_CORPSE || e->typeId == TYPEID_DYNAMICOBJECT;
+    if(!cube && isworldobj) // only world objects have coords and can be drawn
     {
         std::string modelfile, texture = "";
         uint32 opacity = 255;
-        if (_obj->IsUnit())
+        if (isunit)
         {
-            uint32 displayid = _obj->GetUInt32Value(UNIT_FIELD_DISPLAYID);
+            uint32 displayid = snap->GetUInt32Value(e, UNIT_FIELD_DISPLAYID);
             SCPDatabase *cdi = _instance->dbmgr.GetDB("creaturedisplayinfo");
             SCPDatabase *cmd = _instance->dbmgr.GetDB("creaturemodeldata");
             uint32 modelid = cdi && displayid ? cdi->GetUint32(displayid,"model") : 0;
@@ -61,10 +56,10 @@ void DrawObject::_Init(void)
                 texture = std::string("data/texture/") + cdi->GetString(displayid,"name1");
             opacity = cdi && displayid ? cdi->GetUint32(displayid,"opacity") : 255;
         } 
-        else if (_obj->IsCorpse())
+        else if (e->typeId == TYPEID_CORPSE)
         {
-            uint8 race = (_obj->GetUInt32Value(CORPSE_FIELD_BYTES_1) >> 8)&0xFF;
-            uint8 gender = (_obj->GetUInt32Value(CORPSE_FIELD_BYTES_1) >> 16)&0xFF;
+            uint8 race = (snap->GetUInt32Value(e, CORPSE_FIELD_BYTES_1) >> 8)&0xFF;
+            uint8 gender = (snap->GetUInt32Value(e, CORPSE_FIELD_BYTES_1) >> 16)&0xFF;
             std::string racename = "", gendername = "";
 
             SCPDatabase *scprace = _instance->dbmgr.GetDB("race");
@@ -76,37 +71,28 @@ void DrawObject::_Init(void)
 
             modelfile = std::string("data/model/") + racename + gendername + "DeathSkeleton.m2";
         }
-        else if (_obj->IsGameObject())
+        else if (e->typeId == TYPEID_GAMEOBJECT)
         {
-            GameobjectTemplate* gotempl = _instance->GetWSession()->objmgr.GetGOTemplate(_obj->GetEntry());
-            while (!gotempl) 
+            if (!e->gotemplate) // not known yet, the query is on its way. try again next frame
+                return;
+            // GAMEOBJECT_TYPE_TRAP
+            if (e->gotype == 6) // damage source on fires, skip for now
             {
-                ZThread::Thread::sleep(10);
-                gotempl = _instance->GetWSession()->objmgr.GetGOTemplate(_obj->GetEntry());
+                _initialized = true;
+                return;
             }
-            if (gotempl)
+
+            uint32 displayid = e->godisplayid;
+            SCPDatabase *gdi = _instance->dbmgr.GetDB("gameobjectdisplayinfo");
+            if (gdi && displayid)
             {
-                // GAMEOBJECT_TYPE_TRAP
-                if (gotempl->type == 6) // damage source on fires, skip for now
-                {
-                    _initialized = true;
-                    return;
-                }
-
-                uint32 displayid = gotempl->displayId;
-                SCPDatabase *gdi = _instance->dbmgr.GetDB("gameobjectdisplayinfo");
-                if (gdi && displayid)
-                {
-                    modelfile = std::string("data/model/") + gdi->GetString(displayid,"model");
-                    std::string texturef = gdi->GetString(displayid,"path");
-                    if (strcmp(gdi->GetString(displayid,"texture"), "") != 0)
-                        texture = std::string("data/texture/") + gdi->GetString(displayid,"texture");
-                }
-                
-                DEBUG(logdebug("GAMEOBJECT: %u - %u", _obj->GetEntry(), displayid));
-            } else {
-                DEBUG(logdebug("GAMEOBJECT UNKNOWN: %u", _obj->GetEntry()));
+                modelfile = std::string("data/model/") + gdi->GetString(displayid,"model");
+                std::string texturef = gdi->GetString(displayid,"path");
+                if (strcmp(gdi->GetString(displayid,"texture"), "") != 0)
+                    texture = std::string("data/texture/") + gdi->GetString(displayid,"texture");
             }
+            
+            DEBUG(logdebug("GAMEOBJECT: %u - %u", e->entry, displayid));
         }
         scene::IAnimatedMesh *mesh = _smgr->getMesh(modelfile.c_str());
 
@@ -133,53 +119,54 @@ void DrawObject::_Init(void)
         }
 
         text=_smgr->addTextSceneNode(_guienv->getBuiltInFont(), L"TestText" , irr::video::SColor(255,255,255,255),cube, irr::core::vector3df(0,5,0));
-        if(_obj->IsPlayer())
+        if(e->typeId == TYPEID_PLAYER)
         {
             text->setTextColor(irr::video::SColor(255,255,0,0));
         }
-        else if(_obj->IsCreature())
+        else if(e->typeId == TYPEID_UNIT)
         {
             text->setTextColor(irr::video::SColor(255,0,0,255));
         }
 
     }
-    DEBUG(logdebug("initialize DrawObject 0x%X obj: 0x%X "I64FMT,this,_obj,_obj->GetGUID()))
+    DEBUG(logdebug("initialize DrawObject 0x%X guid "I64FMT,this,_guid))
 
     _initialized = true;
 }
 
-void DrawObject::Draw(void)
+void DrawObject::Draw(const ObjectSnapshot *snap)
 {
+    // not yet published (object was created during the current tick), try again next frame
+    const ObjectSnapshotEntry *e = snap->Get(_guid);
+    if(!e)
+        return;
+
     if(!_initialized)
-        _Init();
+        _Init(snap, e);
 
-    //printf("DRAW() for pObj 0x%X name '%s' guid "I64FMT"\n", _obj, _obj->GetName().c_str(), _obj->GetGUID());
-    if(cube)
-    {
-        WorldPosition pos = ((WorldObject*)_obj)->GetPosition();
-        cube->setPosition(WPToIrr(pos));
-        rotation.Y = O_TO_IRR(pos.o);
-
-        float s = _obj->GetFloatValue(OBJECT_FIELD_SCALE_X);
-        if(s <= 0)
-            s = 1;
-        cube->setScale(irr::core::vector3df(s,s,s));
-        cube->setRotation(rotation);
-
-        //cube->setRotation(irr::core::vector3df(0,RAD_TO_DEG(((WorldObject*)_obj)->GetO()),0));
-        irr::core::stringw tmp = L"";
-        if(_obj->GetName().empty() && !_obj->IsCorpse())
-        {
-            tmp += L"unk<";
-            tmp += _obj->GetTypeId();
-            tmp += L">";
-        }
-        else
-        {
-            tmp += _obj->GetName().c_str();
-        }
-        text->setText(tmp.c_str());
+    if(!cube)
+        return;
+
+    cube->setPosition(WPToIrr(e->pos));
+    rotation.Y = O_TO_IRR(e->pos.o);
+
+    float s = snap->GetFloatValue(e, OBJECT_FIELD_SCALE_X);
+    if(s <= 0)
+        s = 1;
+    cube->setScale(irr::core::vector3df(s,s,s));
+    cube->setRotation(rotation);
 
+    //cube->setRotation(irr::core::vector3df(0,RAD_TO_DEG(((WorldObject*)_obj)->GetO()),0));
+    irr::core::stringw tmp = L"";
+    if(e->name.empty() && e->typeId != TYPEID_CORPSE)
+    {
+        tmp += L"unk<";
+        tmp += e->typeId;
+        tmp += L">";
+    }
+    else
+    {
+        tmp += e->name.c_str();
     }
+    text->setText(tmp.c_str());
 }
-
@@ -6,20 +6,22 @@
 
 class Object;
 class PseuInstance;
+class ObjectSnapshot;
+struct ObjectSnapshotEntry;
 
 class DrawObject
 {
 public:
-    DrawObject(irr::IrrlichtDevice *device, Object*, PseuInstance *ins);
+    DrawObject(irr::IrrlichtDevice *device, Object*, PseuInstance *ins); // the object is only used to get its guid
     ~DrawObject();
-    void Draw(void); // call only in threadsafe environment!! (ensure the obj ptr is still valid!)
+    void Draw(const ObjectSnapshot *snap); // all object data come from the snapshot, the object itself is never touched
     void Unlink(void);
     inline irr::scene::ISceneNode *GetSceneNode(void) { return cube; }
     // additionally, we dont use a GetObject() func - that would fuck things up if the object was already deleted.
 
 private:
-    void _Init(void);
-    Object *_obj;
+    void _Init(const ObjectSnapshot *snap, const ObjectSnapshotEntry *e);
+    uint64 _guid;
     bool _initialized : 1;
     irr::IrrlichtDevice *_device;
     irr::scene::ISceneManager *_smgr;
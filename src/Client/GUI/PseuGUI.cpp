@@ -273,6 +273,12 @@ void PseuGUI::NotifyObjectDeletion(uint64 guid)
     domgr.Delete(guid);
 }
 
+// called from ObjMgr::Remove(guids)
+void PseuGUI::NotifyObjectsDeletion(std::vector<uint64>& guids)
+{
+    domgr.Delete(guids);
+}
+
 // called from ObjMgr::Add(Object*)
 void PseuGUI::NotifyObjectCreation(Object *o)
 {
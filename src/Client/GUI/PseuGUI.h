@@ -97,6 +97,7 @@ public:
 
     // interfaces to tell the gui what to draw
     void NotifyObjectDeletion(uint64 guid);
+    void NotifyObjectsDeletion(std::vector<uint64>& guids);
     void NotifyObjectCreation(Object *o);
     void NotifyAllObjectsDeletion(void);
 
@@ -3,6 +3,7 @@
 
 #include "irrlicht/irrlicht.h"
 #include "SceneData.h"
+#include "Unit.h"
 
 using namespace irr;
 using namespace core;
@@ -130,7 +131,7 @@ class MyEventReceiver;
 class MapMgr;
 class WorldSession;
 class MovementMgr;
-class MyCharacter;
+class ObjectSnapshot;
 
 class SceneWorld : public Scene
 {
@@ -173,9 +174,20 @@ private:
     scene::ISceneNode *selectedNode, *oldSelectedNode, *focusedNode, *oldFocusedNode;
     video::SColor envBasicColor;
     MovementMgr *movemgr;
-    MyCharacter *mychar;
+    // MyCharacter as the GUI sees it. it is read from the object snapshot and changed here while moving manually,
+    // changes are sent to the world thread with MovementMgr::Request()
+    uint64 myguid;
+    WorldPosition mypos;
+    float myspeed[MAX_MOVE_TYPE];
+    bool mypos_valid; // false until MyCharacter showed up in a snapshot
+    bool mypos_changed; // not yet sent
+    uint32 mypos_req; // id of the last request that sent mypos
+    uint8 mymovemode; // what was requested last, the GUI is the only one that changes it
     bool _freeCameraMove;
     void _CalcXYMoveVect(float o);
+    void _SyncMyChar(const ObjectSnapshot *snap);
+    void _MoveRequest(uint8 cmd);
+    void _SetMoveMode(uint8 mode);
     core::vector2df xyCharMovement; // stores sin() and cos() values for current MyCharacter orientation, so that they need to be calculated only if the character turns around
     bool mouse_pressed_left;
     bool mouse_pressed_right;
@@ -31,10 +31,17 @@ SceneWorld::SceneWorld(PseuGUI *g) : Scene(g)
     world = wsession->GetWorld();
     mapmgr = world->GetMapMgr();
     movemgr = world->GetMoveMgr();
-    mychar = wsession->GetMyChar();
-    ASSERT(mychar);
-    _CalcXYMoveVect(mychar->GetO());
-    old_char_o = mychar->GetO();
+    myguid = wsession->GetGuid();
+    ASSERT(myguid);
+    mypos_valid = false; // the camera is placed behind the character as soon as it is known
+    mypos_changed = false;
+    mypos_req = 0;
+    mymovemode = MOVEMODE_MANUAL; // the default of MovementMgr
+    memset(myspeed, 0, sizeof(myspeed));
+    wsession->objmgr.AddSnapshotField(OBJECT_FIELD_SCALE_X);
+    wsession->objmgr.AddSnapshotField(UNIT_FIELD_DISPLAYID);
+    wsession->objmgr.AddSnapshotField(CORPSE_FIELD_BYTES_1);
+    wsession->objmgr.SetSnapshotEnabled(true);
 
     if(soundengine)
     {
@@ -102,7 +109,6 @@ SceneWorld::SceneWorld(PseuGUI *g) : Scene(g)
 
     InitTerrain();
     UpdateTerrain();
-    RelocateCameraBehindChar();
 
     DEBUG(logdebug("SceneWorld: Init done!"));
 }
@@ -113,6 +119,16 @@ void SceneWorld::OnUpdate(s32 timediff)
 
     UpdateTerrain();
 
+    // all object data come from the snapshot published by the main thread, so we dont touch any objects
+    // it might be modifying right now. MyCharacter is moved here and the changes are sent back to the main thread.
+    const ObjectSnapshot *snap = wsession->objmgr.AcquireSnapshot();
+    _SyncMyChar(snap);
+    if(!mypos_valid) // not in the snapshot yet, wait for the next one
+    {
+        wsession->objmgr.ReleaseSnapshot(snap);
+        return;
+    }
+
     mouse_pressed_left = eventrecv->mouse.left_pressed();
     mouse_pressed_right = eventrecv->mouse.right_pressed();
     float timediff_f = timediff / 1000.0f;
@@ -145,15 +161,14 @@ void SceneWorld::OnUpdate(s32 timediff)
             camera->moveForward(50 * timediff_f);
         else
         {
-            f32 speedfactor = timediff_f * mychar->GetSpeed(MOVE_RUN);
-            movemgr->SetMoveMode(MOVEMODE_MANUAL);
-            movemgr->MoveStartForward();
-            WorldPosition wp = mychar->GetPosition();
-            _CalcXYMoveVect(wp.o);
-            wp.x += (xyCharMovement.X * speedfactor);
-            wp.y += (xyCharMovement.Y * speedfactor);
-            wp.z = terrain->getHeight(WPToIrr(wp));
-            mychar->SetPosition(wp);
+            f32 speedfactor = timediff_f * myspeed[MOVE_RUN];
+            _SetMoveMode(MOVEMODE_MANUAL);
+            _MoveRequest(MOVEREQ_START_FORWARD);
+            _CalcXYMoveVect(mypos.o);
+            mypos.x += (xyCharMovement.X * speedfactor);
+            mypos.y += (xyCharMovement.Y * speedfactor);
+            mypos.z = terrain->getHeight(WPToIrr(mypos));
+            mypos_changed = true;
         }
     }
 
@@ -163,15 +178,14 @@ void SceneWorld::OnUpdate(s32 timediff)
             camera->moveBack(50 * timediff_f);
         else
         {
-            f32 speedfactor = timediff_f * mychar->GetSpeed(MOVE_WALKBACK);
-            movemgr->SetMoveMode(MOVEMODE_MANUAL);
-            movemgr->MoveStartBackward();
-            WorldPosition wp = mychar->GetPosition();
-            _CalcXYMoveVect(wp.o);
-            wp.x -= (xyCharMovement.X * speedfactor);
-            wp.y -= (xyCharMovement.Y * speedfactor);
-            wp.z = terrain->getHeight(WPToIrr(wp));
-            mychar->SetPosition(wp);
+            f32 speedfactor = timediff_f * myspeed[MOVE_WALKBACK];
+            _SetMoveMode(MOVEMODE_MANUAL);
+            _MoveRequest(MOVEREQ_START_BACKWARD);
+            _CalcXYMoveVect(mypos.o);
+            mypos.x -= (xyCharMovement.X * speedfactor);
+            mypos.y -= (xyCharMovement.Y * speedfactor);
+            mypos.z = terrain->getHeight(WPToIrr(mypos));
+            mypos_changed = true;
         }
     }
 
@@ -193,14 +207,13 @@ void SceneWorld::OnUpdate(s32 timediff)
                 camera->turnRight(timediff_f * M_PI * 25);
             else
             {
-                movemgr->SetMoveMode(MOVEMODE_MANUAL);
-                movemgr->MoveStartTurnRight();
-                WorldPosition wp = mychar->GetPosition();
-                wp.z = terrain->getHeight(WPToIrr(wp));
-                wp.o -= (timediff_f * mychar->GetSpeed(MOVE_TURN));
-                wp.o = RAD_FIX(wp.o);
-                mychar->SetPosition(wp);
-                _CalcXYMoveVect(wp.o);
+                _SetMoveMode(MOVEMODE_MANUAL);
+                _MoveRequest(MOVEREQ_START_TURN_RIGHT);
+                mypos.z = terrain->getHeight(WPToIrr(mypos));
+                mypos.o -= (timediff_f * myspeed[MOVE_TURN]);
+                mypos.o = RAD_FIX(mypos.o);
+                mypos_changed = true;
+                _CalcXYMoveVect(mypos.o);
             }
         }
     }
@@ -222,14 +235,13 @@ void SceneWorld::OnUpdate(s32 timediff)
                 camera->turnLeft(timediff_f * M_PI * 25);
             else
             {
-                movemgr->SetMoveMode(MOVEMODE_MANUAL);
-                movemgr->MoveStartTurnLeft();
-                WorldPosition wp = mychar->GetPosition();
-                wp.z = terrain->getHeight(WPToIrr(wp));
-                wp.o += (timediff_f * mychar->GetSpeed(MOVE_TURN));
-                wp.o = RAD_FIX(wp.o);
-                mychar->SetPosition(wp);
-                _CalcXYMoveVect(wp.o);
+                _SetMoveMode(MOVEMODE_MANUAL);
+                _MoveRequest(MOVEREQ_START_TURN_LEFT);
+                mypos.z = terrain->getHeight(WPToIrr(mypos));
+                mypos.o += (timediff_f * myspeed[MOVE_TURN]);
+                mypos.o = RAD_FIX(mypos.o);
+                mypos_changed = true;
+                _CalcXYMoveVect(mypos.o);
             }
         }
     }
@@ -241,7 +253,7 @@ void SceneWorld::OnUpdate(s32 timediff)
         else
         {/*
             f32 speedfactor = timediff_f * mychar->GetSpeed(MOVE_RUN);
-            movemgr->SetMoveMode(MOVEMODE_MANUAL);
+            _SetMoveMode(MOVEMODE_MANUAL);
             movemgr->MoveStartStrafeRight();
             WorldPosition wp = mychar->GetPosition();
             _CalcXYMoveVect(wp.o);
@@ -259,7 +271,7 @@ void SceneWorld::OnUpdate(s32 timediff)
         else
         {/*
             f32 speedfactor = timediff_f * mychar->GetSpeed(MOVE_RUN);
-            movemgr->SetMoveMode(MOVEMODE_MANUAL);
+            _SetMoveMode(MOVEMODE_MANUAL);
             movemgr->MoveStartStrafeLeft();
             WorldPosition wp = mychar->GetPosition();
             _CalcXYMoveVect(wp.o);
@@ -272,20 +284,20 @@ void SceneWorld::OnUpdate(s32 timediff)
 
     /*if(eventrecv->key.pressed(KEY_SPACE))
     {
-        movemgr->SetMoveMode(MOVEMODE_MANUAL);
+        _SetMoveMode(MOVEMODE_MANUAL);
         movemgr->MoveJump();
     }*/
 
     // listen to *not* pressed keys only if manually moving
-    if(movemgr->GetMoveMode() == MOVEMODE_MANUAL)
+    if(mymovemode == MOVEMODE_MANUAL)
     {
         if (!eventrecv->key.pressed(KEY_KEY_D) && !eventrecv->key.pressed(KEY_KEY_A))
         {
-            movemgr->MoveStopTurn();
+            _MoveRequest(MOVEREQ_STOP_TURN);
         }
         if (!eventrecv->key.pressed(KEY_KEY_W) && !eventrecv->key.pressed(KEY_KEY_S) && !(mouse_pressed_left && mouse_pressed_right))
         {
-            movemgr->MoveStop();
+            _MoveRequest(MOVEREQ_STOP);
         }
         // TODO: add strafe case
     }
@@ -384,12 +396,13 @@ void SceneWorld::OnUpdate(s32 timediff)
             // rotate character if right mouse button pressed.
             if(mouse_pressed_right && !_freeCameraMove)
             {
-                mychar->GetPositionPtr()->o = PI*3/2 - DEG_TO_RAD(camera->getHeading());
+                mypos.o = PI*3/2 - DEG_TO_RAD(camera->getHeading());
+                mypos_changed = true;
                 // send update to server only if we turned by some amount and not always when we turn
-                if(!equals(old_char_o, mychar->GetO(), MOVE_TURN_UPDATE_DIFF))
+                if(!equals(old_char_o, mypos.o, MOVE_TURN_UPDATE_DIFF))
                 {
-                    old_char_o = mychar->GetO();
-                    movemgr->MoveSetFacing();
+                    old_char_o = mypos.o;
+                    _MoveRequest(MOVEREQ_SET_FACING);
                 }
             }
         }
@@ -399,6 +412,8 @@ void SceneWorld::OnUpdate(s32 timediff)
         mouse_pos = device->getCursorControl()->getPosition();
     }
 
+    _MoveRequest(MOVEREQ_NONE); // whatever changed this frame and was not sent along with a command
+
     // TODO: check if the cam really has to be relocated; might save some CPU but not sure...
     if(_freeCameraMove)
     {
@@ -465,7 +480,9 @@ void SceneWorld::OnUpdate(s32 timediff)
 
 
 
-    gui->domgr.Update(); // iterate over DrawObjects, draw them and clean up
+    // iterate over DrawObjects, draw them and clean up
+    gui->domgr.Update(snap);
+    wsession->objmgr.ReleaseSnapshot(snap);
 
 }
 
@@ -495,6 +512,7 @@ void SceneWorld::OnDelete(void)
     _doodads.clear();
     _sound_emitters.clear();
     gui->domgr.Clear();
+    wsession->objmgr.SetSnapshotEnabled(false);
     delete camera;
     delete eventrecv;
     //sky->drop();
@@ -823,12 +841,11 @@ void SceneWorld::UpdateMapSceneNodes(std::map<uint32,SceneNodeWithGridPos>& node
 void SceneWorld::RelocateCamera(void)
 {
 
-    MyCharacter *my = wsession->GetMyChar();
-    if(my)
+    if(mypos_valid)
     {
         //logdebug("SceneWorld: Relocating camera to MyCharacter");
-        camera->setPosition(vector3df(-my->GetX(),my->GetZ(),-my->GetY()));
-        camera->turnLeft(camera->getHeading() - RAD_TO_DEG(PI*3/2 - my->GetO()));
+        camera->setPosition(vector3df(-mypos.x,mypos.z,-mypos.y));
+        camera->turnLeft(camera->getHeading() - RAD_TO_DEG(PI*3/2 - mypos.o));
     }
     else
     {
@@ -839,7 +856,7 @@ void SceneWorld::RelocateCamera(void)
 // TODO: call this func only when really needed, and not in every loop?
 void SceneWorld::RelocateCameraBehindChar(void)
 {
-    if(mychar)
+    if(mypos_valid)
     {
         float distance = (MAX_CAM_DISTANCE / 5.0f) - (eventrecv->mouse.wheel / 5.0f);
         //DEBUG(logdebug("SceneWorld: Relocating camera behind MyCharacter, dist %.2f",distance));
@@ -870,13 +887,13 @@ void SceneWorld::RelocateCameraBehindChar(void)
 
         if(mouse_pressed_left)
         {
-            camera->setPosition(vector3df(-mychar->GetX(), mychar->GetZ() + distance + 1.5f, -mychar->GetY()));
+            camera->setPosition(vector3df(-mypos.x, mypos.z + distance + 1.5f, -mypos.y));
             camera->moveBack(distance);
         }
         else
         {
-            camera->setPosition(vector3df(-mychar->GetX(), mychar->GetZ() + distance + 1.5f, -mychar->GetY()));
-            camera->turnLeft(camera->getHeading() - RAD_TO_DEG(PI*3/2 - mychar->GetO()));
+            camera->setPosition(vector3df(-mypos.x, mypos.z + distance + 1.5f, -mypos.y));
+            camera->turnLeft(camera->getHeading() - RAD_TO_DEG(PI*3/2 - mypos.o));
             camera->moveBack(distance);
         }
     }
@@ -906,8 +923,50 @@ void SceneWorld::_CalcXYMoveVect(float o)
 
 scene::ISceneNode *SceneWorld::GetMyCharacterSceneNode(void)
 {
-    DrawObject *d = gui->domgr.Get(mychar->GetGUID());
+    DrawObject *d = gui->domgr.Get(myguid);
     return d ? d->GetSceneNode() : NULL;
 }
 
+// takes over speeds and position of MyCharacter from the snapshot. the position only if the main thread
+// already got all positions sent from here, otherwise the character would jump back for a moment.
+// this way changes made by the main thread (teleports, ...) show up as soon as the character stands still.
+void SceneWorld::_SyncMyChar(const ObjectSnapshot *snap)
+{
+    const ObjectSnapshotEntry *e = snap->myguid == myguid ? snap->Get(myguid) : NULL;
+    if(!e)
+        return;
+    memcpy(myspeed, snap->myspeed, sizeof(myspeed));
+    if(int32(snap->mymovereq - mypos_req) < 0)
+        return;
+    mypos = e->pos;
+    if(!mypos_valid)
+    {
+        mypos_valid = true;
+        _CalcXYMoveVect(mypos.o);
+        old_char_o = mypos.o;
+        RelocateCameraBehindChar();
+    }
+}
+
+// queues a command for the main thread, with mypos if it changed since it was sent last
+void SceneWorld::_MoveRequest(uint8 cmd)
+{
+    if(mypos_changed)
+    {
+        mypos_req = movemgr->Request(cmd, &mypos);
+        mypos_changed = false;
+    }
+    else if(cmd != MOVEREQ_NONE)
+        movemgr->Request(cmd);
+}
+
+// the move mode is read by the main thread, so it is changed there too. only changes are sent.
+void SceneWorld::_SetMoveMode(uint8 mode)
+{
+    if(mode == mymovemode)
+        return;
+    mymovemode = mode;
+    _MoveRequest(mode == MOVEMODE_MANUAL ? MOVEREQ_MODE_MANUAL : MOVEREQ_MODE_AUTO);
+}
+
 
@@ -240,6 +240,20 @@ namespace MemoryDataHolder
     }
 
 
+    // used for CPU-bound work like parsing, which should also use all loader threads.
+    // runs directly if threading is disabled.
+    void Execute(ZThread::Runnable *r)
+    {
+        if(alwaysSingleThreaded || !executor)
+        {
+            r->run();
+            delete r;
+            return;
+        }
+        ZThread::Task task(r);
+        executor->execute(task);
+    }
+
     bool Delete(std::string s)
     {
         ZThread::Guard<ZThread::FastMutex> g(mutex);
@@ -6,6 +6,7 @@
 namespace ZThread
 {
     class Condition;
+    class Runnable;
 };
 
 namespace MemoryDataHolder
@@ -53,6 +54,7 @@ namespace MemoryDataHolder
     bool IsLoaded(std::string);
     void BackgroundLoadFile(std::string);
     bool Delete(std::string);
+    void Execute(ZThread::Runnable *r); // run other work on the loader threads; takes ownership of r
 };
 
 #endif
@@ -131,7 +131,7 @@ bool PseuInstance::Init(void)
 
     dbmgr.AddSearchPath("./cache");
     dbmgr.AddSearchPath("./data/scp");
-    dbmgr.SetCompression(6);
+    dbmgr.SetCompression(0); // uncompressed databases are memory mapped instead of read at startup
 
     _scp->variables.Set("@version_short",_ver_short);
     _scp->variables.Set("@version",_ver);
@@ -162,6 +162,14 @@ bool PseuInstance::Init(void)
         _rmcontrol = new RemoteController(this,GetConf()->rmcontrolport);
     }
 
+    if(GetConf()->hotReloadScripts)
+    {
+        if(_scp->WatchPath(_scpdir))
+            log("Watching '%s' for changed scripts.",_scpdir.c_str());
+        else
+            logerror("Can't watch '%s' for changed scripts, hot reload is not available.",_scpdir.c_str());
+    }
+
 #if !(PLATFORM == PLATFORM_WIN32 && !defined(_CONSOLE))
     if(GetConf()->enablecli)
     {
@@ -389,6 +397,7 @@ void PseuInstance::Update()
         }
     }
 
+    GetScripts()->UpdateWatch();
     GetScripts()->GetEventMgr()->Update();
 
     this->Sleep(GetConf()->networksleeptime);
@@ -421,10 +430,7 @@ void PseuInstance::SaveAllCache(void)
     //...
     if(GetWSession())
     {
-        GetWSession()->plrNameCache.SaveToFile();
-        ItemProtoCache_WriteDataToCache(GetWSession());
-        CreatureTemplateCache_WriteDataToCache(GetWSession());
-        GOTemplateCache_WriteDataToCache(GetWSession());
+        GetWSession()->SaveCache(); // new entries are on disk already, this only merges the journals
         //...
     }
 }
@@ -482,6 +488,7 @@ PseuInstanceConf::PseuInstanceConf()
     exitonerror=false;
     debug=0;
     rmcontrolport=0;
+    hotReloadScripts=false;
 }
 
 void PseuInstanceConf::ApplyFromVarSet(VarSet &v)
@@ -516,6 +523,14 @@ void PseuInstanceConf::ApplyFromVarSet(VarSet &v)
     dumpPackets=(uint8)atoi(v.Get("DUMPPACKETS").c_str());
     softquit=(bool)atoi(v.Get("SOFTQUIT").c_str());
     dataLoaderThreads=atoi(v.Get("DATALOADERTHREADS").c_str());
+    cacheCompactAt=atoi(v.Get("CACHECOMPACTAT").c_str());
+    sharedCache=(bool)atoi(v.Get("SHAREDCACHE").c_str());
+    queryRate=atoi(v.Get("QUERYRATE").c_str());
+    queryBurst=atoi(v.Get("QUERYBURST").c_str());
+    queryTimeout=atoi(v.Get("QUERYTIMEOUT").c_str());
+    queryRetries=atoi(v.Get("QUERYRETRIES").c_str());
+    nonexistentExpiry=atoi(v.Get("NONEXISTENTEXPIRY").c_str());
+    hotReloadScripts=(bool)atoi(v.Get("HOTRELOADSCRIPTS").c_str());
 
     // clientversion is a bit more complicated to add
     {
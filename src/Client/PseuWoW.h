@@ -71,6 +71,14 @@ class PseuInstanceConf
     uint8 dumpPackets;
     bool softquit;
     uint8 dataLoaderThreads;
+    uint32 cacheCompactAt;
+    bool sharedCache;
+    uint32 queryRate;
+    uint32 queryBurst;
+    uint32 queryTimeout;
+    uint32 queryRetries;
+    uint32 nonexistentExpiry;
+    bool hotReloadScripts;
 
     // gui related
     bool enablegui;
@@ -1,6 +1,9 @@
 #include <fstream>
 #include "common.h"
 #include "Auth/MD5Hash.h"
+#include "zthread/CountingSemaphore.h"
+#include "zthread/Runnable.h"
+#include "MemoryDataHolder.h"
 #include "SCPDatabase.h"
 
 #define HEADER_SIZE (21*sizeof(uint32))
@@ -22,6 +25,119 @@ struct memblock
 TypeStorage<memblock> Pointers; // stores filename -> file content
 std::map<std::string,std::string> FileRelation; // stores filename -> DB name
 
+// splits a text buffer into lines without copying. '\r' and '\n' both end a line, leading spaces and tabs are skipped.
+class SCPLineReader
+{
+public:
+    SCPLineReader(const char *buf, uint32 size) : _p(buf), _end(buf + size) {}
+    bool Next(const char *&line, uint32 &len)
+    {
+        while(_p < _end)
+        {
+            const char *nl = (const char*)memchr(_p, '\n', _end - _p);
+            if(!nl)
+                nl = _end;
+            const char *cr = (const char*)memchr(_p, '\r', nl - _p);
+            const char *eol = cr ? cr : nl;
+            const char *p = _p;
+            _p = eol + 1;
+            while(p < eol && (*p == ' ' || *p == '\t'))
+                p++;
+            if(p < eol)
+            {
+                line = p;
+                len = eol - p;
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    const char *_p, *_end;
+};
+
+// one .scp file, read and parsed without touching any shared data, so that files can be processed in parallel
+struct SCPParseResult
+{
+    SCPParseResult() : buf(NULL), size(0), loaded(false), sections(0) {}
+    std::string fn;
+    char *buf;
+    uint32 size;
+    bool loaded; // buf was read from disk by the parser and is not yet stored in Pointers
+    std::string lastdb; // the last #dbname in the file
+    std::map<std::string,SCPFieldMap> dbs; // usually one DB per file
+    uint32 sections;
+};
+
+static void ParseSCP(SCPParseResult& res)
+{
+    SCPLineReader rd(res.buf, res.size);
+    SCPFieldMap *fields = NULL;
+    SCPEntryMap *section = NULL; // looked up when the first entry of a section is found, empty sections are not stored
+    uint32 id = 0;
+    const char *line;
+    uint32 len;
+    while(rd.Next(line,len))
+    {
+        if(len < 2 || (line[0] == '/' && line[1] == '/'))
+            continue;
+        const char *eq = (const char*)memchr(line, '=', len);
+        if(eq)
+        {
+            std::string entry(line, eq - line);
+            for(uint32 i = 0; i < entry.size(); i++)
+                entry[i] = tolower(entry[i]);
+            if(entry == "#dbname" && eq + 1 < line + len)
+            {
+                res.lastdb.assign(eq + 1, line + len - eq - 1);
+                fields = &res.dbs[res.lastdb];
+                section = NULL;
+            }
+            else if(fields)
+            {
+                if(!section)
+                    section = &(*fields)[id];
+                (*section)[entry].assign(eq + 1, line + len - eq - 1);
+            }
+        }
+        else if(line[0] == '[')
+        {
+            id = (uint32)toInt(std::string(line + 1, len - 1)); // start reading after '['
+            section = NULL;
+            res.sections++;
+        }
+    }
+}
+
+// reads (if not yet in memory) and parses one file on a data loader thread
+class SCPParseRunnable : public ZThread::Runnable
+{
+public:
+    SCPParseRunnable(SCPParseResult *res, ZThread::CountingSemaphore *done) : _res(res), _done(done) {}
+    void run()
+    {
+        if(!_res->buf)
+        {
+            _res->size = GetFileSize(_res->fn.c_str());
+            FILE *fh = _res->size ? fopen(_res->fn.c_str(), "rb") : NULL;
+            if(fh)
+            {
+                _res->buf = new char[_res->size];
+                _res->size = fread(_res->buf, 1, _res->size, fh);
+                _res->loaded = true;
+                fclose(fh);
+            }
+        }
+        if(_res->buf)
+            ParseSCP(*_res);
+        if(_done)
+            _done->post();
+    }
+private:
+    SCPParseResult *_res;
+    ZThread::CountingSemaphore *_done;
+};
+
 SCPDatabase::~SCPDatabase()
 {
     DEBUG(logdebug("Deleting SCPDatabase '%s'",_name.c_str()));
@@ -32,18 +148,36 @@ SCPDatabase::SCPDatabase()
 {
     _stringbuf = NULL;
     _intbuf = NULL;
+    _stringsize = 0;
+    _rowcount = 0;
+    _fields_per_row = 0;
     _compact = false;
+    _mapped = NULL;
+    _dense = false;
+    _minindex = 0;
+    _sortedindex = NULL;
 }
 
 void SCPDatabase::DropAll(void)
 {
     DropTextData();
-    if(_stringbuf)
-        delete [] _stringbuf;
-    if(_intbuf)
-        delete [] _intbuf;
-    _indexes.clear();
-    _indexes_reverse.clear();
+    if(_mapped)
+    {
+        delete _mapped; // the buffers are part of the mapping
+        _mapped = NULL;
+    }
+    else
+    {
+        if(_stringbuf)
+            delete [] _stringbuf;
+        if(_intbuf)
+            delete [] _intbuf;
+    }
+    _rowbyindex.clear();
+    _rowmap.clear();
+    _sortedindex = NULL;
+    _dense = false;
+    _DropColumnIndexes();
     _fielddefs.clear();
     _stringbuf = NULL;
     _intbuf = NULL;
@@ -62,85 +196,159 @@ void SCPDatabase::DropTextData(void)
 
 void *SCPDatabase::GetPtr(uint32 index, const char *entry)
 {
-    std::map<uint32,uint32>::iterator it = _indexes.find(index);
-    if(it == _indexes.end())
+    uint32 row = GetRow(index);
+    if(row == SCP_INVALID_INT)
         return NULL;
-    std::map<std::string,SCPFieldDef>::iterator fi = _fielddefs.find(entry);
+    SCPFieldDefMap::iterator fi = _fielddefs.find(entry);
     if(fi == _fielddefs.end())
         return NULL;
-
-    uint32 target_row = _indexes[index];
-    uint32 field_id = _fielddefs[entry].id;
-    return (void*)&_intbuf[(_fields_per_row * target_row) + field_id];
+    return (void*)&_intbuf[(_fields_per_row * row) + fi->second.id];
 }
 
 void *SCPDatabase::GetPtrByField(uint32 index, uint32 entry)
 {
-    std::map<uint32,uint32>::iterator it = _indexes.find(index);
-    if(it == _indexes.end())
+    uint32 row = GetRow(index);
+    if(row == SCP_INVALID_INT || entry >= _fields_per_row)
         return NULL;
-
-    uint32 target_row = _indexes[index];
-    return (void*)&_intbuf[(_fields_per_row * target_row) + entry];
+    return (void*)&_intbuf[(_fields_per_row * row) + entry];
 }
 
 uint32 SCPDatabase::GetFieldByUint32Value(const char *entry, uint32 val)
 {
-    std::map<std::string,SCPFieldDef>::iterator fi = _fielddefs.find(entry);
+    SCPFieldDefMap::iterator fi = _fielddefs.find(entry);
     if(fi == _fielddefs.end())
         return SCP_INVALID_INT;
-
-    uint32 field_id = _fielddefs[entry].id;
-    return GetFieldByUint32Value(field_id,val);
+    return GetFieldByUint32Value(fi->second.id,val);
 }
 
 uint32 SCPDatabase::GetFieldByUint32Value(uint32 entry, uint32 val)
 {
-    for(uint32 row = 0; row < _rowcount; row++)
-        if(_intbuf[row * _fields_per_row + entry] == val)
-            return _indexes_reverse[row];
-    return SCP_INVALID_INT;
+    uint32 row = _FindFirstRow(entry,val);
+    return row != SCP_INVALID_INT ? GetIndexByRow(row) : SCP_INVALID_INT;
 }
 
 uint32 SCPDatabase::GetFieldByIntValue(const char *entry, int32 val)
 {
-    std::map<std::string,SCPFieldDef>::iterator fi = _fielddefs.find(entry);
+    SCPFieldDefMap::iterator fi = _fielddefs.find(entry);
     if(fi == _fielddefs.end())
         return SCP_INVALID_INT;
-
-    uint32 field_id = _fielddefs[entry].id;
-    return GetFieldByIntValue(field_id,val);
+    return GetFieldByIntValue(fi->second.id,val);
 }
 
 uint32 SCPDatabase::GetFieldByIntValue(uint32 entry, int32 val)
 {
-    for(uint32 row = 0; row < _rowcount; row++)
-        if((int)_intbuf[row * _fields_per_row + entry] == val)
-            return _indexes_reverse[row];
-    return (int)SCP_INVALID_INT;
+    return GetFieldByUint32Value(entry,(uint32)val);
 }
 
-uint32 SCPDatabase::GetFieldByStringValue(const char *entry, const char *val)
+uint32 SCPDatabase::GetFieldByStringValue(const char *entry, const char *val, bool nocase)
 {
-    std::map<std::string,SCPFieldDef>::iterator fi = _fielddefs.find(entry);
+    SCPFieldDefMap::iterator fi = _fielddefs.find(entry);
     if(fi == _fielddefs.end())
         return SCP_INVALID_INT;
-    
-    uint32 field_id = _fielddefs[entry].id;
-    return GetFieldByStringValue(field_id,val);
+    return GetFieldByStringValue(fi->second.id,val,nocase);
 }
 
-uint32 SCPDatabase::GetFieldByStringValue(uint32 entry, const char *val)
+uint32 SCPDatabase::GetFieldByStringValue(uint32 entry, const char *val, bool nocase)
 {
-    for(uint32 row = 0; row < _rowcount; row++)
-        if(!stricmp(GetStringByOffset(_intbuf[row * _fields_per_row + entry]), val))
-            return _indexes_reverse[row];
-    return SCP_INVALID_INT;
+    uint32 row = _FindFirstRow(entry,val,nocase);
+    return row != SCP_INVALID_INT ? GetIndexByRow(row) : SCP_INVALID_INT;
+}
+
+uint32 SCPDatabase::GetFieldsByUint32Value(uint32 entry, uint32 val, SCPIndexList& result)
+{
+    return _CollectRows(entry,SCP_COLINDEX_INT,_FindFirstRow(entry,val),result);
+}
+
+uint32 SCPDatabase::GetFieldsByIntValue(uint32 entry, int32 val, SCPIndexList& result)
+{
+    return GetFieldsByUint32Value(entry,(uint32)val,result);
+}
+
+uint32 SCPDatabase::GetFieldsByStringValue(uint32 entry, const char *val, SCPIndexList& result, bool nocase)
+{
+    return _CollectRows(entry,nocase ? SCP_COLINDEX_STRING_NOCASE : SCP_COLINDEX_STRING,_FindFirstRow(entry,val,nocase),result);
+}
+
+uint32 SCPDatabase::_FindFirstRow(uint32 entry, uint32 val)
+{
+    SCPColumnIndex *ci = _GetColumnIndex(entry,SCP_COLINDEX_INT);
+    if(!ci)
+        return SCP_INVALID_INT;
+    UNORDERED_MAP<uint32,uint32>::iterator it = ci->byvalue.find(val);
+    return it != ci->byvalue.end() ? it->second : SCP_INVALID_INT;
+}
+
+uint32 SCPDatabase::_FindFirstRow(uint32 entry, const char *val, bool nocase)
+{
+    SCPColumnIndex *ci = _GetColumnIndex(entry,nocase ? SCP_COLINDEX_STRING_NOCASE : SCP_COLINDEX_STRING);
+    if(!ci)
+        return SCP_INVALID_INT;
+    UNORDERED_MAP<std::string,uint32>::iterator it = ci->bystring.find(nocase ? stringToLower(val) : std::string(val));
+    return it != ci->bystring.end() ? it->second : SCP_INVALID_INT;
+}
+
+uint32 SCPDatabase::_CollectRows(uint32 entry, uint8 type, uint32 row, SCPIndexList& result)
+{
+    if(row == SCP_INVALID_INT)
+        return 0;
+    SCPColumnIndex *ci = _colindex[type][entry]; // must exist if a row was found
+    uint32 count = 0;
+    for( ; row != SCP_INVALID_INT; row = ci->next[row], count++)
+        result.push_back(GetIndexByRow(row));
+    return count;
+}
+
+// build the search index for a column the first time it is needed.
+// rows are chained from last to first, so that each chain is in ascending row order and its head is the first match.
+SCPColumnIndex *SCPDatabase::_GetColumnIndex(uint32 entry, uint8 type)
+{
+    if(entry >= _fields_per_row)
+        return NULL;
+    std::vector<SCPColumnIndex*>& v = _colindex[type];
+    if(v.size() < _fields_per_row)
+        v.resize(_fields_per_row, NULL);
+    if(v[entry])
+        return v[entry];
+
+    SCPColumnIndex *ci = new SCPColumnIndex;
+    ci->next.resize(_rowcount, SCP_INVALID_INT);
+    for(uint32 row = _rowcount; row-- > 0; )
+    {
+        uint32 val = _intbuf[row * _fields_per_row + entry];
+        uint32 *head;
+        if(type == SCP_COLINDEX_INT)
+        {
+            head = &ci->byvalue.insert(std::make_pair(val,SCP_INVALID_INT)).first->second;
+        }
+        else
+        {
+            std::string str(GetStringByOffset(val));
+            if(type == SCP_COLINDEX_STRING_NOCASE)
+                str = stringToLower(str);
+            head = &ci->bystring.insert(std::make_pair(str,SCP_INVALID_INT)).first->second;
+        }
+        ci->next[row] = *head;
+        *head = row;
+    }
+    DEBUG(logdebug("SCP: '%s' built %s search index for field %u, %u distinct values",_name.c_str(),
+        type == SCP_COLINDEX_INT ? "int" : "string", entry, uint32(ci->byvalue.size() + ci->bystring.size())));
+    v[entry] = ci;
+    return ci;
+}
+
+void SCPDatabase::_DropColumnIndexes(void)
+{
+    for(uint32 t = 0; t < SCP_COLINDEX_MAX; t++)
+    {
+        for(uint32 i = 0; i < _colindex[t].size(); i++)
+            delete _colindex[t][i];
+        _colindex[t].clear();
+    }
 }
 
 uint32 SCPDatabase::GetFieldType(const char *entry)
 {
-    std::map<std::string,SCPFieldDef>::iterator it = _fielddefs.find(entry);
+    SCPFieldDefMap::iterator it = _fielddefs.find(entry);
     if(it != _fielddefs.end())
         return it->second.type;
     return SCP_INVALID_INT;
@@ -148,12 +356,95 @@ uint32 SCPDatabase::GetFieldType(const char *entry)
 
 uint32 SCPDatabase::GetFieldId(const char *entry)
 {
-    std::map<std::string,SCPFieldDef>::iterator it = _fielddefs.find(entry);
+    SCPFieldDefMap::iterator it = _fielddefs.find(entry);
     if(it != _fielddefs.end())
         return it->second.id;
     return SCP_INVALID_INT;
 }
 
+bool SCPDatabase::GetFieldDef(const char *entry, SCPFieldDef& def)
+{
+    SCPFieldDefMap::iterator it = _fielddefs.find(entry);
+    if(it == _fielddefs.end())
+        return false;
+    def = it->second;
+    return true;
+}
+
+// the index of each row is stored in its field 0.
+// if the (index,row) pairs of a mapped file are given (sorted by index), they are used instead,
+// which avoids touching every page of the data block at startup.
+// returns false (and changes nothing) if the given pairs are not strictly sorted or refer to rows that do not exist.
+bool SCPDatabase::_BuildRowIndex(const uint32 *sorted)
+{
+    if(sorted)
+    {
+        // the pairs come from the file, they must not be trusted to stay inside the arrays.
+        // strictly ascending means every index lies between the first and the last one.
+        for(uint32 i = 0; i < _rowcount; i++)
+            if(sorted[i * 2 + 1] >= _rowcount || (i && sorted[i * 2] <= sorted[(i - 1) * 2]))
+                return false;
+    }
+    _DropColumnIndexes(); // built again when searched
+    _rowbyindex.clear();
+    _rowmap.clear();
+    _sortedindex = NULL;
+    uint32 maxindex;
+    if(sorted)
+    {
+        _minindex = _rowcount ? sorted[0] : 0;
+        maxindex = _rowcount ? sorted[(_rowcount - 1) * 2] : 0;
+    }
+    else
+    {
+        _minindex = _rowcount ? GetIndexByRow(0) : 0;
+        maxindex = _minindex;
+        for(uint32 row = 1; row < _rowcount; row++)
+        {
+            _minindex = std::min(_minindex, GetIndexByRow(row));
+            maxindex = std::max(maxindex, GetIndexByRow(row));
+        }
+    }
+    // an array is used if it wastes not too much memory for missing indexes
+    _dense = maxindex - _minindex < _rowcount * 4 + 1024;
+    if(_dense)
+    {
+        _rowbyindex.resize(_rowcount ? maxindex - _minindex + 1 : 0, SCP_INVALID_INT);
+        for(uint32 i = 0; i < _rowcount; i++)
+        {
+            if(sorted)
+                _rowbyindex[sorted[i * 2] - _minindex] = sorted[i * 2 + 1];
+            else
+                _rowbyindex[GetIndexByRow(i) - _minindex] = i;
+        }
+    }
+    else if(sorted)
+    {
+        _sortedindex = sorted; // searched in place
+    }
+    else
+    {
+        for(uint32 row = 0; row < _rowcount; row++)
+            _rowmap[GetIndexByRow(row)] = row;
+    }
+    DEBUG(logdebug("SCP: '%s' has %u rows, %s index lookup",_name.c_str(),_rowcount,_dense ? "direct" : (_sortedindex ? "sorted" : "hashed")));
+    return true;
+}
+
+uint32 SCPDatabase::_FindSortedRow(uint32 index)
+{
+    uint32 lo = 0, hi = _rowcount;
+    while(lo < hi)
+    {
+        uint32 mid = (lo + hi) / 2;
+        if(_sortedindex[mid * 2] < index)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < _rowcount && _sortedindex[lo * 2] == index ? _sortedindex[lo * 2 + 1] : SCP_INVALID_INT;
+}
+
 SCPDatabase *SCPDatabaseMgr::GetDB(std::string n, bool create)
 {
     return create ? _map.Get(n) : _map.GetNoCreate(n);
@@ -161,78 +452,54 @@ SCPDatabase *SCPDatabaseMgr::GetDB(std::string n, bool create)
 
 uint32 SCPDatabaseMgr::AutoLoadFile(const char *fn)
 {
-    char *buf;
-    uint32 size;
-
+    SCPParseResult res;
+    res.fn = fn;
     // check if file was loaded before; use memory data if this is the case
     if(memblock *mb = Pointers.GetNoCreate(fn))
     {
-        size = mb->size;
-        buf = (char*)mb->ptr;
+        res.size = mb->size;
+        res.buf = (char*)mb->ptr;
     }
-    else // and if not, read the file from disk
-    {
-        std::fstream fh;
-        size = GetFileSize(fn);
-        if(!size)
-            return 0;
-
-        fh.open(fn,std::ios_base::in | std::ios_base::binary);
-        if( !fh.is_open() )
-            return 0;
-
-        buf = new char[size];
-
-        fh.read(buf,size);
-        fh.close();
+    SCPParseRunnable(&res, NULL).run(); // reads the file if required
+    return _AddParsedFile(res);
+}
 
-        // store the loaded file buffer so we can reuse it later if necessary
-        Pointers.Assign(fn, new memblock((uint8*)buf,size));
+// stores the file buffer and moves the parsed sections into their DBs. files must be added in load order.
+uint32 SCPDatabaseMgr::_AddParsedFile(SCPParseResult& res)
+{
+    if(!res.buf)
+        return 0;
+    if(res.loaded) // store the loaded file buffer so we can reuse it later if necessary
+        Pointers.Assign(res.fn, new memblock((uint8*)res.buf,res.size));
+    for(std::map<std::string,SCPFieldMap>::iterator it = res.dbs.begin(); it != res.dbs.end(); it++)
+    {
+        SCPDatabase *db = GetDB(it->first,true); // create db if not existing
+        db->_MergeFields(it->second);
+        db->sources.insert(res.fn);
     }
+    if(res.lastdb.size())
+        FileRelation[res.fn] = res.lastdb;
+    return res.sections;
+}
 
-    std::string line,dbname,entry,value;
-    SCPDatabase *db = NULL;
-    uint32 id = 0, sections = 0;
-    for(uint32 pos = 0; pos < size; pos++)
+// entries of files added later override those of earlier files
+void SCPDatabase::_MergeFields(SCPFieldMap& src)
+{
+    if(fields.empty())
     {
-        if(buf[pos] == '\n' || buf[pos] == 10 || buf[pos] == 13)
-        {
-            if(line.empty())
-                continue;
-            while(line.size() && (line[0]==' ' || line[0]=='\t'))
-                line.erase(0,1);
-            if(line.size() < 2 || (line[0] == '/' && line[1] == '/'))
-            {
-                line.clear();
-                continue;
-            }
-            size_t eq = line.find("=");
-            if(eq != std::string::npos)
-            {
-                entry=stringToLower(line.substr(0,eq));
-                value=line.substr(eq+1,line.length()-1);
-
-                if(!stricmp(entry.c_str(),"#dbname") && value.size())
-                {
-                    dbname = value;
-                    db = GetDB(dbname,true); // create db if not existing
-                    FileRelation[fn] = dbname;
-                }
-                else if(db)
-                        db->fields[id][entry] = value;
-            }
-            else if(line[0]=='[')
-            {
-                id=(uint32)toInt(line.c_str()+1); // start reading after '['
-                sections++;
-            }
-            line.clear();
-        }
+        fields.swap(src);
+        return;
+    }
+    for(SCPFieldMap::iterator it = src.begin(); it != src.end(); it++)
+    {
+        SCPEntryMap& dst = fields[it->first];
+        if(dst.empty())
+            dst.swap(it->second);
         else
-            line += buf[pos];
+            for(SCPEntryMap::iterator e = it->second.begin(); e != it->second.end(); e++)
+                dst[e->first].swap(e->second);
     }
-    db->sources.insert(fn);
-    return sections;
+    src.clear();
 }
 
 ////////////////////////////////////////////////////////
@@ -409,6 +676,9 @@ bool SCPDatabaseMgr::Compact(const char *dbname, const char *outfile, uint32 com
         md5buf.append(md5.GetDigest(),md5.GetLength());
         nMD5++;
     }
+    // pad the variable sized blocks, so that all blocks stay 4-byte aligned (SCP_FLAG_ALIGNED)
+    while(md5buf.size() % 4)
+        md5buf << (uint8)0;
     sizeMD5 = md5buf.size();
 
     // field types, sorted by IDs
@@ -419,11 +689,13 @@ bool SCPDatabaseMgr::Compact(const char *dbname, const char *outfile, uint32 com
     {
         fieldbuf << itf->first << itf->second.id << itf->second.type; // entry name, id, type.
     }
+    while(fieldbuf.size() % 4)
+        fieldbuf << (uint8)0;
     sizeFields = fieldbuf.size();
 
     // index -> ID lookup table, e.g. data with ID 500 will have field index 214, because some IDs in between are missing
-    // it *could* be calculated at load-time from the existing data field, but this way is faster when random-accessing the file itself
-    // (what we dont do anyway, for now)
+    // it *could* be calculated at load-time from the existing data field, but this way is faster when random-accessing the file itself,
+    // which is done if the file is memory mapped. sorted by index.
     ByteBuffer indexbuf;
     for(std::map<uint32,uint32>::iterator itx = idToSectionMap.begin(); itx != idToSectionMap.end(); itx++)
     {
@@ -450,7 +722,7 @@ bool SCPDatabaseMgr::Compact(const char *dbname, const char *outfile, uint32 com
     ByteBuffer hbuf(HEADER_SIZE);
     hbuf.append("SCPC",4); // identifier
 
-    uint32 flags = 0;
+    uint32 flags = SCP_FLAG_ALIGNED;
 
     hbuf << flags; // flags, placeholder; real value is put below
     hbuf << (uint32)0 << (uint32)0 << (uint32)0 << (uint32)0; // padding, not yet used
@@ -484,13 +756,23 @@ bool SCPDatabaseMgr::Compact(const char *dbname, const char *outfile, uint32 com
 
     hbuf.put<uint32>(4,flags); // first 4 bytes are 'SCPC', then flags...
 
-    FILE *fh = fopen(outfile,"wb");
+    // other processes may have the old file mapped, it must be replaced, not overwritten
+    std::string tmpfile = std::string(outfile) + ".tmp";
+    FILE *fh = fopen(tmpfile.c_str(),"wb");
     if(!fh)
         return false;
 
     fwrite(hbuf.contents(), hbuf.size(), 1, fh);
     fwrite(z.contents(), z.size(), 1, fh);
     fclose(fh);
+#if PLATFORM == PLATFORM_WIN32
+    remove(outfile); // rename() does not overwrite on windows
+#endif
+    if(rename(tmpfile.c_str(), outfile))
+    {
+        logerror("SCP Compact: Can't replace '%s'",outfile);
+        remove(tmpfile.c_str());
+    }
 
     if(!db)
         db = GetDB(dbname,true); // create if not exist
@@ -509,10 +791,9 @@ bool SCPDatabaseMgr::Compact(const char *dbname, const char *outfile, uint32 com
     db->_intbuf = membuf; // <<-- do NOT drop the membuf, its still used and will be deleted with ~SCPDatabase()!!
     db->_fields_per_row = nFields;
     db->_rowcount = nRows;
-    db->_indexes = idToSectionMap;
-    db->_fielddefs = fieldIdMap;
-    for(std::map<uint32,uint32>::iterator it = idToSectionMap.begin(); it != idToSectionMap.end(); it++)
-        db->_indexes_reverse[it->second] = it->first;
+    for(std::map<std::string,SCPFieldDef>::iterator it = fieldIdMap.begin(); it != fieldIdMap.end(); it++)
+        db->_fielddefs[it->first] = it->second;
+    db->_BuildRowIndex();
 
     return true;
 }
@@ -531,49 +812,37 @@ void SCPDatabaseMgr::_FilterFiles(std::deque<std::string>& files, std::string db
         }
         else // if not previously loaded, load now and cache
         {
-            std::fstream fh;
-            fh.open( it->c_str() , std::ios_base::in | std::ios_base::binary);
-            if( !fh.is_open() )
+            FILE *fh = fopen(it->c_str(), "rb");
+            if(!fh)
             {
                 logerror("SCP: Can't open file '%s'", it->c_str());
+                it = files.erase(it);
                 continue;
             }
 
-            uint32 size = 1000; // search for #dbname tag in first 1000 bytes
-            char *buf = new char[size];
-            memset(buf,0,size);
-
-            fh.read(buf,size);
-            fh.close();
-
-            std::string line,dbn;
-            for(uint32 pos = 0; pos < size; pos++)
+            char buf[1000]; // search for #dbname tag in first 1000 bytes
+            uint32 size = fread(buf, 1, sizeof(buf), fh);
+            fclose(fh);
+            if(size == sizeof(buf)) // only complete lines
+                while(size && buf[size - 1] != '\n' && buf[size - 1] != '\r')
+                    size--;
+
+            SCPLineReader rd(buf, size);
+            const char *line;
+            uint32 len;
+            while(rd.Next(line,len))
             {
-                if(buf[pos] == '\n' || buf[pos] == 10 || buf[pos] == 13)
+                if(len > 8 && !strnicmp(line,"#dbname=",8))
                 {
-                    if(line.empty())
-                        continue;
-                    while(line.size() && (line[0]==' ' || line[0]=='\t'))
-                        line.erase(0,1);
-                    if(line[0] == '#')
+                    std::string t(line + 8, len - 8); // current db name
+                    FileRelation[*it] = t;
+                    if(!stricmp(t.c_str(), dbname.c_str()))
                     {
-                        if(!strnicmp(line.c_str(),"#dbname=",8))
-                        {
-                            std::string t = line.c_str() + 8; // current db name
-                            FileRelation[*it] = t;
-                            if(!stricmp(t.c_str(), dbname.c_str()))
-                            {
-                                load_it = true;
-                                break;
-                            }
-                        }
+                        load_it = true;
+                        break;
                     }
-                    line.clear();
                 }
-                else
-                    line += buf[pos];
             }
-            delete [] buf;
         }
 
         if(load_it)
@@ -646,12 +915,27 @@ uint32 SCPDatabaseMgr::SearchAndLoad(const char *dbname, bool no_compiled)
         }
     }
 
-    for(std::deque<std::string>::iterator it = goodfiles.begin(); it != goodfiles.end(); it++)
+    // read and parse all files in parallel on the data loader threads, then add them in their original order
+    std::vector<SCPParseResult> parsed(goodfiles.size());
+    ZThread::CountingSemaphore done;
+    for(uint32 i = 0; i < goodfiles.size(); i++)
+    {
+        logdebug("File '%s' matching database '%s', loading", goodfiles[i].c_str(), dbname);
+        parsed[i].fn = goodfiles[i];
+        if(memblock *mb = Pointers.GetNoCreate(goodfiles[i])) // use memory data if the file was loaded before
+        {
+            parsed[i].buf = (char*)mb->ptr;
+            parsed[i].size = mb->size;
+        }
+        MemoryDataHolder::Execute(new SCPParseRunnable(&parsed[i], &done));
+    }
+    for(uint32 i = 0; i < parsed.size(); i++)
+        done.wait();
+    for(uint32 i = 0; i < parsed.size(); i++)
     {
-        logdebug("File '%s' matching database '%s', loading", it->c_str(), dbname);
         count++;
-        uint32 sections = AutoLoadFile((char*)it->c_str());
-        logdebug("%u sections loaded", sections);
+        uint32 sections = _AddParsedFile(parsed[i]);
+        logdebug("%u sections loaded from '%s'", sections, parsed[i].fn.c_str());
     }
 
     char fn[100];
@@ -700,25 +984,26 @@ void SCPDatabaseMgr::AddSearchPath(const char *path)
     _paths.push_back(p);
 }
 
+// checks if a block lies completely inside the loaded data
+inline bool blockinside(uint32 offs, uint32 size, uint32 total)
+{
+    return offs <= total && size <= total - offs;
+}
+
 bool SCPDatabaseMgr::LoadCompactSCP(const char *fn, const char *dbname, uint32 nSourcefiles)
 {
-    uint32 filesize = GetFileSize(fn);
-    if(filesize < HEADER_SIZE)
-    {
-        logerror("Database file '%s' is too small!",fn);
-        return false;
-    }
-    std::fstream fh;
-    fh.open(fn, std::ios_base::in | std::ios_base::binary);
-    if(!fh.is_open())
+    // the file is always mapped. uncompressed and aligned files are then used directly from the mapping,
+    // pages are loaded by the OS only when accessed and shared between processes using the same file.
+    MappedFile *mf = new MappedFile();
+    if(!mf->Open(fn) || mf->GetSize() < HEADER_SIZE)
     {
-        logerror("Error opening '%s'",fn);
+        logerror("Database file '%s' can't be opened or is too small!",fn);
+        delete mf;
         return false;
     }
 
-    ByteBuffer hbuf;
-    hbuf.resize(HEADER_SIZE);
-    fh.read((char*)hbuf.contents(), HEADER_SIZE);
+    ByteBuffer hbuf(HEADER_SIZE);
+    hbuf.append(mf->GetData(), HEADER_SIZE);
 
     char tag[4];
     uint32 flags, padding[4];
@@ -734,6 +1019,7 @@ bool SCPDatabaseMgr::LoadCompactSCP(const char *fn, const char *dbname, uint32 n
     if(memcmp(tag,"SCPC",4))
     {
         logerror("'%s' is not a compact database file!",fn);
+        delete mf;
         return false;
     }
     hbuf >> flags;
@@ -744,46 +1030,55 @@ bool SCPDatabaseMgr::LoadCompactSCP(const char *fn, const char *dbname, uint32 n
     hbuf >> offsData >> nRows >> sizeData;
     hbuf >> offsStrings >> nStrings >> sizeStrings;
 
-    // read some extra bytes depending on flags
-    if(flags & SCP_FLAG_COMPRESSED)
-        fh.read((char*)&realsize, sizeof(uint32));
-
+    // all offsets are relative to the start of the data following the header
+    const uint8 *base = mf->GetData() + HEADER_SIZE;
+    uint32 basesize = mf->GetSize() - HEADER_SIZE;
     ZCompressor z;
-    uint32 remain = sizeMD5 + sizeIndexes + sizeFields + sizeData + sizeStrings;
-    z.resize(remain);
-    fh.read((char*)z.contents(), remain);
-
-    fh.close(); // All data are read from the file now, it can safely be closed
-
     if(flags & SCP_FLAG_COMPRESSED)
     {
+        // read some extra bytes depending on flags
+        if(basesize < sizeof(uint32))
+        {
+            logerror("LoadCompactSCP: '%s' is truncated",fn);
+            delete mf;
+            return false;
+        }
+        memcpy(&realsize, base, sizeof(uint32));
+        z.append(base + sizeof(uint32), basesize - sizeof(uint32));
         z.Compressed(true);
         z.RealSize(realsize);
         z.Inflate();
         if(z.Compressed())
         {
             logerror("LoadCompactSCP: Unable to uncompress '%s'",fn);
+            delete mf;
             return false;
         }
+        base = z.contents();
+        basesize = z.size();
     }
 
+    if(!blockinside(offsMD5,sizeMD5,basesize) || !blockinside(offsFields,sizeFields,basesize)
+        || !blockinside(offsData,sizeData,basesize) || !blockinside(offsStrings,sizeStrings,basesize)
+        || !nFields || uint64(nRows) * nFields * sizeof(uint32) != sizeData)
+    {
+        logerror("'%s' has wrong block offsets or sizes, can't load",fn);
+        delete mf;
+        return false;
+    }
+
+    // older files may have unaligned blocks, these (and compressed ones) are copied into memory
+    bool mapit = !(flags & SCP_FLAG_COMPRESSED) && (flags & SCP_FLAG_ALIGNED) && !(offsData % 4)
+        && !(offsIndexes % 4) && nIndexes == nRows && sizeIndexes == nRows * 2 * sizeof(uint32)
+        && blockinside(offsIndexes,sizeIndexes,basesize);
+
     SCPDatabase *db = GetDB(dbname,true);
     db->_name = dbname;
     db->_compact = true;
 
-    ByteBuffer md5buf(sizeMD5);
-    md5buf.resize(sizeMD5);
     // read MD5 block
-    z.rpos(offsMD5);
-    if(z.rpos() == offsMD5)
-    {
-        z.read((uint8*)md5buf.contents(),sizeMD5);
-    }
-    else
-    {
-        logerror("'%s' has wrong MD5 offset, can't load",fn);
-        return false;
-    }
+    ByteBuffer md5buf(sizeMD5);
+    md5buf.append(base + offsMD5, sizeMD5);
 
     for(uint32 i = 0; i < nMD5; i++)
     {
@@ -799,6 +1094,7 @@ bool SCPDatabaseMgr::LoadCompactSCP(const char *fn, const char *dbname, uint32 n
         if(!refFile)
         {
             logdebug("Not loading '%s', file doesn't exist",fn);
+            delete mf;
             return false;
         }
         uint8 *refFileBuf = new uint8[refFileSize];
@@ -812,6 +1108,7 @@ bool SCPDatabaseMgr::LoadCompactSCP(const char *fn, const char *dbname, uint32 n
         if(memcmp(buf, md5.GetDigest(), MD5_DIGEST_LENGTH))
         {
             logdebug("MD5-check: '%s' has changed!", refFn.c_str());
+            delete mf;
             return false;
         }
         else
@@ -825,45 +1122,15 @@ bool SCPDatabaseMgr::LoadCompactSCP(const char *fn, const char *dbname, uint32 n
     if(nSourcefiles > nMD5)
     {
         logdebug("There are more source files existing then hashed in the CCP file, must recompact.");
+        delete mf;
         return false;
     }
     ASSERT(nMD5 == nSourcefiles); // if we didnt return until now, something isnt good
 
-    // everything good so far? we reached this point? then its likely that the rest of the file is ok, alloc remaining buffers
-    ByteBuffer indexbuf(sizeIndexes);
+    // everything good so far? we reached this point? then its likely that the rest of the file is ok
+    // read field definitions
     ByteBuffer fieldsbuf(sizeFields);
-    indexbuf.resize(sizeIndexes);
-    fieldsbuf.resize(sizeFields);
-
-    // read indexes block
-    z.rpos(offsIndexes);
-    if(z.rpos() == offsIndexes)
-        z.read((uint8*)indexbuf.contents(),sizeIndexes);
-    else
-    {
-        logerror("'%s' has wrong indexes offset, can't load",fn);
-        return false;
-    }
-
-    // read field definitions buf
-    z.rpos(offsFields);
-    if(z.rpos() == offsFields)
-        z.read((uint8*)fieldsbuf.contents(),sizeFields);
-    else
-    {
-        logerror("'%s' has wrong field defs offset, can't load",fn);
-        return false;
-    }
-
-    // main data and string blocks follow below
-
-    for(uint32 i = 0; i < nIndexes; i++)
-    {
-        uint32 field_id, row;
-        indexbuf >> field_id >> row;
-        db->_indexes[field_id] = row;
-        db->_indexes_reverse[row] = field_id;
-    }
+    fieldsbuf.append(base + offsFields, sizeFields);
 
     for(uint32 i = 0; i < nFields - 1; i++) // the first field (index column) is never written to the file!
     {
@@ -873,39 +1140,43 @@ bool SCPDatabaseMgr::LoadCompactSCP(const char *fn, const char *dbname, uint32 n
         db->_fielddefs[fieldn] = fieldd;
     }
 
-    // read main data block
-    ASSERT(nRows * nFields == sizeData / sizeof(uint32));
-    z.rpos(offsData);
-    if(z.rpos() == offsData)
-    {
-        db->_intbuf = new uint32[nRows * nFields];
-        z.read((uint8*)db->_intbuf, sizeData); // load this somewhat fast and without a for loop
-    }
-    else
-    {
-        logerror("'%s' has wrong data offset, can't load",fn);
-        return false;
-    }
+    db->_stringsize = sizeStrings;
+    db->_rowcount = nRows;
+    db->_fields_per_row = nFields;
 
-    // read strings
-    z.rpos(offsStrings);
-    if(z.rpos() == offsStrings)
+    if(mapit)
     {
-        db->_stringbuf = new char[sizeStrings];
-        z.read((uint8*)db->_stringbuf,sizeStrings);
+        // main data and strings are used in place, the row lookup is built from the indexes block
+        db->_intbuf = (uint32*)(base + offsData);
+        db->_stringbuf = (char*)(base + offsStrings);
+        if(!db->_BuildRowIndex((const uint32*)(base + offsIndexes)))
+        {
+            logerror("'%s' has a broken index block, can't load",fn);
+            db->_intbuf = NULL;
+            db->_stringbuf = NULL;
+            db->_stringsize = 0;
+            db->_rowcount = 0;
+            delete mf;
+            return false;
+        }
+        db->_mapped = mf;
     }
     else
     {
-        logerror("'%s' has wrong strings offset, can't load",fn);
-        return false;
+        // read main data block and strings
+        // (the indexes block is not needed, the row lookup is built from the data block)
+        db->_intbuf = new uint32[nRows * nFields];
+        memcpy(db->_intbuf, base + offsData, sizeData); // load this somewhat fast and without a for loop
+        db->_stringbuf = new char[sizeStrings];
+        memcpy(db->_stringbuf, base + offsStrings, sizeStrings);
+        delete mf; // All data are read from the file now, it can safely be closed
+        db->_BuildRowIndex();
     }
-    db->_stringsize = sizeStrings;
-    db->_rowcount = nRows;
-    db->_fields_per_row = nFields;
 
     db->DropTextData(); // delete pointers to file content created at md5 comparison
 
     // all fine, DB loaded
+    DEBUG(logdebug("SCP: '%s' %s",fn,mapit ? "used memory mapped" : "read into memory"));
 
     return true;
 }
@@ -922,7 +1193,7 @@ void SCPDatabase::DumpStructureToFile(const char *fn)
     ftype[0] = SCP_TYPE_INT;
 
     f << "Fields: (0 is always index field)\n";
-    for(std::map<std::string,SCPFieldDef>::iterator it = _fielddefs.begin(); it != _fielddefs.end(); it++)
+    for(SCPFieldDefMap::iterator it = _fielddefs.begin(); it != _fielddefs.end(); it++)
     {
         f << "-> Name: " << it->first << ", ID: " << it->second.id << ", type: " << gettypename(it->second.type) << "\n";
         ftype[it->second.id] = it->second.type;
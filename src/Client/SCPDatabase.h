@@ -3,6 +3,8 @@
 
 #include "DefScript/TypeStorage.h"
 #include "ZCompressor.h"
+#include "UnorderedMap.h"
+#include "MappedFile.h"
 #include <set>
 
 enum SCPFieldTypes
@@ -14,7 +16,8 @@ enum SCPFieldTypes
 
 enum SCPFlags
 {
-    SCP_FLAG_COMPRESSED = 1
+    SCP_FLAG_COMPRESSED = 1,
+    SCP_FLAG_ALIGNED = 2 // all blocks start at 4-byte boundaries, uncompressed files can be used directly from a memory mapping
 };
 
 struct SCPFieldDef
@@ -25,10 +28,33 @@ struct SCPFieldDef
 
 #define SCP_INVALID_INT 0xFFFFFFFF
 
+typedef UNORDERED_MAP<std::string,SCPFieldDef> SCPFieldDefMap;
+typedef UNORDERED_MAP<uint32,uint32> SCPRowMap;
+typedef std::vector<uint32> SCPIndexList;
+
+enum SCPColumnIndexType
+{
+    SCP_COLINDEX_INT = 0,
+    SCP_COLINDEX_STRING = 1,
+    SCP_COLINDEX_STRING_NOCASE = 2,
+    SCP_COLINDEX_MAX
+};
+
+// reverse lookup for one column, built on its first search.
+// every distinct value maps to the first row that has it, the remaining rows with that value are chained in ascending order.
+struct SCPColumnIndex
+{
+    UNORDERED_MAP<uint32,uint32> byvalue; // SCP_COLINDEX_INT
+    UNORDERED_MAP<std::string,uint32> bystring; // SCP_COLINDEX_STRING(_NOCASE), lowercased if nocase
+    std::vector<uint32> next; // row -> next row with the same value, SCP_INVALID_INT at the end
+};
+
 typedef std::map<std::string,std::string> SCPEntryMap;
 typedef std::map<uint32,SCPEntryMap> SCPFieldMap;
 typedef std::set<std::string> SCPSourceList;
 
+struct SCPParseResult;
+
 class SCPDatabase
 {
     friend class SCPDatabaseMgr;
@@ -45,8 +71,19 @@ public:
     void DropTextData(void);
 
     // access funcs
+    // for repeated access, resolve the field name once with GetFieldDef() or GetFieldId() and use the uint32 variants
     void *GetPtr(uint32 index, const char *entry);
     void *GetPtrByField(uint32 index, uint32 entry);
+    inline uint32 GetRow(uint32 index) // SCP_INVALID_INT if the index does not exist
+    {
+        if(_dense)
+            return index - _minindex < _rowbyindex.size() ? _rowbyindex[index - _minindex] : SCP_INVALID_INT;
+        if(_sortedindex)
+            return _FindSortedRow(index);
+        SCPRowMap::iterator it = _rowmap.find(index);
+        return it != _rowmap.end() ? it->second : SCP_INVALID_INT;
+    }
+    inline uint32 GetIndexByRow(uint32 row) { return _intbuf[row * _fields_per_row]; } // field 0 is always the index
     inline char *GetStringByOffset(uint32 offs) { return (char*)(offs < _stringsize ? _stringbuf + offs : ""); }
     inline char *GetString(uint32 index, const char *entry) { return GetStringByOffset(GetUint32(index,entry)); }
     inline char *GetString(uint32 index, uint32 entry) { return GetStringByOffset(GetUint32(index,entry)); }
@@ -58,20 +95,35 @@ public:
     inline float GetFloat(uint32 index, uint32 entry) { float *t = (float*)GetPtrByField(index,entry); return t ? *t : 0; }
     uint32 GetFieldType(const char *entry);
     uint32 GetFieldId(const char *entry);
+    bool GetFieldDef(const char *entry, SCPFieldDef& def); // id and type at once
     inline void *GetRowByIndex(uint32 index) { return GetPtrByField(index,0); }
     uint32 GetFieldByUint32Value(const char *entry, uint32 val);
     uint32 GetFieldByUint32Value(uint32 entry, uint32 val);
     uint32 GetFieldByIntValue(const char *entry, int32 val);
     uint32 GetFieldByIntValue(uint32 entry, int32 val);
-    uint32 GetFieldByStringValue(const char *entry, const char *val);
-    uint32 GetFieldByStringValue(uint32 entry, const char *val);
+    uint32 GetFieldByStringValue(const char *entry, const char *val, bool nocase = true);
+    uint32 GetFieldByStringValue(uint32 entry, const char *val, bool nocase = true);
+    // same as above, but append the indexes of all matching rows to the list and return how many were found
+    uint32 GetFieldsByUint32Value(uint32 entry, uint32 val, SCPIndexList& result);
+    uint32 GetFieldsByIntValue(uint32 entry, int32 val, SCPIndexList& result);
+    uint32 GetFieldsByStringValue(uint32 entry, const char *val, SCPIndexList& result, bool nocase = true);
     // float value lookup not necessary
     inline uint32 GetFieldsCount(void) { return _fields_per_row; }
     inline uint32 GetRowsCount(void) { return _rowcount; }
+    inline bool IsMapped(void) { return _mapped != NULL; }
 
 
     void DumpStructureToFile(const char *fn);
 private:
+    void _MergeFields(SCPFieldMap& src);
+    bool _BuildRowIndex(const uint32 *sorted = NULL);
+    uint32 _FindSortedRow(uint32 index);
+    uint32 _FindFirstRow(uint32 entry, uint32 val);
+    uint32 _FindFirstRow(uint32 entry, const char *val, bool nocase);
+    uint32 _CollectRows(uint32 entry, uint8 type, uint32 row, SCPIndexList& result);
+    SCPColumnIndex *_GetColumnIndex(uint32 entry, uint8 type);
+    void _DropColumnIndexes(void);
+
     // text data related
     SCPSourceList sources;
     SCPFieldMap fields;
@@ -84,8 +136,16 @@ private:
     char *_stringbuf;
     uint32 _stringsize;
     uint32 *_intbuf;
-    std::map<uint32,uint32> _indexes, _indexes_reverse; // stores index-to-rowID, rowID-to-index
-    std::map<std::string,SCPFieldDef> _fielddefs;
+    MappedFile *_mapped; // if set, _intbuf and _stringbuf point into this file and must not be deleted
+    // index-to-row lookup. a plain array if the indexes are dense enough, a hash map otherwise,
+    // or a binary search over the (index,row) pairs of a mapped file
+    bool _dense;
+    uint32 _minindex;
+    std::vector<uint32> _rowbyindex;
+    SCPRowMap _rowmap;
+    const uint32 *_sortedindex;
+    SCPFieldDefMap _fielddefs;
+    std::vector<SCPColumnIndex*> _colindex[SCP_COLINDEX_MAX]; // per-column search indexes, built on demand
 };
 
 typedef TypeStorage<SCPDatabase> SCPDatabaseMap;
@@ -109,6 +169,7 @@ public:
 
 private:
     void _FilterFiles(std::deque<std::string>& files, std::string dbname);
+    uint32 _AddParsedFile(SCPParseResult& res);
     SCPDatabaseMap _map;
     std::deque<std::string> _paths;
     uint32 _compr; // zlib compression level
@@ -30,15 +30,11 @@ void WorldSession::SendChatMessage(uint32 type, uint32 lang, std::string msg, st
 	SendWorldPacket(packet);
 }
 
-void WorldSession::SendQueryPlayerName(uint64 guid)
+void WorldSession::SendQueryPlayerName(uint64 guid, uint8 prio)
 {
     if((!_logged) || guid==0)
         return;
-    WorldPacket packet;
-    packet << guid;
-    packet.SetOpcode(CMSG_NAME_QUERY);
-    SendWorldPacket(packet);
-    // to prevent opcode spam, we need to make a list with already requested names
+    _queries.Add(QUERY_PLAYERNAME, guid, 0, prio);
 }
 
 void WorldSession::SendPing(uint32 ping)
@@ -63,18 +59,14 @@ void WorldSession::SendEmote(uint32 id)
     SendWorldPacket(packet);
 }
 
-void WorldSession::SendQueryItem(uint32 entry, uint64 guid) // is it a guid? not sure
+void WorldSession::SendQueryItem(uint32 entry, uint64 guid, uint8 prio) // is it a guid? not sure
 {
     if(objmgr.ItemNonExistent(entry))
     {
         logdebug("Skipped query of item %u (was marked as nonexistent before)",entry);
         return;
     }
-    logdebug("Sending Item query, id=%u",entry);
-    WorldPacket packet;
-    packet << entry << guid;
-    packet.SetOpcode(CMSG_ITEM_QUERY_SINGLE);
-    SendWorldPacket(packet);
+    _queries.Add(QUERY_ITEM, entry, guid, prio);
 }
 
 // use ONLY this function to target objects and notify the server about it.
@@ -179,29 +171,53 @@ void WorldSession::SendWhoListRequest(uint32 minlvl, uint32 maxlvl, uint32 racem
     SendWorldPacket(pkt);
 }
 
-void WorldSession::SendQueryCreature(uint32 entry, uint64 guid)
+void WorldSession::SendQueryCreature(uint32 entry, uint64 guid, uint8 prio)
 {
     if(objmgr.CreatureNonExistent(entry))
     {
         logdebug("Skipped query of creature %u (was marked as nonexistent before)",entry);
         return;
     }
-    logdebug("Sending creature query, id=%u",entry);
-    WorldPacket wp(CMSG_CREATURE_QUERY,4+8);
-    wp << entry << guid;
-    SendWorldPacket(wp);
+    _queries.Add(QUERY_CREATURE, entry, guid, prio);
 }
 
-void WorldSession::SendQueryGameobject(uint32 entry, uint64 guid)
+void WorldSession::SendQueryGameobject(uint32 entry, uint64 guid, uint8 prio)
 {
     if(objmgr.GONonExistent(entry))
     {
         logdebug("Skipped query of gameobject %u (was marked as nonexistent before)",entry);
         return;
     }
-    logdebug("Sending gameobject query, id=%u",entry);
-    WorldPacket wp(CMSG_GAMEOBJECT_QUERY,4+8);
-    wp << entry << guid;
+    _queries.Add(QUERY_GAMEOBJECT, entry, guid, prio);
+}
+
+void WorldSession::SendQueryPacket(uint8 type, uint64 id, uint64 guid)
+{
+    WorldPacket wp;
+    switch(type)
+    {
+        case QUERY_PLAYERNAME:
+            wp.SetOpcode(CMSG_NAME_QUERY);
+            wp << id;
+            break;
+        case QUERY_ITEM:
+            logdebug("Sending Item query, id=%u",(uint32)id);
+            wp.SetOpcode(CMSG_ITEM_QUERY_SINGLE);
+            wp << (uint32)id << guid;
+            break;
+        case QUERY_CREATURE:
+            logdebug("Sending creature query, id=%u",(uint32)id);
+            wp.SetOpcode(CMSG_CREATURE_QUERY);
+            wp << (uint32)id << guid;
+            break;
+        case QUERY_GAMEOBJECT:
+            logdebug("Sending gameobject query, id=%u",(uint32)id);
+            wp.SetOpcode(CMSG_GAMEOBJECT_QUERY);
+            wp << (uint32)id << guid;
+            break;
+        default:
+            return;
+    }
     SendWorldPacket(wp);
 }
 
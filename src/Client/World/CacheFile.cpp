@@ -0,0 +1,142 @@
+#include <fstream>
+#include "common.h"
+#include "CacheFile.h"
+
+CacheFile::CacheFile()
+{
+    _version = 0;
+    _index = NULL;
+    _strings = NULL;
+    _count = 0;
+    _stringsize = 0;
+}
+
+bool CacheFile::Open(const char *fn, uint32 version)
+{
+    Close();
+    _fn = fn;
+    _version = version;
+    if(!_mf.Open(fn))
+        return false;
+
+    const uint8 *data = _mf.GetData();
+    uint32 size = _mf.GetSize();
+    const CacheFileHeader *hdr = (const CacheFileHeader*)data;
+    if(size < sizeof(CacheFileHeader) || hdr->magic != CACHEFILE_MAGIC || hdr->version != version)
+    {
+        logerror("CacheFile: '%s' is outdated or not a cache file",fn);
+        Close();
+        return false;
+    }
+    // compared so that nothing can wrap around. the string table must end with '\0', see CacheStrings
+    if(hdr->indexoffs > size || hdr->count > (size - hdr->indexoffs) / sizeof(CacheFileIndexEntry)
+        || hdr->stringoffs > size || !hdr->stringsize || hdr->stringsize > size - hdr->stringoffs
+        || data[hdr->stringoffs + hdr->stringsize - 1] != '\0')
+    {
+        logerror("CacheFile: '%s' is corrupt",fn);
+        Close();
+        return false;
+    }
+    _index = (const CacheFileIndexEntry*)(data + hdr->indexoffs);
+    _count = hdr->count;
+    _strings = (const char*)(data + hdr->stringoffs);
+    _stringsize = hdr->stringsize;
+    return true;
+}
+
+bool CacheFile::Reopen(void)
+{
+    std::string fn = _fn;
+    return fn.length() && Open(fn.c_str(), _version);
+}
+
+void CacheFile::Close(void)
+{
+    _mf.Close();
+    _index = NULL;
+    _strings = NULL;
+    _count = 0;
+    _stringsize = 0;
+}
+
+const CacheFileIndexEntry *CacheFile::_Find(uint32 entry)
+{
+    uint32 lo = 0, hi = _count;
+    while(lo < hi)
+    {
+        uint32 mid = (lo + hi) >> 1;
+        if(_index[mid].entry < entry)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo < _count && _index[lo].entry == entry)
+        return &_index[lo];
+    return NULL;
+}
+
+bool CacheFile::Read(uint32 entry, ByteBuffer& buf)
+{
+    const CacheFileIndexEntry *ie = _Find(entry);
+    if(!ie || ie->offset > _mf.GetSize() || ie->size > _mf.GetSize() - ie->offset)
+        return false;
+    buf.clear();
+    buf.append(_mf.GetData() + ie->offset, ie->size);
+    return true;
+}
+
+
+CacheFileWriter::CacheFileWriter()
+{
+    _strings << ""; // offset 0
+    _strmap[""] = 0;
+}
+
+uint32 CacheFileWriter::AddString(const std::string& s)
+{
+    std::map<std::string,uint32>::iterator it = _strmap.find(s);
+    if(it != _strmap.end())
+        return it->second;
+    uint32 offs = _strings.size();
+    _strings << s;
+    _strmap[s] = offs;
+    return offs;
+}
+
+void CacheFileWriter::AddRecord(uint32 entry, ByteBuffer& data)
+{
+    CacheFileIndexEntry& ie = _index[entry];
+    ie.entry = entry;
+    ie.offset = sizeof(CacheFileHeader) + _data.size(); // an overwritten record just leaves some unused bytes
+    ie.size = data.size();
+    _data.append(data);
+}
+
+bool CacheFileWriter::Write(const char *fn, uint32 version)
+{
+    std::fstream fh;
+    fh.open(fn, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if(!fh)
+        return false;
+
+    CacheFileHeader hdr;
+    hdr.magic = CACHEFILE_MAGIC;
+    hdr.version = version;
+    hdr.count = _index.size();
+    hdr.indexoffs = sizeof(CacheFileHeader) + _data.size();
+    hdr.stringoffs = hdr.indexoffs + hdr.count * sizeof(CacheFileIndexEntry);
+    hdr.stringsize = _strings.size();
+
+    fh.write((char*)&hdr, sizeof(CacheFileHeader));
+    if(_data.size())
+        fh.write((char*)_data.contents(), _data.size());
+    for(std::map<uint32,CacheFileIndexEntry>::iterator it = _index.begin(); it != _index.end(); it++) // sorted by entry
+        fh.write((char*)&it->second, sizeof(CacheFileIndexEntry));
+    fh.write((char*)_strings.contents(), _strings.size());
+    fh.flush();
+    bool ok = fh.good();
+    fh.close();
+    if(!ok)
+        remove(fn);
+    return ok;
+}
@@ -0,0 +1,84 @@
+#ifndef _CACHEFILE_H
+#define _CACHEFILE_H
+
+#include "MappedFile.h"
+
+// cache file layout (all values in host byte order):
+// [CacheFileHeader] [records] [CacheFileIndexEntry * count, sorted by entry] [string table]
+// records are written by the CacheHandler functions; strings are stored as offsets into the string table,
+// every distinct string only once. offset 0 is always the empty string.
+#define CACHEFILE_MAGIC 0x46435750 // "PWCF"
+
+struct CacheFileHeader
+{
+    uint32 magic;
+    uint32 version;
+    uint32 count;
+    uint32 indexoffs;
+    uint32 stringoffs;
+    uint32 stringsize;
+};
+
+struct CacheFileIndexEntry
+{
+    uint32 entry;
+    uint32 offset;
+    uint32 size;
+};
+
+// a string table, either of a cache file or of a single journal record
+struct CacheStrings
+{
+    CacheStrings(const char *d, uint32 s) : data(d), size(s) {}
+    // the table is terminated by '\0', so a bad offset can at most return garbage, but not crash
+    inline const char *Get(uint32 offs) { return offs < size ? data + offs : ""; }
+    const char *data;
+    uint32 size;
+};
+
+// read access to a cache file. the file is memory mapped, records are only touched when they are requested.
+class CacheFile
+{
+public:
+    CacheFile();
+    bool Open(const char *fn, uint32 version);
+    bool Reopen(void); // same file again, e.g. after it was replaced
+    void Close(void);
+    inline bool IsOpen(void) { return _mf.IsOpen(); }
+    inline uint32 GetCount(void) { return _count; }
+    inline uint32 GetEntry(uint32 i) { return _index[i].entry; }
+    inline bool Has(uint32 entry) { return _Find(entry) != NULL; }
+    bool Read(uint32 entry, ByteBuffer& buf); // copies the record into buf
+    inline CacheStrings GetStrings(void) { return CacheStrings(_strings, _stringsize); }
+
+private:
+    const CacheFileIndexEntry *_Find(uint32 entry);
+    MappedFile _mf;
+    std::string _fn;
+    uint32 _version;
+    const CacheFileIndexEntry *_index;
+    const char *_strings;
+    uint32 _count;
+    uint32 _stringsize;
+};
+
+// collects records and strings, then writes a complete cache file
+class CacheFileWriter
+{
+public:
+    CacheFileWriter();
+    uint32 AddString(const std::string& s);
+    void AddRecord(uint32 entry, ByteBuffer& data);
+    inline uint32 GetCount(void) { return _index.size(); }
+    inline CacheStrings GetStrings(void) { return CacheStrings((const char*)_strings.contents(), _strings.size()); }
+    inline ByteBuffer& GetStringTable(void) { return _strings; }
+    bool Write(const char *fn, uint32 version);
+
+private:
+    std::map<std::string,uint32> _strmap; // string -> offset in _strings
+    ByteBuffer _strings;
+    ByteBuffer _data;
+    std::map<uint32,CacheFileIndexEntry> _index;
+};
+
+#endif
@@ -9,20 +9,62 @@
 #include "WorldSession.h"
 #include "CacheHandler.h"
 #include "Item.h"
+#include "CacheFile.h"
+#include "CacheJournal.h"
 
 // increase this number whenever you change something that makes old files unusable
-uint32 ITEMPROTOTYPES_CACHE_VERSION = 5;
-uint32 CREATURETEMPLATES_CACHE_VERSION = 1;
-uint32 GOTEMPLATES_CACHE_VERSION = 1;
+uint32 ITEMPROTOTYPES_CACHE_VERSION = 6;
+uint32 CREATURETEMPLATES_CACHE_VERSION = 2;
+uint32 GOTEMPLATES_CACHE_VERSION = 2;
+
+#define ITEMPROTOTYPES_CACHE_FILE "./cache/ItemPrototypes.cache"
+#define CREATURETEMPLATES_CACHE_FILE "./cache/CreatureTemplates.cache"
+#define GOTEMPLATES_CACHE_FILE "./cache/GOTemplates.cache"
+#define PLAYERNAMES_CACHE_FILE "./cache/playernames.cache"
+#define NONEXISTENT_CACHE_FILE "./cache/nonexistent.cache"
+
+PlayerNameCache::PlayerNameCache()
+{
+    _journal = NULL;
+}
 
 PlayerNameCache::~PlayerNameCache()
 {
 }
 
-void PlayerNameCache::Add(uint64 guid, std::string name)
+void PlayerNameCache::Add(uint64 guid, std::string name, bool journal)
+{
+    std::string& stored = _cache[guid];
+    if(stored == name)
+        return; // nothing new
+    if(stored.length()) // drop old data if present (renamed character)
+    {
+        PlayerNameIndex::iterator it = _index.find(DefScriptTools::stringToLower(stored));
+        if(it != _index.end() && it->second == guid)
+            _index.erase(it);
+    }
+    stored = name;
+    _index[DefScriptTools::stringToLower(name)] = guid;
+
+    if(_journal && journal)
+    {
+        ByteBuffer rec;
+        rec << guid << name;
+        _journal->Append(rec);
+    }
+}
+
+void PlayerNameCache::Add(PlayerNameMap& names)
 {
-    _cache.erase(guid); // drop old data if present
-    _cache[guid] = name;
+    if(_cache.empty()) // usual case when loading from file, no old entries to take care of
+    {
+        _cache = names;
+        for(PlayerNameMap::iterator it = _cache.begin(); it != _cache.end(); it++)
+            _index[DefScriptTools::stringToLower(it->second)] = it->first;
+        return;
+    }
+    for(PlayerNameMap::iterator it = names.begin(); it != names.end(); it++)
+        Add(it->first, it->second);
 }
 
 bool PlayerNameCache::IsKnown(uint64 guid)
@@ -43,19 +85,25 @@ std::string PlayerNameCache::GetName(uint64 guid)
 
 uint64 PlayerNameCache::GetGuid(std::string name)
 {
-    for(PlayerNameMap::iterator it = _cache.begin(); it != _cache.end(); it++)
-        if(it->second == name)
-            return it->first;
+    PlayerNameIndex::iterator it = _index.find(DefScriptTools::stringToLower(name));
+    if(it != _index.end())
+        return it->second;
     return 0;
 }
 
-bool PlayerNameCache::SaveToFile(void)
+void PlayerNameCache::GetGuids(std::vector<std::string>& names, std::vector<uint64>& guids)
+{
+    guids.resize(names.size());
+    for(uint32 i = 0; i < names.size(); i++)
+        guids[i] = GetGuid(names[i]);
+}
+
+bool PlayerNameCache::SaveToFile(const char *fn)
 {
     if(_cache.empty())
         return true; // no data to save, so we are fine
 
     logdebug("Saving PlayerNameCache...");
-    const char *fn="./cache/playernames.cache";
     std::fstream fh;
     fh.open(fn, std::ios_base::out | std::ios_base::binary);
     if(!fh)
@@ -83,10 +131,9 @@ bool PlayerNameCache::SaveToFile(void)
     return true;
 }
 
-bool PlayerNameCache::ReadFromFile(void)
+bool PlayerNameCache::ReadFromFile(const char *fn)
 {
-    const char *fn="./cache/playernames.cache";
-    log("Loading PlayerNameCache...");
+    logdetail("Loading PlayerNameCache...");
     bool success=true;
     std::fstream fh;
     uint32 size = GetFileSize(fn);
@@ -107,6 +154,7 @@ bool PlayerNameCache::ReadFromFile(void)
     uint32 count;
     uint64 guid;
     char namebuf[MAX_PLAYERNAME_LENGTH + 1];
+    PlayerNameMap loaded;
 
     bb >> count; // entries count
 
@@ -119,13 +167,16 @@ bool PlayerNameCache::ReadFromFile(void)
             logerror("PlayerNameCache data seem corrupt [namelength=%d, should be <=%u]",len,MAX_PLAYERNAME_LENGTH);
             log("-> Clearing cache, creating new.");
             _cache.clear();
+            _index.clear();
+            loaded.clear();
             success = false;
             break;
         }
         memset(namebuf,0,MAX_PLAYERNAME_LENGTH + 1);
         bb.read((uint8*)namebuf, len);
-        Add(guid, namebuf);
+        loaded[guid] = namebuf;
     }
+    Add(loaded);
     if(success)
         logdebug("PlayerNameCache successfully loaded.");
     return success;
@@ -136,181 +187,52 @@ uint32 PlayerNameCache::GetSize(void)
     return _cache.size();
 }
 
-void ItemProtoCache_InsertDataToSession(WorldSession *session)
+static void _ReplayPlayerName(ByteBuffer& rec, void *param)
 {
-    logdetail("ItemProtoCache: Loading...");
-    const char* fn = "./cache/ItemPrototypes.cache";
-    std::fstream fh;
-    fh.open(fn, std::ios_base::in | std::ios_base::binary);
-    if(!fh)
-    {
-        logerror("ItemProtoCache: Could not open file '%s'!",fn);
-        return;
-    }
-
-	uint32 cacheversion, total;
-
+    uint64 guid;
+    std::string name;
     try
     {
-
-	fh.read((char*)&cacheversion,4);
-	if(cacheversion != ITEMPROTOTYPES_CACHE_VERSION)
-	{
-		logerror("ItemProtoCache is outdated! Creating new cache.");
-		fh.close();
-		return;
-	}
-    fh.read((char*)&total,4);
-    logdetail("ItemProtoCache: %u item prototypes stored",total);
-
-    uint32 datasize, counter = 0;
-    ByteBuffer buf;
-    for(uint32 i = 0; i < total && !fh.eof(); i++)
-    {
-        buf.clear();
-        fh.read((char*)&datasize,sizeof(uint32));
-        //DEBUG(logdebug("ItemProtoCache: (%u/%u) - datasize=%u",i,total,datasize));
-        buf.resize(datasize);
-        fh.read((char*)buf.contents(),datasize);
-        ItemProto *proto = new ItemProto();
-        buf >> proto->Id;
-        buf >> proto->Class;
-        buf >> proto->SubClass;
-        buf >> proto->Name;
-        buf >> proto->DisplayInfoID;
-        buf >> proto->Quality;
-        buf >> proto->Flags;
-        buf >> proto->Faction;
-        buf >> proto->BuyPrice;
-        buf >> proto->SellPrice;
-        buf >> proto->InventoryType;
-        buf >> proto->AllowableClass;
-        buf >> proto->AllowableRace;
-        buf >> proto->ItemLevel;
-        buf >> proto->RequiredLevel;
-        buf >> proto->RequiredSkill;
-        buf >> proto->RequiredSkillRank;
-        buf >> proto->RequiredSpell;
-        buf >> proto->RequiredHonorRank;
-        buf >> proto->RequiredCityRank;
-        buf >> proto->RequiredReputationFaction;
-        buf >> proto->RequiredReputationRank;
-        buf >> proto->MaxCount;
-        buf >> proto->Stackable;
-        buf >> proto->ContainerSlots;
-        buf >> proto->StatsCount;
-        for(uint32 i = 0; i < proto->StatsCount; i++)
-        {
-            buf >> proto->ItemStat[i].ItemStatType;
-            buf >> proto->ItemStat[i].ItemStatValue;
-        }
-        buf >> proto->ScalingStatDistribution;
-        buf >> proto->ScalingStatValue;
-        for(int i = 0; i < 5; i++)
-        {
-            buf >> proto->Damage[i].DamageMin;
-            buf >> proto->Damage[i].DamageMax;
-            buf >> proto->Damage[i].DamageType;
-        }
-        buf >> proto->Armor;
-        buf >> proto->HolyRes;
-        buf >> proto->FireRes;
-        buf >> proto->NatureRes;
-        buf >> proto->FrostRes;
-        buf >> proto->ShadowRes;
-        buf >> proto->ArcaneRes;
-        buf >> proto->Delay;
-        buf >> proto->Ammo_type;
-
-        buf >> proto->RangedModRange;
-        for(int s = 0; s < 5; s++)
-        {
-            buf >> proto->Spells[s].SpellId;
-            buf >> proto->Spells[s].SpellTrigger;
-            buf >> proto->Spells[s].SpellCharges;
-            buf >> proto->Spells[s].SpellCooldown;
-            buf >> proto->Spells[s].SpellCategory;
-            buf >> proto->Spells[s].SpellCategoryCooldown;
-        }
-        buf >> proto->Bonding;
-        buf >> proto->Description;
-        buf >> proto->PageText;
-        buf >> proto->LanguageID;
-        buf >> proto->PageMaterial;
-        buf >> proto->StartQuest;
-        buf >> proto->LockID;
-        buf >> proto->Material;
-        buf >> proto->Sheath;
-        buf >> proto->RandomProperty;
-        buf >> proto->RandomSuffix; // added in 2.0.3
-        buf >> proto->Block;
-        buf >> proto->ItemSet;
-        buf >> proto->MaxDurability;
-		buf >> proto->Area;
-        buf >> proto->Map;
-        buf >> proto->BagFamily;
-        buf >> proto->TotemCategory; // Added in 1.12.x client branch
-		for(uint32 s = 0; s < 3; s++)
-		{
-			buf >> proto->Socket[s].Color;
-			buf >> proto->Socket[s].Content;
-		}
-		buf >> proto->socketBonus;
-		buf >> proto->GemProperties;
-		buf >> proto->RequiredDisenchantSkill;
-		buf >> proto->ArmorDamageModifier;
-        buf >> proto->Duration;
-        buf >> proto->ItemLimitCategory;
-        buf >> proto->HolidayId;
-
-        if(proto->Id)
-        {
-            //DEBUG(logdebug("ItemProtoCache: Loaded %u [%s]",proto->Id, proto->Name[0].c_str()));
-            session->objmgr.Add(proto);
-            counter++;
-        } else
-            delete proto;
-    }
-
+        rec >> guid >> name;
     }
     catch (ByteBufferException bbe)
     {
-        logerror("ByteBuffer exception: attempt to \"%s\" %u bytes at position %u out of total %u bytes. (wpos=%u)",
-            bbe.action, bbe.readsize, bbe.rpos, bbe.cursize, bbe.wpos);
+        return;
     }
-
-    fh.close();
-    logdetail("ItemProtoCache: Loaded %u Item Prototypes",total);
+    ((PlayerNameCache*)param)->Add(guid, name, false);
 }
 
-void ItemProtoCache_WriteDataToCache(WorldSession *session)
+static bool _CompactPlayerNames(const char *basefn, const char *journalfn, const char *tmpfn)
 {
-	if (!session->objmgr.GetItemProtoCount())
-		return;
-
-    const char* fn = "./cache/ItemPrototypes.cache";
-    std::fstream fh;
-    fh.open(fn, std::ios_base::out | std::ios_base::binary);
-    if(!fh)
-    {
-        logerror("ItemProtoCache: Could not write to file '%s'!",fn);
-        return;
-    }
+    PlayerNameCache names;
+    names.ReadFromFile(basefn);
+    CacheJournal::ReplayFile(journalfn, _ReplayPlayerName, &names);
+    return names.GetSize() && names.SaveToFile(tmpfn);
+}
 
-    uint32 total = session->objmgr.GetItemProtoCount();
-	fh.write((char*)&ITEMPROTOTYPES_CACHE_VERSION,4);
-    fh.write((char*)&total,4);
+void PlayerNameCache_InsertDataToSession(WorldSession *session)
+{
+    PlayerNameCache& names = session->plrNameCache;
+    PlayerNameMap early = names.GetNames(); // the names from the character list are known before the cache is loaded
+    names.ReadFromFile(PLAYERNAMES_CACHE_FILE); // load names/guids of known players
+    PseuInstanceConf *conf = session->GetInstance()->GetConf();
+    CacheJournal *j = new CacheJournal(PLAYERNAMES_CACHE_FILE, _CompactPlayerNames, conf->cacheCompactAt, conf->sharedCache);
+    if(uint32 count = j->Replay(_ReplayPlayerName, &names))
+        logdetail("PlayerNameCache: %u names from journal",count);
+    names.SetJournal(j); // from now on, write every new name to the journal
+    for(PlayerNameMap::iterator it = early.begin(); it != early.end(); it++)
+        names.Add(it->first, it->second); // journaled if new or renamed
+    session->SetCacheJournal(CACHE_PLAYERNAMES, j);
+}
 
-    uint32 counter=0;
-    ByteBuffer buf;
-    for(ItemProtoMap::iterator it = session->objmgr.GetItemProtoStorage()->begin(); it != session->objmgr.GetItemProtoStorage()->end(); it++)
-    {
-        buf.clear();
-        ItemProto *proto = it->second;
+// serialize a record for the cache file. strings are interned by the writer.
+static void _WriteItemProto(ByteBuffer& buf, ItemProto *proto, CacheFileWriter& w)
+{
+    buf.clear();
         buf << proto->Id;
         buf << proto->Class;
         buf << proto->SubClass;
-        buf << proto->Name;
+        buf << w.AddString(proto->Name);
         buf << proto->DisplayInfoID;
         buf << proto->Quality;
         buf << proto->Flags;
@@ -333,7 +255,7 @@ void ItemProtoCache_WriteDataToCache(WorldSession *session)
         buf << proto->Stackable;
         buf << proto->ContainerSlots;
         buf << proto->StatsCount;
-        for(uint32 i = 0; i < proto->StatsCount; i++)
+        for(uint32 i = 0; i < MAX_ITEM_PROTO_STATS; i++)
         {
             buf << proto->ItemStat[i].ItemStatType;
             buf << proto->ItemStat[i].ItemStatValue;
@@ -367,7 +289,7 @@ void ItemProtoCache_WriteDataToCache(WorldSession *session)
             buf << proto->Spells[s].SpellCategoryCooldown;
         }
         buf << proto->Bonding;
-        buf << proto->Description;
+        buf << w.AddString(proto->Description);
         buf << proto->PageText;
         buf << proto->LanguageID;
         buf << proto->PageMaterial;
@@ -396,57 +318,150 @@ void ItemProtoCache_WriteDataToCache(WorldSession *session)
         buf << proto->Duration;
         buf << proto->ItemLimitCategory;
         buf << proto->HolidayId;
-
-        //DEBUG(logdebug("ItemProtoCache: Saved %u [%s]",proto->Id, proto->Name[0].c_str()));
-        uint32 size = buf.size();
-        fh.write((char*)&size,sizeof(uint32));
-        fh.write((char*)buf.contents(),buf.size());
-        counter++;
-    }
-    fh.flush();
-    fh.close();
-    log("ItemProtoCache: Saved %u Item Prototypes",counter);
 }
 
-void CreatureTemplateCache_InsertDataToSession(WorldSession *session)
+// deserialize one record
+static ItemProto *_ReadItemProto(ByteBuffer& buf, CacheStrings str, uint32 entry)
 {
-    logdetail("CreatureTemplateCache: Loading...");
-    const char* fn = "./cache/CreatureTemplates.cache";
-    std::fstream fh;
-    fh.open(fn, std::ios_base::in | std::ios_base::binary);
-    if(!fh)
-    {
-        logerror("CreatureTemplateCache: Could not open file '%s'!",fn);
-        return;
-    }
-
-    uint32 cacheversion, total, counter = 0;
-
+    ItemProto *proto = new ItemProto();
     try
     {
+        buf >> proto->Id;
+        buf >> proto->Class;
+        buf >> proto->SubClass;
+        proto->Name = str.Get(buf.read<uint32>());
+        buf >> proto->DisplayInfoID;
+        buf >> proto->Quality;
+        buf >> proto->Flags;
+        buf >> proto->Faction;
+        buf >> proto->BuyPrice;
+        buf >> proto->SellPrice;
+        buf >> proto->InventoryType;
+        buf >> proto->AllowableClass;
+        buf >> proto->AllowableRace;
+        buf >> proto->ItemLevel;
+        buf >> proto->RequiredLevel;
+        buf >> proto->RequiredSkill;
+        buf >> proto->RequiredSkillRank;
+        buf >> proto->RequiredSpell;
+        buf >> proto->RequiredHonorRank;
+        buf >> proto->RequiredCityRank;
+        buf >> proto->RequiredReputationFaction;
+        buf >> proto->RequiredReputationRank;
+        buf >> proto->MaxCount;
+        buf >> proto->Stackable;
+        buf >> proto->ContainerSlots;
+        buf >> proto->StatsCount;
+        for(uint32 i = 0; i < MAX_ITEM_PROTO_STATS; i++) // always all, so that every record has the same layout
+        {
+            buf >> proto->ItemStat[i].ItemStatType;
+            buf >> proto->ItemStat[i].ItemStatValue;
+        }
+        buf >> proto->ScalingStatDistribution;
+        buf >> proto->ScalingStatValue;
+        for(int i = 0; i < 5; i++)
+        {
+            buf >> proto->Damage[i].DamageMin;
+            buf >> proto->Damage[i].DamageMax;
+            buf >> proto->Damage[i].DamageType;
+        }
+        buf >> proto->Armor;
+        buf >> proto->HolyRes;
+        buf >> proto->FireRes;
+        buf >> proto->NatureRes;
+        buf >> proto->FrostRes;
+        buf >> proto->ShadowRes;
+        buf >> proto->ArcaneRes;
+        buf >> proto->Delay;
+        buf >> proto->Ammo_type;
 
-    fh.read((char*)&cacheversion,4);
-    if(cacheversion != CREATURETEMPLATES_CACHE_VERSION)
+        buf >> proto->RangedModRange;
+        for(int s = 0; s < 5; s++)
+        {
+            buf >> proto->Spells[s].SpellId;
+            buf >> proto->Spells[s].SpellTrigger;
+            buf >> proto->Spells[s].SpellCharges;
+            buf >> proto->Spells[s].SpellCooldown;
+            buf >> proto->Spells[s].SpellCategory;
+            buf >> proto->Spells[s].SpellCategoryCooldown;
+        }
+        buf >> proto->Bonding;
+        proto->Description = str.Get(buf.read<uint32>());
+        buf >> proto->PageText;
+        buf >> proto->LanguageID;
+        buf >> proto->PageMaterial;
+        buf >> proto->StartQuest;
+        buf >> proto->LockID;
+        buf >> proto->Material;
+        buf >> proto->Sheath;
+        buf >> proto->RandomProperty;
+        buf >> proto->RandomSuffix; // added in 2.0.3
+        buf >> proto->Block;
+        buf >> proto->ItemSet;
+        buf >> proto->MaxDurability;
+		buf >> proto->Area;
+        buf >> proto->Map;
+        buf >> proto->BagFamily;
+        buf >> proto->TotemCategory; // Added in 1.12.x client branch
+		for(uint32 s = 0; s < 3; s++)
+		{
+			buf >> proto->Socket[s].Color;
+			buf >> proto->Socket[s].Content;
+		}
+		buf >> proto->socketBonus;
+		buf >> proto->GemProperties;
+		buf >> proto->RequiredDisenchantSkill;
+		buf >> proto->ArmorDamageModifier;
+        buf >> proto->Duration;
+        buf >> proto->ItemLimitCategory;
+        buf >> proto->HolidayId;
+    }
+    catch (ByteBufferException bbe)
     {
-        logerror("CreatureTemplateCache is outdated! Creating new cache.");
-        fh.close();
-        return;
+        logerror("ItemProtoCache: record %u corrupt, attempt to \"%s\" %u bytes at position %u out of total %u bytes.",
+            entry, bbe.action, bbe.readsize, bbe.rpos, bbe.cursize);
+        delete proto;
+        return NULL;
+    }
+    if(proto->Id != entry)
+    {
+        delete proto;
+        return NULL;
     }
-    fh.read((char*)&total,4);
-    logdetail("CreatureTemplateCache: %u creature templates stored",total);
+    return proto;
+}
 
-    uint32 datasize;
-    ByteBuffer buf;
-    for(uint32 i = 0; i < total && !fh.eof(); i++)
+static void _WriteCreatureTemplate(ByteBuffer& buf, CreatureTemplate *ct, CacheFileWriter& w)
+{
+    buf.clear();
+        buf << ct->entry;
+        buf << w.AddString(ct->name);
+        buf << w.AddString(ct->subname);
+        buf << ct->flag1;
+        buf << ct->type;
+        buf << ct->family;
+        buf << ct->rank;
+        //buf << ct->SpellDataId;
+        for(uint32 i = 0; i < MAX_KILL_CREDIT; i++)
+            buf << ct->killCredit[i];
+        buf << ct->displayid_A;
+        buf << ct->displayid_H;
+        buf << ct->displayid_AF;
+        buf << ct->displayid_HF;
+        buf << ct->RacialLeader;
+        for(uint32 i = 0; i < 4; i++)
+            buf << ct->questItems[i];
+        buf << ct->movementId;
+}
+
+static CreatureTemplate *_ReadCreatureTemplate(ByteBuffer& buf, CacheStrings str, uint32 entry)
+{
+    CreatureTemplate *ct = new CreatureTemplate();
+    try
     {
-        buf.clear();
-        fh.read((char*)&datasize,sizeof(uint32));
-        buf.resize(datasize);
-        fh.read((char*)buf.contents(),datasize);
-        CreatureTemplate *ct = new CreatureTemplate();
         buf >> ct->entry;
-        buf >> ct->name;
-        buf >> ct->subname;
+        ct->name = str.Get(buf.read<uint32>());
+        ct->subname = str.Get(buf.read<uint32>());
         buf >> ct->flag1;
         buf >> ct->type;
         buf >> ct->family;
@@ -462,191 +477,398 @@ void CreatureTemplateCache_InsertDataToSession(WorldSession *session)
         for(uint32 i = 0; i < 4; i++)
             buf >> ct->questItems[i];
         buf >> ct->movementId;
-
-        if(ct->entry)
-        {
-            session->objmgr.Add(ct);
-            counter++;
-        } else
-            delete ct;
     }
+    catch (ByteBufferException bbe)
+    {
+        logerror("CreatureTemplateCache: record %u corrupt, attempt to \"%s\" %u bytes at position %u out of total %u bytes.",
+            entry, bbe.action, bbe.readsize, bbe.rpos, bbe.cursize);
+        delete ct;
+        return NULL;
+    }
+    if(ct->entry != entry)
+    {
+        delete ct;
+        return NULL;
+    }
+    return ct;
+}
 
+static void _WriteGOTemplate(ByteBuffer& buf, GameobjectTemplate *go, CacheFileWriter& w)
+{
+    buf.clear();
+        buf << go->entry;
+        buf << go->type;
+        buf << go->displayId;
+        buf << w.AddString(go->name);
+        buf << w.AddString(go->castBarCaption);
+        buf << w.AddString(go->unk1);
+        buf << go->faction;
+        buf << go->flags;
+        buf << go->size;
+        for(uint32 i = 0; i < GAMEOBJECT_DATA_FIELDS; i++)
+            buf << go->raw.data[i];
+        buf << go->size;
+        for(uint32 i = 0; i < 4; i++)
+            buf << go->questItems[i];
+}
+
+static GameobjectTemplate *_ReadGOTemplate(ByteBuffer& buf, CacheStrings str, uint32 entry)
+{
+    GameobjectTemplate *go = new GameobjectTemplate();
+    try
+    {
+        buf >> go->entry;
+        buf >> go->type;
+        buf >> go->displayId;
+        go->name = str.Get(buf.read<uint32>());
+        go->castBarCaption = str.Get(buf.read<uint32>());
+        go->unk1 = str.Get(buf.read<uint32>());
+        buf >> go->faction;
+        buf >> go->flags;
+        buf >> go->size;
+        for(uint32 i = 0; i < GAMEOBJECT_DATA_FIELDS; i++)
+            buf >> go->raw.data[i];
+        buf >> go->size;
+        for(uint32 i = 0; i < 4; i++)
+            buf >> go->questItems[i];
     }
     catch (ByteBufferException bbe)
     {
-        logerror("ByteBuffer exception: attempt to \"%s\" %u bytes at position %u out of total %u bytes. (wpos=%u)",
-            bbe.action, bbe.readsize, bbe.rpos, bbe.cursize, bbe.wpos);
+        logerror("GOTemplateCache: record %u corrupt, attempt to \"%s\" %u bytes at position %u out of total %u bytes.",
+            entry, bbe.action, bbe.readsize, bbe.rpos, bbe.cursize);
+        delete go;
+        return NULL;
     }
+    if(go->entry != entry)
+    {
+        delete go;
+        return NULL;
+    }
+    return go;
+}
 
-    fh.close();
-    logdetail("CreatureTemplateCache: Loaded %u Creature Templates",counter);
+// -- things all template caches have in common --
+
+template <class T> struct TemplateCacheInfo
+{
+    const char *name; // for log output
+    const char *fn;
+    uint32 version;
+    T *(*read)(ByteBuffer& buf, CacheStrings str, uint32 entry);
+    void (*write)(ByteBuffer& buf, T *t, CacheFileWriter& w);
+    T *(ObjMgr::*get)(uint32 entry);
+    CacheFile& (ObjMgr::*file)(void);
+};
+
+static TemplateCacheInfo<ItemProto> itemProtoInfo =
+    { "ItemProtoCache", ITEMPROTOTYPES_CACHE_FILE, ITEMPROTOTYPES_CACHE_VERSION, _ReadItemProto, _WriteItemProto,
+      &ObjMgr::GetItemProto, &ObjMgr::GetItemProtoCacheFile };
+static TemplateCacheInfo<CreatureTemplate> creatureTemplateInfo =
+    { "CreatureTemplateCache", CREATURETEMPLATES_CACHE_FILE, CREATURETEMPLATES_CACHE_VERSION, _ReadCreatureTemplate, _WriteCreatureTemplate,
+      &ObjMgr::GetCreatureTemplate, &ObjMgr::GetCreatureTemplateCacheFile };
+static TemplateCacheInfo<GameobjectTemplate> goTemplateInfo =
+    { "GOTemplateCache", GOTEMPLATES_CACHE_FILE, GOTEMPLATES_CACHE_VERSION, _ReadGOTemplate, _WriteGOTemplate,
+      &ObjMgr::GetGOTemplate, &ObjMgr::GetGOTemplateCacheFile };
+
+// a journal record is self-contained: [entry][record size][record][string table of this record]
+template <class T> static void _JournalTemplate(CacheJournal *j, TemplateCacheInfo<T>& info, uint32 entry, T *t)
+{
+    CacheFileWriter w;
+    ByteBuffer rec, jr;
+    info.write(rec, t, w);
+    jr << entry << (uint32)rec.size();
+    jr.append(rec);
+    jr.append(w.GetStringTable());
+    j->Append(jr);
 }
 
-void CreatureTemplateCache_WriteDataToCache(WorldSession *session)
+template <class T> struct TemplateReplay
 {
-    if (!session->objmgr.GetCreatureTemplateCount())
+    TemplateCacheInfo<T> *info;
+    std::map<uint32,T*> *result;
+};
+
+template <class T> static void _ReplayTemplate(ByteBuffer& jr, void *param)
+{
+    TemplateReplay<T> *r = (TemplateReplay<T>*)param;
+    if(jr.size() < 2 * sizeof(uint32))
+        return;
+    uint32 entry, recsize;
+    jr >> entry >> recsize;
+    if(recsize > jr.size() - jr.rpos())
         return;
+    ByteBuffer rec;
+    rec.append(jr.contents() + jr.rpos(), recsize);
+    CacheStrings str((const char*)jr.contents() + jr.rpos() + recsize, jr.size() - jr.rpos() - recsize);
+    if(str.size && str.data[str.size - 1] != '\0') // CacheStrings relies on the terminator
+        return;
+    T *t = r->info->read(rec, str, entry);
+    if(!t)
+        return;
+    typename std::map<uint32,T*>::iterator it = r->result->find(entry);
+    if(it != r->result->end()) // the later record wins
+        delete it->second;
+    (*r->result)[entry] = t;
+}
 
-    const char* fn = "./cache/CreatureTemplates.cache";
-    std::fstream fh;
-    fh.open(fn, std::ios_base::out | std::ios_base::binary);
-    if(!fh)
+template <class T> struct TemplateReceive
+{
+    TemplateCacheInfo<T> *info;
+    ObjMgr *objmgr;
+};
+
+// a record another process added to the journal. it may be one we know already (or our own)
+template <class T> static void _ReceiveTemplate(ByteBuffer& jr, void *param)
+{
+    TemplateReceive<T> *r = (TemplateReceive<T>*)param;
+    std::map<uint32,T*> rec;
+    TemplateReplay<T> rp = { r->info, &rec };
+    _ReplayTemplate<T>(jr, &rp);
+    for(typename std::map<uint32,T*>::iterator it = rec.begin(); it != rec.end(); it++)
     {
-        logerror("CreatureTemplateCache: Could not write to file '%s'!",fn);
-        return;
+        // don't deserialize records from the cache file just to find out they are known
+        if((r->objmgr->*(r->info->file))().Has(it->first) || (r->objmgr->*(r->info->get))(it->first))
+            delete it->second;
+        else
+            r->objmgr->Add(it->second);
     }
-    uint32 total = session->objmgr.GetCreatureTemplateCount();
-    fh.write((char*)&CREATURETEMPLATES_CACHE_VERSION,4);
-    fh.write((char*)&total,4);
-    uint32 counter=0;
+}
+
+template <class T> static void _ReceiveTemplates(WorldSession *session, TemplateCacheInfo<T>& info, uint32 journaltype)
+{
+    TemplateReceive<T> r = { &info, &session->objmgr };
+    if(CacheJournal *j = session->GetCacheJournal(journaltype))
+        if(uint32 count = j->Receive(&_ReceiveTemplate<T>, &r))
+            logdebug("%s: %u records from other processes",info.name,count);
+}
+
+// runs in the journal thread. the base file is mapped a second time here, read-only, so the
+// main thread can go on using its own mapping.
+template <class T> static bool _CompactTemplateCache(TemplateCacheInfo<T>& info, const char *basefn, const char *journalfn, const char *tmpfn)
+{
+    std::map<uint32,T*> newer;
+    TemplateReplay<T> r = { &info, &newer };
+    CacheJournal::ReplayFile(journalfn, &_ReplayTemplate<T>, &r);
+
+    CacheFile base;
+    base.Open(basefn, info.version); // there may be no base file yet
+    CacheFileWriter w;
     ByteBuffer buf;
-    for(CreatureTemplateMap::iterator it = session->objmgr.GetCreatureTemplateStorage()->begin(); it != session->objmgr.GetCreatureTemplateStorage()->end(); it++)
+    for(uint32 i = 0; i < base.GetCount(); i++)
     {
-        buf.clear();
-        CreatureTemplate *ct = it->second;
-        buf << ct->entry;
-        buf << ct->name;
-        buf << ct->subname;
-        buf << ct->flag1;
-        buf << ct->type;
-        buf << ct->family;
-        buf << ct->rank;
-        //buf << ct->SpellDataId;
-        for(uint32 i = 0; i < MAX_KILL_CREDIT; i++)
-            buf << ct->killCredit[i];
-        buf << ct->displayid_A;
-        buf << ct->displayid_H;
-        buf << ct->displayid_AF;
-        buf << ct->displayid_HF;
-        buf << ct->RacialLeader;
-        for(uint32 i = 0; i < 4; i++)
-            buf << ct->questItems[i];
-        buf << ct->movementId;
+        uint32 entry = base.GetEntry(i);
+        if(newer.find(entry) != newer.end() || !base.Read(entry, buf))
+            continue;
+        T *t = info.read(buf, base.GetStrings(), entry);
+        if(t)
+        {
+            info.write(buf, t, w);
+            w.AddRecord(entry, buf);
+            delete t;
+        }
+    }
+    for(typename std::map<uint32,T*>::iterator it = newer.begin(); it != newer.end(); it++)
+    {
+        info.write(buf, it->second, w);
+        w.AddRecord(it->first, buf);
+        delete it->second;
+    }
+    base.Close();
 
-        uint32 size = buf.size();
-        fh.write((char*)&size,sizeof(uint32));
-        fh.write((char*)buf.contents(),buf.size());
-        counter++;
+    if(!w.Write(tmpfn, info.version))
+    {
+        logerror("%s: Could not write to file '%s'!",info.name,tmpfn);
+        return false;
     }
-    fh.flush();
-    fh.close();
-    log("CreatureTemplateCache: Saved %u Creature Templates",counter);
+    logdetail("%s: Merged %u new records, %u total",info.name,(uint32)newer.size(),w.GetCount());
+    return true;
+}
+
+template <class T> static void _LoadTemplateCache(WorldSession *session, TemplateCacheInfo<T>& info, CacheFile& cf,
+                                                  CacheCompactFunc compact, uint32 journaltype)
+{
+    logdetail("%s: Loading...",info.name);
+    if(cf.Open(info.fn, info.version))
+        logdetail("%s: %u records stored",info.name,cf.GetCount()); // deserialized on demand, see ObjMgr
+    else
+        logerror("%s: Could not open file '%s'! Creating new cache.",info.name,info.fn);
+
+    // records that were not merged into the base file yet
+    PseuInstanceConf *conf = session->GetInstance()->GetConf();
+    CacheJournal *j = new CacheJournal(info.fn, compact, conf->cacheCompactAt, conf->sharedCache);
+    std::map<uint32,T*> newer;
+    TemplateReplay<T> r = { &info, &newer };
+    j->Replay(&_ReplayTemplate<T>, &r);
+    for(typename std::map<uint32,T*>::iterator it = newer.begin(); it != newer.end(); it++)
+        session->objmgr.Add(it->second);
+    if(newer.size())
+        logdetail("%s: %u records from journal",info.name,(uint32)newer.size());
+    session->SetCacheJournal(journaltype, j);
+}
+
+static bool _CompactItemProtos(const char *basefn, const char *journalfn, const char *tmpfn)
+{
+    return _CompactTemplateCache(itemProtoInfo, basefn, journalfn, tmpfn);
+}
+
+static bool _CompactCreatureTemplates(const char *basefn, const char *journalfn, const char *tmpfn)
+{
+    return _CompactTemplateCache(creatureTemplateInfo, basefn, journalfn, tmpfn);
+}
+
+static bool _CompactGOTemplates(const char *basefn, const char *journalfn, const char *tmpfn)
+{
+    return _CompactTemplateCache(goTemplateInfo, basefn, journalfn, tmpfn);
+}
+
+// deserialize one record from the cache file, on first access
+ItemProto *ItemProtoCache_Load(CacheFile& cf, uint32 entry)
+{
+    ByteBuffer buf;
+    return cf.Read(entry, buf) ? _ReadItemProto(buf, cf.GetStrings(), entry) : NULL;
+}
+
+void ItemProtoCache_InsertDataToSession(WorldSession *session)
+{
+    _LoadTemplateCache(session, itemProtoInfo, session->objmgr.GetItemProtoCacheFile(), _CompactItemProtos, CACHE_ITEMPROTOS);
+}
+
+void ItemProtoCache_AddToJournal(WorldSession *session, ItemProto *proto)
+{
+    if(CacheJournal *j = session->GetCacheJournal(CACHE_ITEMPROTOS))
+        _JournalTemplate(j, itemProtoInfo, proto->Id, proto);
+}
+
+CreatureTemplate *CreatureTemplateCache_Load(CacheFile& cf, uint32 entry)
+{
+    ByteBuffer buf;
+    return cf.Read(entry, buf) ? _ReadCreatureTemplate(buf, cf.GetStrings(), entry) : NULL;
+}
+
+void CreatureTemplateCache_InsertDataToSession(WorldSession *session)
+{
+    _LoadTemplateCache(session, creatureTemplateInfo, session->objmgr.GetCreatureTemplateCacheFile(), _CompactCreatureTemplates, CACHE_CREATURETEMPLATES);
+}
+
+void CreatureTemplateCache_AddToJournal(WorldSession *session, CreatureTemplate *ct)
+{
+    if(CacheJournal *j = session->GetCacheJournal(CACHE_CREATURETEMPLATES))
+        _JournalTemplate(j, creatureTemplateInfo, ct->entry, ct);
+}
+
+GameobjectTemplate *GOTemplateCache_Load(CacheFile& cf, uint32 entry)
+{
+    ByteBuffer buf;
+    return cf.Read(entry, buf) ? _ReadGOTemplate(buf, cf.GetStrings(), entry) : NULL;
 }
 
 void GOTemplateCache_InsertDataToSession(WorldSession *session)
 {
-    logdetail("GOTemplateCache: Loading...");
-    const char* fn = "./cache/GOTemplates.cache";
-    std::fstream fh;
-    fh.open(fn, std::ios_base::in | std::ios_base::binary);
-    if(!fh)
-    {
-        logerror("GOTemplateCache: Could not open file '%s'!",fn);
-        return;
-    }
+    _LoadTemplateCache(session, goTemplateInfo, session->objmgr.GetGOTemplateCacheFile(), _CompactGOTemplates, CACHE_GOTEMPLATES);
+}
 
-    uint32 cacheversion, total, counter = 0;
+void GOTemplateCache_AddToJournal(WorldSession *session, GameobjectTemplate *go)
+{
+    if(CacheJournal *j = session->GetCacheJournal(CACHE_GOTEMPLATES))
+        _JournalTemplate(j, goTemplateInfo, go->entry, go);
+}
 
-    try
-    {
+// -- nonexistent entries --
+// the base file has the same layout as the journal: [uint32 size][uint8 typeid][uint32 entry][uint32 time] ...
 
-        fh.read((char*)&cacheversion,4);
-        if(cacheversion != GOTEMPLATES_CACHE_VERSION)
-        {
-            logerror("GOTemplateCache is outdated! Creating new cache.");
-            fh.close();
-            return;
-        }
-        fh.read((char*)&total,4);
-        logdetail("GOTemplateCache: %u gameobject templates stored",total);
+static uint32 nonexistentExpiry; // for the journal thread
 
-        uint32 datasize;
-        ByteBuffer buf;
-        for(uint32 i = 0; i < total && !fh.eof(); i++)
-        {
-            buf.clear();
-            fh.read((char*)&datasize,sizeof(uint32));
-            buf.resize(datasize);
-            fh.read((char*)buf.contents(),datasize);
-            GameobjectTemplate *go = new GameobjectTemplate();
-            buf >> go->entry;
-            buf >> go->type;
-            buf >> go->displayId;
-            buf >> go->name;
-            buf >> go->castBarCaption;
-            buf >> go->unk1;
-            buf >> go->faction;
-            buf >> go->flags;
-            buf >> go->size;
-            for(uint32 i = 0; i < GAMEOBJECT_DATA_FIELDS; i++)
-                buf >> go->raw.data[i];
-            buf >> go->size;
-            for(uint32 i = 0; i < 4; i++)
-                buf >> go->questItems[i];
-
-            if(go->entry)
-            {
-                session->objmgr.Add(go);
-                counter++;
-            } else
-                delete go;
-        }
+struct NonexistentEntry
+{
+    uint8 typeId;
+    uint32 entry;
+    uint32 time;
+};
 
+static bool _ReadNonexistent(ByteBuffer& rec, NonexistentEntry& ne)
+{
+    try
+    {
+        rec >> ne.typeId >> ne.entry >> ne.time;
     }
     catch (ByteBufferException bbe)
     {
-        logerror("ByteBuffer exception: attempt to \"%s\" %u bytes at position %u out of total %u bytes. (wpos=%u)",
-            bbe.action, bbe.readsize, bbe.rpos, bbe.cursize, bbe.wpos);
+        return false;
     }
-
-    fh.close();
-    logdetail("GOTemplateCache: Loaded %u Gameobject Templates",counter);
+    return !nonexistentExpiry || (uint32)time(NULL) - ne.time < nonexistentExpiry;
 }
 
-void GOTemplateCache_WriteDataToCache(WorldSession *session)
+static void _ReplayNonexistent(ByteBuffer& rec, void *param)
 {
-    if (!session->objmgr.GetGOTemplateCount())
+    NonexistentEntry ne;
+    if(!_ReadNonexistent(rec, ne))
         return;
+    ObjMgr& objmgr = ((WorldSession*)param)->objmgr;
+    switch(ne.typeId)
+    {
+        case TYPEID_ITEM:       objmgr.AddNonexistentItem(ne.entry, ne.time); break;
+        case TYPEID_UNIT:       objmgr.AddNonexistentCreature(ne.entry, ne.time); break;
+        case TYPEID_GAMEOBJECT: objmgr.AddNonexistentGO(ne.entry, ne.time); break;
+    }
+}
 
-    const char* fn = "./cache/GOTemplates.cache";
-    std::fstream fh;
-    fh.open(fn, std::ios_base::out | std::ios_base::binary);
+static void _CollectNonexistent(ByteBuffer& rec, void *param)
+{
+    NonexistentEntry ne;
+    if(_ReadNonexistent(rec, ne))
+        (*(std::map<uint64,uint32>*)param)[(uint64(ne.typeId) << 32) | ne.entry] = ne.time;
+}
+
+// expired entries are dropped here
+static bool _CompactNonexistent(const char *basefn, const char *journalfn, const char *tmpfn)
+{
+    std::map<uint64,uint32> entries;
+    CacheJournal::ReplayFile(basefn, _CollectNonexistent, &entries);
+    CacheJournal::ReplayFile(journalfn, _CollectNonexistent, &entries);
+
+    ByteBuffer out;
+    for(std::map<uint64,uint32>::iterator it = entries.begin(); it != entries.end(); it++)
+        out << uint32(sizeof(uint8) + 2 * sizeof(uint32)) << uint8(it->first >> 32) << uint32(it->first) << it->second;
+    FILE *fh = fopen(tmpfn, "wb");
     if(!fh)
     {
-        logerror("GOTemplateCache: Could not write to file '%s'!",fn);
-        return;
+        logerror("NonexistentCache: Could not write to file '%s'!",tmpfn);
+        return false;
     }
-    uint32 total = session->objmgr.GetGOTemplateCount();
-    fh.write((char*)&GOTEMPLATES_CACHE_VERSION,4);
-    fh.write((char*)&total,4);
-    uint32 counter=0;
-    ByteBuffer buf;
-    for(GOTemplateMap::iterator it = session->objmgr.GetGOTemplateStorage()->begin(); it != session->objmgr.GetGOTemplateStorage()->end(); it++)
-    {
-        buf.clear();
-        GameobjectTemplate *go = it->second;
-        buf << go->entry;
-        buf << go->type;
-        buf << go->displayId;
-        buf << go->name;
-        buf << go->castBarCaption;
-        buf << go->unk1;
-        buf << go->faction;
-        buf << go->flags;
-        buf << go->size;
-        for(uint32 i = 0; i < GAMEOBJECT_DATA_FIELDS; i++)
-            buf << go->raw.data[i];
-        buf << go->size;
-        for(uint32 i = 0; i < 4; i++)
-            buf << go->questItems[i];
+    bool ok = !out.size() || fwrite(out.contents(), out.size(), 1, fh) == 1;
+    fclose(fh);
+    return ok;
+}
 
-        uint32 size = buf.size();
-        fh.write((char*)&size,sizeof(uint32));
-        fh.write((char*)buf.contents(),buf.size());
-        counter++;
+void NonexistentCache_InsertDataToSession(WorldSession *session)
+{
+    PseuInstanceConf *conf = session->GetInstance()->GetConf();
+    nonexistentExpiry = conf->nonexistentExpiry;
+    uint32 count = CacheJournal::ReplayFile(NONEXISTENT_CACHE_FILE, _ReplayNonexistent, session);
+    CacheJournal *j = new CacheJournal(NONEXISTENT_CACHE_FILE, _CompactNonexistent, conf->cacheCompactAt, conf->sharedCache);
+    count += j->Replay(_ReplayNonexistent, session);
+    logdetail("NonexistentCache: %u entries",count);
+    session->SetCacheJournal(CACHE_NONEXISTENT, j);
+}
+
+void NonexistentCache_AddToJournal(WorldSession *session, uint8 typeId, uint32 entry)
+{
+    if(CacheJournal *j = session->GetCacheJournal(CACHE_NONEXISTENT))
+    {
+        ByteBuffer rec;
+        rec << typeId << entry << (uint32)time(NULL);
+        j->Append(rec);
     }
-    fh.flush();
-    fh.close();
-    log("GOTemplateCache: Saved %u Gameobject Templates",counter);
 }
 
+// take over what other processes using the same cache files learned meanwhile (SharedCache=1)
+void SharedCache_Receive(WorldSession *session)
+{
+    if(CacheJournal *j = session->GetCacheJournal(CACHE_PLAYERNAMES))
+        j->Receive(_ReplayPlayerName, &session->plrNameCache);
+    _ReceiveTemplates(session, itemProtoInfo, CACHE_ITEMPROTOS);
+    _ReceiveTemplates(session, creatureTemplateInfo, CACHE_CREATURETEMPLATES);
+    _ReceiveTemplates(session, goTemplateInfo, CACHE_GOTEMPLATES);
+    if(CacheJournal *j = session->GetCacheJournal(CACHE_NONEXISTENT))
+        j->Receive(_ReplayNonexistent, session);
+}
@@ -1,31 +1,72 @@
 #ifndef _CACHEHANDLER_H
 #define _CACHEHANDLER_H
 
+#include "UnorderedMap.h"
+
 typedef std::map<uint64,std::string> PlayerNameMap; 
+typedef UNORDERED_MAP<std::string,uint64> PlayerNameIndex; // lowercased name -> guid
+
+class CacheFile;
+class CacheJournal;
+
+// the caches that keep a journal of new entries, see CacheJournal.h
+enum CacheJournalType
+{
+    CACHE_PLAYERNAMES,
+    CACHE_ITEMPROTOS,
+    CACHE_CREATURETEMPLATES,
+    CACHE_GOTEMPLATES,
+    CACHE_NONEXISTENT,
+    CACHE_JOURNAL_COUNT
+};
 
 class PlayerNameCache
 {
 public:
+    PlayerNameCache();
 	~PlayerNameCache();
 
     std::string GetName(uint64);
     bool IsKnown(uint64);
-    uint64 GetGuid(std::string);
-    void Add(uint64 guid, std::string name);
-    bool SaveToFile(void);
-    bool ReadFromFile(void);
+    uint64 GetGuid(std::string); // case insensitive
+    void GetGuids(std::vector<std::string>& names, std::vector<uint64>& guids); // guids[i] = 0 if names[i] is unknown
+    void Add(uint64 guid, std::string name, bool journal = true); // journal=false: known from another process, don't write it again
+    void Add(PlayerNameMap& names);
+    bool SaveToFile(const char *fn = "./cache/playernames.cache");
+    bool ReadFromFile(const char *fn = "./cache/playernames.cache");
     uint32 GetSize(void);
+    inline const PlayerNameMap& GetNames(void) { return _cache; }
+    inline void SetJournal(CacheJournal *j) { _journal = j; } // every name added from now on goes to the journal
 private:
     PlayerNameMap _cache;
+    PlayerNameIndex _index;
+    CacheJournal *_journal;
 };
 
+// loads the name cache and the names not yet merged from its journal
+void PlayerNameCache_InsertDataToSession(WorldSession *session);
+
+// the template caches are memory mapped; *_InsertDataToSession() only opens the file and replays the journal,
+// *_Load() deserializes a single record when the ObjMgr needs it.
+// *_AddToJournal() must be called for every template received from the server, it is written in the background
 void ItemProtoCache_InsertDataToSession(WorldSession *session);
-void ItemProtoCache_WriteDataToCache(WorldSession *session);
+ItemProto *ItemProtoCache_Load(CacheFile& cf, uint32 entry);
+void ItemProtoCache_AddToJournal(WorldSession *session, ItemProto *proto);
 
 void CreatureTemplateCache_InsertDataToSession(WorldSession *session);
-void CreatureTemplateCache_WriteDataToCache(WorldSession *session);
+CreatureTemplate *CreatureTemplateCache_Load(CacheFile& cf, uint32 entry);
+void CreatureTemplateCache_AddToJournal(WorldSession *session, CreatureTemplate *ct);
 
 void GOTemplateCache_InsertDataToSession(WorldSession *session);
-void GOTemplateCache_WriteDataToCache(WorldSession *session);
+GameobjectTemplate *GOTemplateCache_Load(CacheFile& cf, uint32 entry);
+void GOTemplateCache_AddToJournal(WorldSession *session, GameobjectTemplate *go);
+
+// items, creatures and gameobjects the server said do not exist, so they are not queried again after a restart.
+// typeId is TYPEID_ITEM, TYPEID_UNIT or TYPEID_GAMEOBJECT
+void NonexistentCache_InsertDataToSession(WorldSession *session);
+void NonexistentCache_AddToJournal(WorldSession *session, uint8 typeId, uint32 entry);
+
+// several processes can share the cache files. this hands over the entries the others added
+void SharedCache_Receive(WorldSession *session);
 
 #endif
@@ -0,0 +1,343 @@
+#include "common.h"
+#include "CacheFile.h"
+#include "CacheJournal.h"
+
+CacheJournal::CacheJournal(std::string basefn, CacheCompactFunc func, uint32 compactAt, bool shared)
+{
+    _basefn = basefn;
+    _journalfn = basefn + ".journal";
+    _oldjournalfn = basefn + ".journal.old"; // the journal that is being merged
+    _tmpfn = basefn + ".tmp";
+    _compactfunc = func;
+    _compactat = compactAt;
+    _records = 0;
+    _fh = NULL;
+    _compactreq = false;
+    _compactdone = false;
+    _shared = shared;
+    _tailfh = NULL;
+    _tailpos = 0;
+    _basechanged = false;
+    memset(&_fhid, 0, sizeof(FileId));
+    memset(&_tailid, 0, sizeof(FileId));
+    memset(&_baseid, 0, sizeof(FileId));
+    GetFileId(_basefn.c_str(), _baseid); // the file the caller just opened, if any
+    if(_shared) // the locks are not needed if we are the only one using the files
+    {
+        _lock.Open((basefn + ".lock").c_str());
+        _mergelock.Open((basefn + ".merge.lock").c_str());
+    }
+}
+
+CacheJournal::~CacheJournal()
+{
+    while(_queue.size())
+        delete _queue.next();
+    while(_incoming.size())
+        delete _incoming.next();
+    if(_fh)
+        fclose(_fh);
+    if(_tailfh)
+        fclose(_tailfh);
+}
+
+void CacheJournal::Append(ByteBuffer& rec)
+{
+    if(rec.size() > CACHEJOURNAL_MAX_RECORD)
+    {
+        logerror("CacheJournal: Record for '%s' too big (%u bytes), not written",_basefn.c_str(),(uint32)rec.size());
+        return;
+    }
+    _queue.add(new ByteBuffer(rec));
+}
+
+uint32 CacheJournal::ReplayFile(const char *fn, CacheReplayFunc func, void *param, uint32 *endpos, bool repair)
+{
+    if(endpos)
+        *endpos = 0;
+    FILE *fh = fopen(fn, "rb");
+    if(!fh)
+        return 0;
+    fseek(fh, 0, SEEK_END);
+    uint32 filesize = ftell(fh);
+    fseek(fh, 0, SEEK_SET);
+    uint32 size, count = 0, pos = 0;
+    bool bad = false;
+    ByteBuffer rec;
+    while(pos < filesize)
+    {
+        // the size is not trusted, a torn write or a broken file must not make us allocate gigabytes
+        if(filesize - pos < sizeof(uint32) || fread(&size, sizeof(uint32), 1, fh) != 1
+            || size > CACHEJOURNAL_MAX_RECORD || size > filesize - pos - sizeof(uint32))
+        {
+            bad = true;
+            break;
+        }
+        rec.clear();
+        rec.resize(size);
+        if(size && fread((void*)rec.contents(), size, 1, fh) != 1)
+        {
+            bad = true;
+            break;
+        }
+        (*func)(rec, param);
+        count++;
+        pos += sizeof(uint32) + size;
+    }
+    fclose(fh);
+    if(bad)
+    {
+        if(repair && TruncateFile(fn, pos))
+            logerror("CacheJournal: '%s' ends with a broken record, cut back to %u bytes",fn,pos);
+        else
+            logerror("CacheJournal: '%s' ends with a broken record, ignored",fn);
+    }
+    if(endpos)
+        *endpos = pos;
+    return count;
+}
+
+// a leftover old journal means a compaction was not finished, so its records are newer than the base file
+uint32 CacheJournal::Replay(CacheReplayFunc func, void *param)
+{
+    uint32 endpos;
+    _lock.Lock(true); // nobody may be appending while a broken end is cut off
+    _records = ReplayFile(_oldjournalfn.c_str(), func, param, NULL, true) + ReplayFile(_journalfn.c_str(), func, param, &endpos, true);
+    _lock.Unlock();
+    if(_shared) // watch the journal for new records from here on
+    {
+        GetFileId(_journalfn.c_str(), _tailid);
+        _tailpos = endpos;
+    }
+    return _records;
+}
+
+void CacheJournal::Process(void)
+{
+    if(_queue.size())
+        _Write();
+
+    if(_shared)
+        _Tail();
+
+    // wait until the main thread took the result of the last compaction
+    if(!_compactdone && (_compactreq || (_compactat && _records >= _compactat)))
+        _Compact();
+}
+
+void CacheJournal::_Write(void)
+{
+    ByteBuffer out;
+    uint32 count = 0;
+    while(_queue.size())
+    {
+        ByteBuffer *rec = _queue.next();
+        out << (uint32)rec->size();
+        if(rec->size())
+            out.append(rec->contents(), rec->size());
+        delete rec;
+        count++;
+    }
+
+    _lock.Lock(false); // the journal must not be moved aside while writing
+
+    // another process may have moved the journal aside to merge it, continue with a new one then
+    FileId id;
+    if(_fh && (!GetFileId(_journalfn.c_str(), id) || id != _fhid))
+    {
+        fclose(_fh);
+        _fh = NULL;
+    }
+    if(!_fh && (_fh = fopen(_journalfn.c_str(), "ab")))
+    {
+        setvbuf(_fh, NULL, _IONBF, 0); // one write per batch, so the records of several processes do not mix
+        GetFileId(_fh, _fhid);
+    }
+
+    if(_fh && fwrite(out.contents(), out.size(), 1, _fh) == 1)
+    {
+        _records += count;
+        // nobody else wrote since the journal was read last, no need to read our own records back
+        uint32 end = ftell(_fh);
+        if(_tailfh && _tailid == _fhid && _tailpos + out.size() == end)
+            _tailpos = end;
+    }
+    else
+        logerror("CacheJournal: Can't write to '%s'",_journalfn.c_str());
+
+    _lock.Unlock();
+}
+
+// read the records other processes appended to the journal
+void CacheJournal::_Tail(void)
+{
+    FileId id;
+    if(GetFileId(_basefn.c_str(), id) && id != _baseid) // merged by another process (or by us)
+    {
+        _baseid = id;
+        _basechanged = true;
+    }
+
+    _lock.Lock(false); // holds off moving the journal aside, so nothing written before that can be missed
+    if(!_tailfh && (_tailfh = fopen(_journalfn.c_str(), "rb")))
+    {
+        GetFileId(_tailfh, id);
+        if(id != _tailid) // not the file we read last time
+            _tailpos = 0;
+        _tailid = id;
+    }
+    if(_tailfh)
+    {
+        uint32 size, filesize = 0;
+        if(!fseek(_tailfh, 0, SEEK_END))
+            filesize = ftell(_tailfh);
+        while(_tailpos < filesize && !fseek(_tailfh, _tailpos, SEEK_SET) && fread(&size, sizeof(uint32), 1, _tailfh) == 1)
+        {
+            if(size > CACHEJOURNAL_MAX_RECORD)
+            {
+                // garbage, there is no way to find the next record. skip the rest of this journal,
+                // reading continues with the next one once it was merged
+                logerror("CacheJournal: '%s' has a broken record at %u, ignoring the rest",_journalfn.c_str(),_tailpos);
+                _tailpos = 0xFFFFFFFF;
+                break;
+            }
+            if(size > filesize - _tailpos - sizeof(uint32))
+                break; // not completely written yet
+            ByteBuffer *rec = new ByteBuffer();
+            rec->resize(size);
+            if(size && fread((void*)rec->contents(), size, 1, _tailfh) != 1)
+            {
+                delete rec;
+                break;
+            }
+            _tailpos += sizeof(uint32) + size;
+            _incoming.add(rec);
+        }
+        clearerr(_tailfh);
+
+        // the journal was moved aside and everything in it was read, continue with the new one
+        if(!GetFileId(_journalfn.c_str(), id) || id != _tailid)
+        {
+            fclose(_tailfh);
+            _tailfh = NULL;
+        }
+    }
+    _lock.Unlock();
+}
+
+void CacheJournal::_Compact(void)
+{
+    _compactreq = false;
+
+    // only one process merges at a time. the one that does takes our records as well
+    if(_mergelock.IsOpen() && !_mergelock.Lock(true, false))
+    {
+        logdebug("CacheJournal: '%s' is being merged by another process",_basefn.c_str());
+        _records = 0;
+        return;
+    }
+
+    if(_fh)
+    {
+        fclose(_fh);
+        _fh = NULL;
+    }
+
+    // move the journal aside, new records will go into a new one while merging
+    _lock.Lock(true);
+    if(FileExists(_journalfn))
+    {
+        if(FileExists(_oldjournalfn)) // last merge failed, append to that one
+        {
+            FILE *src = fopen(_journalfn.c_str(), "rb");
+            FILE *dst = fopen(_oldjournalfn.c_str(), "ab");
+            if(src && dst)
+            {
+                char buf[4096];
+                size_t n;
+                while((n = fread(buf, 1, sizeof(buf), src)))
+                    fwrite(buf, 1, n, dst);
+            }
+            if(src)
+                fclose(src);
+            if(dst)
+                fclose(dst);
+            remove(_journalfn.c_str());
+        }
+        else
+            rename(_journalfn.c_str(), _oldjournalfn.c_str());
+    }
+    _lock.Unlock();
+    _records = 0;
+
+    if(FileExists(_oldjournalfn) && (*_compactfunc)(_basefn.c_str(), _oldjournalfn.c_str(), _tmpfn.c_str()))
+    {
+        _compactdone = true; // keep the merge lock until the new file is in place
+        return;
+    }
+    if(FileExists(_oldjournalfn))
+        logerror("CacheJournal: Failed to merge '%s' into '%s', will retry later",_oldjournalfn.c_str(),_basefn.c_str());
+    _mergelock.Unlock();
+}
+
+// replace the base file by the merged one. if the base file is mapped, it has to be unmapped first (windows).
+// a base file replaced by another process is mapped again as well.
+bool CacheJournal::FinishCompaction(CacheFile *mapped)
+{
+    if(_basechanged)
+    {
+        _basechanged = false;
+        if(mapped && !_compactdone)
+            mapped->Reopen();
+    }
+    if(!_compactdone)
+        return false;
+    if(mapped)
+        mapped->Close();
+#if PLATFORM == PLATFORM_WIN32
+    remove(_basefn.c_str()); // rename() does not overwrite on windows
+#endif
+    if(rename(_tmpfn.c_str(), _basefn.c_str()))
+        logerror("CacheJournal: Can't replace '%s'",_basefn.c_str());
+    else
+        remove(_oldjournalfn.c_str());
+    if(mapped)
+        mapped->Reopen();
+    logdebug("CacheJournal: '%s' compacted",_basefn.c_str());
+    _mergelock.Unlock();
+    _compactdone = false; // must be last, the journal thread may start the next compaction right after
+    return true;
+}
+
+// records written by other processes since the last call
+uint32 CacheJournal::Receive(CacheReplayFunc func, void *param)
+{
+    uint32 count = 0;
+    while(_incoming.size())
+    {
+        ByteBuffer *rec = _incoming.next();
+        (*func)(*rec, param);
+        delete rec;
+        count++;
+    }
+    return count;
+}
+
+
+CacheJournalRunnable::CacheJournalRunnable()
+{
+    _stop = false;
+}
+
+void CacheJournalRunnable::run(void)
+{
+    while(true)
+    {
+        bool stop = _stop; // do one more round after Stop() was called to write everything left
+        for(uint32 i = 0; i < _journals.size(); i++)
+            _journals[i]->Process();
+        if(stop)
+            break;
+        ZThread::Thread::sleep(250);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef _CACHEJOURNAL_H
+#define _CACHEJOURNAL_H
+
+#include "FileLock.h"
+
+class CacheFile;
+
+#define CACHEJOURNAL_MAX_RECORD 65536 // a record with a bigger size field can only be garbage
+
+// merges the records of <journalfn> into <basefn> and writes the result to <tmpfn>. runs in the journal thread.
+typedef bool (*CacheCompactFunc)(const char *basefn, const char *journalfn, const char *tmpfn);
+// called for every record found in a journal file
+typedef void (*CacheReplayFunc)(ByteBuffer& rec, void *param);
+
+// append-only journal for a cache file. new entries are written by a background thread as they arrive,
+// so nothing is lost on a crash and the main thread never waits for the disk.
+// from time to time the journal is merged into the base file ("compaction").
+// file layout: [uint32 size][size bytes record] ...
+// a journal that ends with a torn or garbage record is cut back to the last good one when it is replayed.
+//
+// several processes can use the same files: each appends to the journal under a shared lock,
+// only one of them merges at a time (<basefn>.merge.lock), and the journal is only moved aside
+// while holding <basefn>.lock exclusively. in shared mode, the records the other processes append
+// are read back and handed to the main thread, and a base file replaced by another process is remapped.
+class CacheJournal
+{
+public:
+    CacheJournal(std::string basefn, CacheCompactFunc func, uint32 compactAt, bool shared);
+    ~CacheJournal();
+    void Append(ByteBuffer& rec);
+    uint32 Replay(CacheReplayFunc func, void *param); // call only before the journal thread is started
+    inline void RequestCompaction(void) { _compactreq = true; }
+    void Process(void); // journal thread only
+    bool FinishCompaction(CacheFile *mapped = NULL); // main thread only. mapped: the base file, if kept open
+    uint32 Receive(CacheReplayFunc func, void *param); // main thread only. records other processes wrote
+
+    // endpos: end of the last good record. repair: cut the file there if a bad record follows, no other process may write to it
+    static uint32 ReplayFile(const char *fn, CacheReplayFunc func, void *param, uint32 *endpos = NULL, bool repair = false);
+
+private:
+    void _Write(void);
+    void _Tail(void);
+    void _Compact(void);
+    std::string _basefn, _journalfn, _oldjournalfn, _tmpfn;
+    CacheCompactFunc _compactfunc;
+    uint32 _compactat; // compact automatically after that many records, 0 = only on request
+    uint32 _records; // records written since the last compaction
+    FILE *_fh;
+    FileId _fhid;
+    FileLock _lock, _mergelock;
+    ZThread::LockedQueue<ByteBuffer*,ZThread::FastMutex> _queue;
+    volatile bool _compactreq;
+    volatile bool _compactdone;
+
+    // shared mode only
+    bool _shared;
+    FILE *_tailfh; // reads the journal from _tailpos on
+    FileId _tailid;
+    uint32 _tailpos;
+    FileId _baseid;
+    volatile bool _basechanged;
+    ZThread::LockedQueue<ByteBuffer*,ZThread::FastMutex> _incoming;
+};
+
+// writes the journals of one session in the background
+class CacheJournalRunnable : public ZThread::Runnable
+{
+public:
+    CacheJournalRunnable();
+    inline void Add(CacheJournal *j) { _journals.push_back(j); } // only before the thread is started
+    inline void Stop(void) { _stop = true; }
+    void run(void);
+
+private:
+    std::vector<CacheJournal*> _journals;
+    volatile bool _stop;
+};
+
+#endif
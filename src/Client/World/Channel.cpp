@@ -267,6 +267,7 @@ void Channel::HandleListRequest(WorldPacket& recvPacket)
         // DefScript binding
         l->push_back(DefScriptTools::toString(guid));
 	}
+    _worldSession->GetInstance()->GetScripts()->_ListChanged(l);
 }
 
 
@@ -12,6 +12,7 @@ void WorldSession::_HandleItemQuerySingleResponseOpcode(WorldPacket& recvPacket)
     std::string s;
 
     recvPacket >> ItemID;
+    _queries.Done(QUERY_ITEM, ItemID & 0x7FFFFFFF);
     if(!(ItemID & 0x80000000)) // invalid item flag?
     {
         ItemProto *proto = new ItemProto();
@@ -115,6 +116,7 @@ void WorldSession::_HandleItemQuerySingleResponseOpcode(WorldPacket& recvPacket)
         logdetail("Got Item Info: Id=%u Name='%s' ReqLevel=%u Armor=%u Desc='%s'",
             proto->Id, proto->Name.c_str(), proto->RequiredLevel, proto->Armor, proto->Description.c_str());
         objmgr.Add(proto);
+        ItemProtoCache_AddToJournal(this, proto);
         objmgr.AssignNameToObj(proto->Id, TYPEID_ITEM, proto->Name);
         objmgr.AssignNameToObj(proto->Id, TYPEID_CONTAINER, proto->Name);
     }
@@ -123,6 +125,7 @@ void WorldSession::_HandleItemQuerySingleResponseOpcode(WorldPacket& recvPacket)
         ItemID &= 0x7FFFFFFF; // remove nonexisting item flag
         logdetail("Item %u doesn't exist!",ItemID);
         objmgr.AddNonexistentItem(ItemID);
+        NonexistentCache_AddToJournal(this, TYPEID_ITEM, ItemID);
     }
 }
 
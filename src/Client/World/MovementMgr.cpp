@@ -11,6 +11,8 @@ MovementMgr::MovementMgr()
     _optime = 0;
     _updatetime = 0;
     _moved = false;
+    _reqid = 0;
+    _reqdone = 0;
 }
 
 MovementMgr::~MovementMgr()
@@ -69,8 +71,47 @@ void MovementMgr::_BuildPacket(uint16 opcode)
 
 }
 
+uint32 MovementMgr::Request(uint8 cmd, const WorldPosition *pos)
+{
+    MoveRequest r;
+    r.id = ++_reqid;
+    r.cmd = cmd;
+    r.setpos = pos != NULL;
+    if(pos)
+        r.pos = *pos;
+    _requests.add(r);
+    return r.id;
+}
+
+void MovementMgr::_DoRequests(void)
+{
+    while(_requests.size())
+    {
+        MoveRequest r = _requests.next();
+        if(r.setpos)
+            _mychar->SetPosition(r.pos);
+        switch(r.cmd)
+        {
+            case MOVEREQ_START_FORWARD: MoveStartForward(); break;
+            case MOVEREQ_START_BACKWARD: MoveStartBackward(); break;
+            case MOVEREQ_STOP: MoveStop(); break;
+            case MOVEREQ_START_TURN_LEFT: MoveStartTurnLeft(); break;
+            case MOVEREQ_START_TURN_RIGHT: MoveStartTurnRight(); break;
+            case MOVEREQ_STOP_TURN: MoveStopTurn(); break;
+            case MOVEREQ_SET_FACING: MoveSetFacing(); break;
+            case MOVEREQ_JUMP: MoveJump(); break;
+            case MOVEREQ_MODE_MANUAL: SetMoveMode(MOVEMODE_MANUAL); break;
+            case MOVEREQ_MODE_AUTO: SetMoveMode(MOVEMODE_AUTO); break;
+        }
+        _reqdone = r.id;
+    }
+}
+
 void MovementMgr::Update(bool sendDirect)
 {
+    if(!sendDirect) // the move functions call this too, the requests are done only once per tick
+        _DoRequests();
+
     uint32 curtime = getMSTime();
     uint32 timediff = curtime - _updatetime;
     _updatetime = curtime;
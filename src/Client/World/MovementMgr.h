@@ -25,6 +25,30 @@ enum MoveModes
     MOVEMODE_MANUAL, // user controlling movement, MyCharacter must be updated by the GUI
 };
 
+// what the GUI thread wants the character to do, see MovementMgr::Request()
+enum MoveRequestCommand
+{
+    MOVEREQ_NONE, // only set the position
+    MOVEREQ_START_FORWARD,
+    MOVEREQ_START_BACKWARD,
+    MOVEREQ_STOP,
+    MOVEREQ_START_TURN_LEFT,
+    MOVEREQ_START_TURN_RIGHT,
+    MOVEREQ_STOP_TURN,
+    MOVEREQ_SET_FACING,
+    MOVEREQ_JUMP,
+    MOVEREQ_MODE_MANUAL, // SetMoveMode()
+    MOVEREQ_MODE_AUTO
+};
+
+struct MoveRequest
+{
+    uint32 id;
+    uint8 cmd;
+    bool setpos;
+    WorldPosition pos;
+};
+
 class PseuInstance;
 class MyCharacter;
 
@@ -59,10 +83,16 @@ public:
     bool IsWalking(void); // walking straight forward/backward?
     bool IsStrafing(void); // strafing left/right?
 
+    // for the GUI thread, which must not touch MyCharacter: the request is queued and done in the next Update().
+    // the position is set first, then the command is done. returns the id of the request, ids only grow.
+    // must always be called from the same thread.
+    uint32 Request(uint8 cmd, const WorldPosition *pos = NULL);
+    inline uint32 GetLastRequestDone(void) { return _reqdone; } // world thread only
 
 
 private:
     void _BuildPacket(uint16);
+    void _DoRequests(void);
     PseuInstance *_instance;
     MyCharacter *_mychar;
     uint32 _moveFlags; // server relevant flags (move forward/backward/swim/fly/jump/etc)
@@ -73,7 +103,9 @@ private:
     float _jumptime;
     UnitMoveType _movetype; // index used for speed selection
     bool _moved;
-
+    ZThread::LockedQueue<MoveRequest,ZThread::FastMutex> _requests;
+    uint32 _reqid; // last id given out by Request()
+    uint32 _reqdone; // last request done
 
 };
 
@@ -1,11 +1,21 @@
+#include <algorithm>
 #include "common.h"
 #include "log.h"
 #include "PseuWoW.h"
 #include "ObjMgr.h"
 #include "GUI/PseuGUI.h"
+#include "CacheHandler.h"
+#include "WorldSession.h"
+#include "World.h"
+#include "MovementMgr.h"
 
 ObjMgr::ObjMgr()
 {
+    _fieldwatch_id = 0;
+    _evtypemask = 0;
+    _snapreaders[0] = _snapreaders[1] = 0;
+    _snapfront = 0;
+    _snapenabled = false;
     DEBUG(logdebug("DEBUG: ObjMgr created"));
 }
 
@@ -30,14 +40,20 @@ void ObjMgr::RemoveAll(void)
     {
         delete i->second;
     }
+    _go_templmutex.acquire();
     for(GOTemplateMap::iterator i = _go_templ.begin(); i!=_go_templ.end(); i++)
     {
         delete i->second;
     }
+    _go_templ.clear();
+    _go_templmutex.release();
     while(_obj.size())
     {
         Remove(_obj.begin()->first, true);
     }
+    _dirtyobj.clear();
+    _createdobj.clear();
+    _deletedobj.clear();
     if(PseuGUI *gui = _instance->GetGUI())
     {
         // necessary that the pending-to-delete GUIDs just stored by deleting the objects above will be cleared
@@ -71,6 +87,31 @@ void ObjMgr::Remove(uint64 guid, bool del)
     }        
 }
 
+void ObjMgr::Remove(std::vector<uint64>& guids, bool del)
+{
+    uint32 missing = 0;
+    for(uint32 i = 0; i < guids.size(); i++)
+    {
+        ObjectMap::iterator it = _obj.find(guids[i]);
+        if(it == _obj.end())
+        {
+            missing++;
+            continue;
+        }
+        Object *o = it->second;
+        o->_SetDepleted();
+        if(del)
+        {
+            _obj.erase(it);
+            delete o;
+        }
+    }
+    logdebug("ObjMgr: %u objects %s, %u not existing", guids.size() - missing, del ? "deleted" : "depleted", missing);
+
+    if(PseuGUI *gui = _instance->GetGUI())
+        gui->NotifyObjectsDeletion(guids);
+}
+
 // -- Object part --
 
 void ObjMgr::Add(Object *o)
@@ -92,14 +133,10 @@ Object *ObjMgr::GetObj(uint64 guid, bool also_depleted)
 {
     if(!guid)
         return NULL;
-    for(ObjectMap::iterator i = _obj.begin(); i!=_obj.end(); i++)
-        if(i->second->GetGUID() == guid)
-        {
-            if(i->second->_IsDepleted() && !also_depleted)
-                return NULL;
-            return i->second;
-        }
-    return NULL;
+    ObjectMap::iterator i = _obj.find(guid);
+    if(i == _obj.end() || (i->second->_IsDepleted() && !also_depleted))
+        return NULL;
+    return i->second;
 }
 
 // iterate over all objects and assign a name to all matching the entry and typeid
@@ -133,6 +170,302 @@ void ObjMgr::ReNotifyGUI(void)
 
 
 
+// -- Field watch part --
+
+uint32 ObjMgr::AddFieldWatch(std::vector<uint16>& fields, FieldWatchCallback cb, void *param, uint64 guid, uint8 typeId)
+{
+    FieldWatch& w = _fieldwatch[++_fieldwatch_id];
+    w.guid = guid;
+    w.typeId = typeId;
+    w.fields = fields;
+    w.callback = cb;
+    w.param = param;
+    return _fieldwatch_id;
+}
+
+uint32 ObjMgr::AddFieldWatch(std::vector<uint16>& fields, std::string script, uint64 guid, uint8 typeId)
+{
+    uint32 id = AddFieldWatch(fields, NULL, NULL, guid, typeId);
+    _fieldwatch[id].script = script;
+    return id;
+}
+
+bool ObjMgr::RemoveFieldWatch(uint32 id)
+{
+    return _fieldwatch.erase(id) != 0;
+}
+
+// call all watchers of fields that changed since the last call. each watcher gets notified only once per object,
+// with all of its watched fields that changed, no matter how many update blocks touched the object in between.
+void ObjMgr::DispatchFieldChanges(void)
+{
+    if(_dirtyobj.empty())
+        return;
+
+    // swap out the dirty set first; values changed by the callbacks will be dispatched next time
+    std::set<uint64> dirty;
+    dirty.swap(_dirtyobj);
+
+    DefScriptPackage *sc = _instance->GetScripts();
+    std::vector<uint16> changed;
+    for(std::set<uint64>::iterator it = dirty.begin(); it != dirty.end(); it++)
+    {
+        Object *o = GetObj(*it);
+        if(!o || !o->_HasDirtyFields())
+            continue;
+
+        for(FieldWatchMap::iterator wi = _fieldwatch.begin(); wi != _fieldwatch.end(); )
+        {
+            uint32 id = wi->first;
+            FieldWatch& w = wi->second;
+            if( (w.guid && w.guid != o->GetGUID()) || (w.typeId != TYPEID_OBJECT && w.typeId != o->GetTypeId()) )
+            {
+                wi++;
+                continue;
+            }
+
+            changed.clear();
+            for(uint32 i = 0; i < w.fields.size(); i++)
+                if(o->_IsFieldDirty(w.fields[i]))
+                    changed.push_back(w.fields[i]);
+
+            if(changed.size())
+            {
+                if(w.callback)
+                {
+                    (*w.callback)(o, changed, w.param);
+                }
+                else if(sc->ScriptExists(w.script))
+                {
+                    CmdSet Set;
+                    Set.defaultarg = DefScriptTools::toString(o->GetGUID());
+                    Set.arg[0] = DefScriptTools::toString((uint32)o->GetTypeId());
+                    for(uint32 i = 0; i < changed.size(); i++)
+                        Set.arg[i + 1] = DefScriptTools::toString((uint32)changed[i]);
+                    sc->RunScript(w.script, &Set);
+                }
+            }
+            // the callback may have added or removed watches, so dont rely on the old iterator
+            wi = _fieldwatch.upper_bound(id);
+        }
+        o->_ClearDirtyFields();
+    }
+}
+
+// -- Object event part --
+
+void ObjMgr::SetObjectEventFilter(uint32 typemask, std::set<uint32>& entries)
+{
+    _evtypemask = typemask;
+    _eventries = entries;
+}
+
+// true if scripts are not interested in objects of this type/entry
+bool ObjMgr::IsObjectEventFiltered(uint8 typeId, uint32 entry)
+{
+    if(_evtypemask && !(_evtypemask & (1 << typeId)))
+        return true;
+    return !_eventries.empty() && _eventries.find(entry) == _eventries.end();
+}
+
+void ObjMgr::QueueObjectCreation(Object *o)
+{
+    if(IsObjectEventFiltered(o))
+        return;
+    ObjectEvent ev;
+    ev.guid = o->GetGUID();
+    ev.entry = o->GetEntry();
+    ev.typeId = o->GetTypeId();
+    ev.outofrange = false;
+    _createdobj.push_back(ev);
+}
+
+// call this before the object is removed, so that type and entry are still known
+// objects we dont know (anymore) are not reported, the server sends out-of-range and destroy updates for those too
+void ObjMgr::QueueObjectDeletion(uint64 guid, bool outofrange)
+{
+    Object *o = GetObj(guid);
+    if(!o)
+        return;
+    ObjectEvent ev;
+    ev.guid = guid;
+    ev.entry = o->GetEntry();
+    ev.typeId = o->GetTypeId();
+    ev.outofrange = outofrange;
+    if(IsObjectEventFiltered(ev.typeId, ev.entry))
+        return;
+    _deletedobj.push_back(ev);
+}
+
+// pass all objects created/deleted since the last call to the scripts, as lists. one script call for each kind.
+void ObjMgr::DispatchObjectEvents(void)
+{
+    if(_createdobj.empty() && _deletedobj.empty())
+        return;
+
+    DefScriptPackage *sc = _instance->GetScripts();
+    std::vector<ObjectEvent> ev;
+    const char *script[2] = { "_onobjectscreated", "_onobjectsdeleted" };
+    const char *prefix[2] = { "OBJECTS::CREATED::", "OBJECTS::DELETED::" };
+    for(uint32 k = 0; k < 2; k++)
+    {
+        ev.clear();
+        ev.swap(k ? _deletedobj : _createdobj); // scripts may cause new events, these go into the next call
+        if(ev.empty() || !sc->ScriptExists(script[k]))
+            continue;
+
+        std::string pre = prefix[k];
+        DefList *guids = sc->lists.Get(pre + "GUIDS");
+        DefList *types = sc->lists.Get(pre + "TYPES");
+        DefList *entries = sc->lists.Get(pre + "ENTRIES");
+        DefList *oor = k ? sc->lists.Get(pre + "OUTOFRANGE") : NULL;
+        guids->clear();
+        types->clear();
+        entries->clear();
+        if(oor)
+            oor->clear();
+        for(uint32 i = 0; i < ev.size(); i++)
+        {
+            guids->push_back(DefScriptTools::toString(ev[i].guid));
+            types->push_back(DefScriptTools::toString((uint32)ev[i].typeId));
+            entries->push_back(DefScriptTools::toString(ev[i].entry));
+            if(oor)
+                oor->push_back(ev[i].outofrange ? "true" : "false");
+        }
+
+        CmdSet Set;
+        Set.defaultarg = DefScriptTools::toString((uint64)ev.size());
+        Set.arg[0] = "#" + pre + "GUIDS";
+        Set.arg[1] = "#" + pre + "TYPES";
+        Set.arg[2] = "#" + pre + "ENTRIES";
+        if(k)
+            Set.arg[3] = "#" + pre + "OUTOFRANGE";
+        sc->RunScript(script[k], &Set);
+
+        sc->lists.Delete(pre + "GUIDS");
+        sc->lists.Delete(pre + "TYPES");
+        sc->lists.Delete(pre + "ENTRIES");
+        if(k)
+            sc->lists.Delete(pre + "OUTOFRANGE");
+    }
+}
+
+// -- Snapshot part --
+
+const ObjectSnapshotEntry *ObjectSnapshot::Get(uint64 guid) const
+{
+    uint32 lo = 0, hi = objects.size();
+    while(lo < hi)
+    {
+        uint32 mid = (lo + hi) >> 1;
+        if(objects[mid].guid < guid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo < objects.size() && objects[lo].guid == guid)
+        return &objects[lo];
+    return NULL;
+}
+
+uint32 ObjectSnapshot::GetUInt32Value(const ObjectSnapshotEntry *e, uint16 field) const
+{
+    for(uint32 i = 0; i < fields.size(); i++)
+        if(fields[i] == field)
+            return e->values[i];
+    return 0;
+}
+
+float ObjectSnapshot::GetFloatValue(const ObjectSnapshotEntry *e, uint16 field) const
+{
+    uint32 u = GetUInt32Value(e, field);
+    float f;
+    memcpy(&f, &u, sizeof(float));
+    return f;
+}
+
+void ObjMgr::AddSnapshotField(uint16 field)
+{
+    _snapmutex.acquire();
+    if(std::find(_snapfields.begin(), _snapfields.end(), field) == _snapfields.end())
+        _snapfields.push_back(field);
+    _snapmutex.release();
+}
+
+// copy the current state of all objects into the buffer that is not visible to readers, then swap buffers.
+// must be called from the thread that owns the objects (once per tick). the buffers are reused, so after a few ticks
+// this does not allocate anything anymore, except if new objects appear.
+void ObjMgr::PublishSnapshot(void)
+{
+    if(!_snapenabled)
+        return;
+
+    _snapmutex.acquire();
+    uint32 back = _snapfront ^ 1;
+    bool busy = _snapreaders[back] != 0;
+    if(!busy)
+        _snap[back].fields = _snapfields;
+    _snapmutex.release();
+
+    // a slow reader still holds the old buffer; skip this tick, the readers will just see slightly older data
+    if(busy)
+        return;
+
+    ObjectSnapshot& snap = _snap[back];
+    snap.objects.resize(_obj.size());
+    uint32 idx = 0;
+    for(ObjectMap::iterator it = _obj.begin(); it != _obj.end(); it++) // ordered by guid, so the result is sorted too
+    {
+        Object *o = it->second;
+        ObjectSnapshotEntry& e = snap.objects[idx++];
+        e.guid = it->first;
+        e.entry = o->GetEntry();
+        e.typeId = o->GetTypeId();
+        e.pos = o->IsWorldObject() ? ((WorldObject*)o)->GetPosition() : WorldPosition();
+        e.name = o->GetName();
+        e.values.resize(snap.fields.size());
+        for(uint32 i = 0; i < snap.fields.size(); i++)
+            e.values[i] = snap.fields[i] < o->GetValuesCount() ? o->GetUInt32Value(snap.fields[i]) : 0;
+        GameobjectTemplate *go = o->IsGameObject() ? GetGOTemplate(e.entry) : NULL;
+        e.gotemplate = go != NULL;
+        e.gotype = go ? go->type : 0;
+        e.godisplayid = go ? go->displayId : 0;
+    }
+    snap.myguid = 0;
+    snap.mymovereq = 0;
+    WorldSession *ws = _instance->GetWSession();
+    Unit *my = ws && ws->GetGuid() ? (Unit*)GetObj(ws->GetGuid()) : NULL;
+    if(my)
+    {
+        snap.myguid = my->GetGUID();
+        for(uint32 i = 0; i < MAX_MOVE_TYPE; i++)
+            snap.myspeed[i] = my->GetSpeed(i);
+        if(ws->GetWorld() && ws->GetWorld()->GetMoveMgr())
+            snap.mymovereq = ws->GetWorld()->GetMoveMgr()->GetLastRequestDone();
+    }
+    snap.tick = _snap[_snapfront].tick + 1;
+
+    _snapmutex.acquire();
+    _snapfront = back;
+    _snapmutex.release();
+}
+
+const ObjectSnapshot *ObjMgr::AcquireSnapshot(void)
+{
+    _snapmutex.acquire();
+    uint32 front = _snapfront;
+    _snapreaders[front]++;
+    _snapmutex.release();
+    return &_snap[front];
+}
+
+void ObjMgr::ReleaseSnapshot(const ObjectSnapshot *snap)
+{
+    _snapmutex.acquire();
+    _snapreaders[snap == &_snap[0] ? 0 : 1]--;
+    _snapmutex.release();
+}
+
 // -- Item part --
 
 void ObjMgr::Add(ItemProto *proto)
@@ -145,17 +478,31 @@ ItemProto *ObjMgr::GetItemProto(uint32 entry)
     ItemProtoMap::iterator it = _iproto.find(entry);
     if(it != _iproto.end())
         return it->second;
-    return NULL;
+    // not used yet in this session, maybe it is in the cache file
+    ItemProto *proto = _iprotofile.IsOpen() ? ItemProtoCache_Load(_iprotofile, entry) : NULL;
+    if(proto)
+        _iproto[entry] = proto;
+    return proto;
 }
 
-void ObjMgr::AddNonexistentItem(uint32 id)
+// all prototypes known, including those that were not loaded from the cache file yet
+uint32 ObjMgr::GetItemProtoCount(void)
 {
-    _noitem.insert(id);
+    uint32 count = _iprotofile.GetCount();
+    for(ItemProtoMap::iterator it = _iproto.begin(); it != _iproto.end(); it++)
+        if(!_iprotofile.Has(it->first))
+            count++;
+    return count;
+}
+
+void ObjMgr::AddNonexistentItem(uint32 id, uint32 since)
+{
+    _noitem[id] = since ? since : (uint32)time(NULL);
 }
 
 bool ObjMgr::ItemNonExistent(uint32 id)
 {
-    return _noitem.find(id) != _noitem.end();
+    return _IsNonexistent(_noitem, id);
 }
 
 // -- Creature part --
@@ -170,52 +517,89 @@ CreatureTemplate *ObjMgr::GetCreatureTemplate(uint32 entry)
     CreatureTemplateMap::iterator it = _creature_templ.find(entry);
     if(it != _creature_templ.end())
         return it->second;
-    return NULL;
+    CreatureTemplate *ct = _creature_templfile.IsOpen() ? CreatureTemplateCache_Load(_creature_templfile, entry) : NULL;
+    if(ct)
+        _creature_templ[entry] = ct;
+    return ct;
+}
+
+uint32 ObjMgr::GetCreatureTemplateCount(void)
+{
+    uint32 count = _creature_templfile.GetCount();
+    for(CreatureTemplateMap::iterator it = _creature_templ.begin(); it != _creature_templ.end(); it++)
+        if(!_creature_templfile.Has(it->first))
+            count++;
+    return count;
 }
 
-void ObjMgr::AddNonexistentCreature(uint32 id)
+void ObjMgr::AddNonexistentCreature(uint32 id, uint32 since)
 {
-    _nocreature.insert(id);
+    _nocreature[id] = since ? since : (uint32)time(NULL);
 }
 
 bool ObjMgr::CreatureNonExistent(uint32 id)
 {
-    return _nocreature.find(id) != _nocreature.end();
+    return _IsNonexistent(_nocreature, id);
 }
 
 // -- Gameobject part --
 
+// loading a GO template from the cache file modifies the storage, and the journal thread replaces the cache file,
+// so every access is locked. the GUI gets what it needs from the object snapshot and never calls these
 void ObjMgr::Add(GameobjectTemplate *go)
 {
+    _go_templmutex.acquire();
     _go_templ[go->entry] = go;
+    _go_templmutex.release();
 }
 
 GameobjectTemplate *ObjMgr::GetGOTemplate(uint32 entry)
 {
+    GameobjectTemplate *go = NULL;
+    _go_templmutex.acquire();
     GOTemplateMap::iterator it = _go_templ.find(entry);
     if(it != _go_templ.end())
-        return it->second;
-    return NULL;
+        go = it->second;
+    else if(_go_templfile.IsOpen() && (go = GOTemplateCache_Load(_go_templfile, entry)))
+        _go_templ[entry] = go;
+    _go_templmutex.release();
+    return go;
 }
 
-void ObjMgr::AddNonexistentGO(uint32 id)
+uint32 ObjMgr::GetGOTemplateCount(void)
 {
-    _nogameobj.insert(id);
+    _go_templmutex.acquire();
+    uint32 count = _go_templfile.GetCount();
+    for(GOTemplateMap::iterator it = _go_templ.begin(); it != _go_templ.end(); it++)
+        if(!_go_templfile.Has(it->first))
+            count++;
+    _go_templmutex.release();
+    return count;
 }
 
-bool ObjMgr::GONonExistent(uint32 id)
+void ObjMgr::AddNonexistentGO(uint32 id, uint32 since)
 {
-    return _nogameobj.find(id) != _nogameobj.end();
+    _nogameobj[id] = since ? since : (uint32)time(NULL);
 }
 
-// -- misc part --
-
-void ObjMgr::AddRequestedPlayerGUID(uint32 loguid)
+bool ObjMgr::GONonExistent(uint32 id)
 {
-    _reqpnames.insert(loguid);
+    return _IsNonexistent(_nogameobj, id);
 }
 
-bool ObjMgr::IsRequestedPlayerGUID(uint32 loguid)
+// -- misc part --
+
+// entries the server said do not exist are asked for again after some time (NonexistentExpiry), they may have been added
+bool ObjMgr::_IsNonexistent(NonexistentMap& m, uint32 id)
 {
-    return _reqpnames.find(loguid) != _reqpnames.end();
+    NonexistentMap::iterator it = m.find(id);
+    if(it == m.end())
+        return false;
+    uint32 expiry = _instance->GetConf()->nonexistentExpiry;
+    if(expiry && (uint32)time(NULL) - it->second >= expiry)
+    {
+        m.erase(it);
+        return false;
+    }
+    return true;
 }
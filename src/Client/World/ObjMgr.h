@@ -6,11 +6,70 @@
 #include "Item.h"
 #include "Unit.h"
 #include "GameObject.h"
+#include "CacheFile.h"
+#include "UnorderedMap.h"
 
 typedef std::map<uint32,ItemProto*> ItemProtoMap;
 typedef std::map<uint32,CreatureTemplate*> CreatureTemplateMap;
 typedef std::map<uint32,GameobjectTemplate*> GOTemplateMap;
 typedef std::map<uint64,Object*> ObjectMap;
+typedef UNORDERED_MAP<uint32,uint32> NonexistentMap; // entry -> time the server said it does not exist
+
+// called once per tick for each watched object with all watched fields that changed during that tick
+typedef void (*FieldWatchCallback)(Object *obj, std::vector<uint16>& fields, void *param);
+
+struct FieldWatch
+{
+    uint64 guid; // 0 = any object
+    uint8 typeId; // TYPEID_OBJECT = any type
+    std::vector<uint16> fields;
+    FieldWatchCallback callback; // either this is set...
+    void *param;
+    std::string script; // ...or this, the DefScript to run
+};
+
+typedef std::map<uint32,FieldWatch> FieldWatchMap;
+
+// object creation/deletion, queued and passed to the scripts once per tick
+struct ObjectEvent
+{
+    uint64 guid;
+    uint32 entry;
+    uint8 typeId;
+    bool outofrange; // only used for deletion
+};
+
+// read-only copy of an object, as far as other threads (GUI) are interested in it
+struct ObjectSnapshotEntry
+{
+    uint64 guid;
+    uint32 entry;
+    uint8 typeId;
+    WorldPosition pos; // only set for world objects
+    std::string name;
+    std::vector<uint32> values; // one value per snapshot field, in the same order
+    // gameobjects only, from the template. gotemplate is false as long as the template is not known
+    bool gotemplate;
+    uint32 gotype;
+    uint32 godisplayid;
+};
+
+class ObjectSnapshot
+{
+public:
+    ObjectSnapshot() : tick(0), myguid(0), mymovereq(0) { memset(myspeed, 0, sizeof(myspeed)); }
+    const ObjectSnapshotEntry *Get(uint64 guid) const;
+    uint32 GetUInt32Value(const ObjectSnapshotEntry *e, uint16 field) const;
+    float GetFloatValue(const ObjectSnapshotEntry *e, uint16 field) const;
+
+    std::vector<ObjectSnapshotEntry> objects; // sorted by guid
+    std::vector<uint16> fields;
+    uint32 tick;
+    // MyCharacter, its position is in objects. myguid is 0 if it does not exist (yet)
+    uint64 myguid;
+    float myspeed[MAX_MOVE_TYPE];
+    uint32 mymovereq; // the last MovementMgr::Request() done before the copy was made
+};
 
 class PseuInstance;
 
@@ -23,61 +82,101 @@ public:
     void RemoveAll(void); // TODO: this needs to be called on SMSG_LOGOUT_COMPLETE once implemented.
 
     // Item Prototype functions
-    uint32 GetItemProtoCount(void) { return _iproto.size(); }
+    uint32 GetItemProtoCount(void);
     ItemProto *GetItemProto(uint32);
     void Add(ItemProto*);
-    ItemProtoMap *GetItemProtoStorage(void) { return &_iproto; }
+    ItemProtoMap *GetItemProtoStorage(void) { return &_iproto; } // only the prototypes used so far
+    CacheFile& GetItemProtoCacheFile(void) { return _iprotofile; }
 
     // nonexistent items handler
-    void AddNonexistentItem(uint32);
+    void AddNonexistentItem(uint32 id, uint32 since = 0); // since = 0: now
     bool ItemNonExistent(uint32);
 
     // Creature template functions
-    uint32 GetCreatureTemplateCount(void) { return _creature_templ.size(); }
+    uint32 GetCreatureTemplateCount(void);
     CreatureTemplate *GetCreatureTemplate(uint32);
     void Add(CreatureTemplate*);
     CreatureTemplateMap *GetCreatureTemplateStorage(void) { return &_creature_templ; }
+    CacheFile& GetCreatureTemplateCacheFile(void) { return _creature_templfile; }
 
     // nonexistent creatures handler
-    void AddNonexistentCreature(uint32);
+    void AddNonexistentCreature(uint32 id, uint32 since = 0); // since = 0: now
     bool CreatureNonExistent(uint32);
 
     // Gameobject template functions
-    uint32 GetGOTemplateCount(void) { return _go_templ.size(); }
+    uint32 GetGOTemplateCount(void);
     GameobjectTemplate *GetGOTemplate(uint32);
     void Add(GameobjectTemplate*);
     GOTemplateMap *GetGOTemplateStorage(void) { return &_go_templ; }
+    CacheFile& GetGOTemplateCacheFile(void) { return _go_templfile; }
+    ZThread::FastMutex& GetGOTemplateMutex(void) { return _go_templmutex; } // hold while touching the GO cache file
 
     // nonexistent gameobjects handler
-    void AddNonexistentGO(uint32);
+    void AddNonexistentGO(uint32 id, uint32 since = 0); // since = 0: now
     bool GONonExistent(uint32);
 
-    // player names related
-    void AddRequestedPlayerGUID(uint32);
-    bool IsRequestedPlayerGUID(uint32);
-    inline void AddRequestedPlayerGUID(uint64 guid) { AddRequestedPlayerGUID(GUID_LOPART(guid)); }
-    inline bool IsRequestedPlayerGUID(uint64 guid) { return IsRequestedPlayerGUID(GUID_LOPART(guid)); }
-
 
     // Object functions
     void Add(Object*);
     void Remove(uint64 guid, bool del); // remove all objects with that guid (should be only 1 object in total anyway)
+    void Remove(std::vector<uint64>& guids, bool del); // same for many objects at once, with only one GUI notification
     Object *GetObj(uint64 guid, bool also_depleted = false);
     inline uint32 GetObjectCount(void) { return _obj.size(); }
     uint32 AssignNameToObj(uint32 entry, uint8 type, std::string name);
     void ReNotifyGUI(void);
 
+    // field change subscriptions
+    uint32 AddFieldWatch(std::vector<uint16>& fields, FieldWatchCallback cb, void *param, uint64 guid = 0, uint8 typeId = TYPEID_OBJECT);
+    uint32 AddFieldWatch(std::vector<uint16>& fields, std::string script, uint64 guid = 0, uint8 typeId = TYPEID_OBJECT);
+    bool RemoveFieldWatch(uint32 id);
+    inline bool HasFieldWatches(void) { return !_fieldwatch.empty(); }
+    inline void AddDirtyObject(Object *o) { _dirtyobj.insert(o->GetGUID()); }
+    void DispatchFieldChanges(void);
+
+    // batched object creation/deletion events for scripts
+    void SetObjectEventFilter(uint32 typemask, std::set<uint32>& entries);
+    bool IsObjectEventFiltered(uint8 typeId, uint32 entry);
+    inline bool IsObjectEventFiltered(Object *o) { return IsObjectEventFiltered(o->GetTypeId(), o->GetEntry()); }
+    void QueueObjectCreation(Object *o);
+    void QueueObjectDeletion(uint64 guid, bool outofrange);
+    void DispatchObjectEvents(void);
+
+    // double-buffered object snapshot, published once per tick for other threads.
+    // readers must not keep the returned ptr after ReleaseSnapshot().
+    void SetSnapshotEnabled(bool b) { _snapenabled = b; }
+    void AddSnapshotField(uint16 field);
+    void PublishSnapshot(void);
+    const ObjectSnapshot *AcquireSnapshot(void);
+    void ReleaseSnapshot(const ObjectSnapshot *snap);
+
 private:
     ItemProtoMap _iproto;
     CreatureTemplateMap _creature_templ;
     GOTemplateMap _go_templ;
+    CacheFile _iprotofile; // everything known from earlier sessions, loaded on demand
+    CacheFile _creature_templfile;
+    CacheFile _go_templfile;
+    ZThread::FastMutex _go_templmutex;
 
     ObjectMap _obj;
-    std::set<uint32> _noitem;
-    std::set<uint32> _reqpnames;
-    std::set<uint32> _nocreature;
-    std::set<uint32> _nogameobj;
+    NonexistentMap _noitem;
+    NonexistentMap _nocreature;
+    NonexistentMap _nogameobj;
+    std::set<uint64> _dirtyobj;
+    FieldWatchMap _fieldwatch;
+    uint32 _fieldwatch_id;
+    std::vector<ObjectEvent> _createdobj;
+    std::vector<ObjectEvent> _deletedobj;
+    uint32 _evtypemask; // 1 << typeid, 0 = all types
+    std::set<uint32> _eventries; // empty = all entries
+    ObjectSnapshot _snap[2];
+    uint32 _snapreaders[2];
+    volatile uint32 _snapfront;
+    volatile bool _snapenabled;
+    std::vector<uint16> _snapfields;
+    ZThread::FastMutex _snapmutex; // only guards the buffer index, reader counts and field list
     PseuInstance *_instance;
+    bool _IsNonexistent(NonexistentMap& m, uint32 id);
 
 };
 
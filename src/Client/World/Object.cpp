@@ -6,7 +6,9 @@
 Object::Object()
 {
     _depleted = false;
+    _dirty = false;
     _uint32values=NULL;
+    _dirtymask=NULL;
     _type=TYPE_OBJECT;
     _typeid=TYPEID_OBJECT;
     _valuescount=OBJECT_END; // base class. this value will be set by derived classes
@@ -18,12 +20,26 @@ Object::~Object()
     DEBUG(logdebug("~Object() GUID="I64FMT,GetGUID()));
     if(_uint32values)
         delete [] _uint32values;
+    if(_dirtymask)
+        delete [] _dirtymask;
 }
 
 void Object::_InitValues()
 {
     _uint32values = new uint32[ _valuescount ];
     memset(_uint32values, 0, _valuescount*sizeof(uint32));
+    uint32 blocks = (_valuescount + 31) >> 5;
+    _dirtymask = new uint32[ blocks ];
+    memset(_dirtymask, 0, blocks*sizeof(uint32));
+}
+
+void Object::_ClearDirtyFields(void)
+{
+    if(_dirty)
+    {
+        memset(_dirtymask, 0, ((_valuescount + 31) >> 5)*sizeof(uint32));
+        _dirty = false;
+    }
 }
 
 void Object::Create( uint64 guid )
@@ -113,15 +129,18 @@ void WorldSession::_HandleDestroyObjectOpcode(WorldPacket& recvPacket)
     recvPacket >> guid >> dummy;
     logdebug("Destroy Object "I64FMT,guid);
 
-    // call script just before object removal
-    if(GetInstance()->GetScripts()->ScriptExists("_onobjectdelete"))
+    // call scripts just before object removal
+    DefScriptPackage *sc = GetInstance()->GetScripts();
+    if(sc->ScriptExists("_onobjectsdeleted"))
+        objmgr.QueueObjectDeletion(guid, false);
+    Object *o = objmgr.GetObj(guid);
+    if(sc->ScriptExists("_onobjectdelete") && !(o && objmgr.IsObjectEventFiltered(o)))
     {
-        Object *o = objmgr.GetObj(guid);
         CmdSet Set;
         Set.defaultarg = toString(guid);
         Set.arg[0] = o ? toString(o->GetTypeId()) : "";
         Set.arg[1] = "false"; // out of range = false
-        GetInstance()->GetScripts()->RunScript("_onobjectdelete", &Set);
+        sc->RunScript("_onobjectdelete", &Set);
     }
 
     objmgr.Remove(guid, false);
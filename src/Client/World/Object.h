@@ -99,6 +99,19 @@ public:
     void Create(uint64 guid);
     inline bool _IsDepleted(void) { return _depleted; }
     inline void _SetDepleted(void) { _depleted = true; }
+
+    // dirty-field tracking. bits are set by WorldSession::_ValuesUpdate() and cleared after ObjMgr dispatched the changes.
+    inline void _SetFieldDirty(uint16 index)
+    {
+        _dirtymask[ index >> 5 ] |= 1u << ( index & 31 );
+        _dirty = true;
+    }
+    inline bool _IsFieldDirty(uint16 index) const
+    {
+        return index < _valuescount && ( _dirtymask[ index >> 5 ] & ( 1u << ( index & 31 ) ) ) != 0;
+    }
+    inline bool _HasDirtyFields(void) { return _dirty; }
+    void _ClearDirtyFields(void);
     
 protected:
     Object();
@@ -110,10 +123,12 @@ protected:
         uint32 *_uint32values;
         float *_floatvalues;
     };
+    uint32 *_dirtymask; // 1 bit per field, (_valuescount + 31) / 32 blocks
     uint8 _type;
     uint8 _typeid;
     std::string _name;
     bool _depleted : 1; // true if the object was deleted from the objmgr, but not from memory
+    bool _dirty : 1; // true if at least one bit in _dirtymask is set
 };
 
 class WorldObject : public Object
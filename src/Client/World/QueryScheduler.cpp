@@ -0,0 +1,144 @@
+#include "common.h"
+#include "WorldSession.h"
+#include "QueryScheduler.h"
+
+static const char *queryTypeNames[QUERY_TYPE_COUNT] = { "name", "item", "creature", "gameobject" };
+
+QueryScheduler::QueryScheduler()
+{
+    _session = NULL;
+    _waiting = _inflight = 0;
+    _rate = _burst = 0;
+    _timeout = 5000;
+    _retries = 2;
+    _allowance = 0;
+    _lastupdate = getMSTime();
+}
+
+void QueryScheduler::SetRate(uint32 perSecond, uint32 burst)
+{
+    _rate = perSecond;
+    _burst = burst ? burst : 1;
+    _allowance = _burst * 1000;
+}
+
+void QueryScheduler::SetTimeout(uint32 ms, uint32 retries)
+{
+    if(ms) // keep the default if not configured
+        _timeout = ms;
+    _retries = retries;
+}
+
+bool QueryScheduler::Add(uint8 type, uint64 id, uint64 guid, uint8 prio)
+{
+    PendingQueryMap::iterator it = _pending[type].find(id);
+    if(it != _pending[type].end())
+    {
+        // asked again, but now it's more urgent
+        PendingQuery& q = it->second;
+        if(!q.sent && prio > q.prio)
+        {
+            q.prio = prio;
+            QueueEntry qe = { type, id, 0 };
+            _queue[prio].push_back(qe); // the old entry is skipped when it comes up
+        }
+        return false;
+    }
+    PendingQuery& q = _pending[type][id];
+    q.guid = guid;
+    q.sent = 0;
+    q.prio = prio;
+    q.tries = 0;
+    QueueEntry qe = { type, id, 0 };
+    _queue[prio].push_back(qe);
+    _waiting++;
+    return true;
+}
+
+void QueryScheduler::Done(uint8 type, uint64 id)
+{
+    PendingQueryMap::iterator it = _pending[type].find(id);
+    if(it == _pending[type].end())
+        return; // not asked by us, or timed out already
+    if(it->second.sent)
+        _inflight--;
+    else
+        _waiting--;
+    _pending[type].erase(it);
+}
+
+void QueryScheduler::_Send(QueueEntry& qe, PendingQuery& q, uint32 now)
+{
+    q.sent = now ? now : 1; // 0 means not sent
+    q.tries++;
+    qe.sent = q.sent;
+    _sentqueue.push_back(qe);
+    _waiting--;
+    _inflight++;
+    _session->SendQueryPacket(qe.type, qe.id, q.guid);
+}
+
+void QueryScheduler::Update(void)
+{
+    uint32 now = getMSTime();
+    uint32 diff = now - _lastupdate;
+    _lastupdate = now;
+
+    // queries the server did not answer in time are sent again, or given up
+    while(_sentqueue.size() && now - _sentqueue.front().sent >= _timeout)
+    {
+        QueueEntry qe = _sentqueue.front();
+        _sentqueue.pop_front();
+        PendingQueryMap::iterator it = _pending[qe.type].find(qe.id);
+        if(it == _pending[qe.type].end() || it->second.sent != qe.sent)
+            continue; // answered or sent again meanwhile
+        PendingQuery& q = it->second;
+        _inflight--;
+        if(q.tries > _retries)
+        {
+            logdebug("QueryScheduler: No answer to %s query " I64FMTD ", giving up",queryTypeNames[qe.type],qe.id);
+            _pending[qe.type].erase(it);
+            continue;
+        }
+        logdebug("QueryScheduler: No answer to %s query " I64FMTD ", retrying",queryTypeNames[qe.type],qe.id);
+        q.sent = 0;
+        _waiting++;
+        qe.sent = 0;
+        _queue[q.prio].push_front(qe); // it waited long enough
+    }
+
+    // refill even if nothing waits, so a burst builds up again while idle
+    if(_rate)
+        _allowance = std::min<uint32>(_allowance + std::min<uint32>(diff, 60000) * _rate, _burst * 1000);
+
+    if(!_waiting)
+        return;
+
+    for(int prio = QUERY_PRIO_COUNT - 1; prio >= 0; prio--)
+    {
+        QueryQueue& queue = _queue[prio];
+        while(queue.size() && (!_rate || _allowance >= 1000))
+        {
+            QueueEntry qe = queue.front();
+            queue.pop_front();
+            PendingQueryMap::iterator it = _pending[qe.type].find(qe.id);
+            if(it == _pending[qe.type].end() || it->second.sent || it->second.prio != prio)
+                continue; // outdated entry
+            _Send(qe, it->second, now);
+            if(_rate)
+                _allowance -= 1000;
+        }
+    }
+}
+
+void QueryScheduler::Clear(void)
+{
+    for(uint32 i = 0; i < QUERY_TYPE_COUNT; i++)
+        _pending[i].clear();
+    for(uint32 i = 0; i < QUERY_PRIO_COUNT; i++)
+        _queue[i].clear();
+    _sentqueue.clear();
+    _waiting = _inflight = 0;
+    _allowance = _burst * 1000; // a new session starts with a full bucket
+    _lastupdate = getMSTime();
+}
@@ -0,0 +1,73 @@
+#ifndef _QUERYSCHEDULER_H
+#define _QUERYSCHEDULER_H
+
+#include <deque>
+#include "UnorderedMap.h"
+
+class WorldSession;
+
+enum QueryType
+{
+    QUERY_PLAYERNAME, // id = player guid
+    QUERY_ITEM,       // id = entry
+    QUERY_CREATURE,
+    QUERY_GAMEOBJECT,
+    QUERY_TYPE_COUNT
+};
+
+enum QueryPriority
+{
+    QUERY_PRIO_LOW,    // nice to know (item links in chat, ...)
+    QUERY_PRIO_NORMAL, // objects that came into range
+    QUERY_PRIO_HIGH,   // something waits for the answer (delayed packets, scripts)
+    QUERY_PRIO_COUNT
+};
+
+struct PendingQuery
+{
+    uint64 guid; // sent along with template queries
+    uint32 sent; // time of the last send, 0 = waiting to be sent
+    uint8 prio;
+    uint8 tries;
+};
+
+typedef UNORDERED_MAP<uint64,PendingQuery> PendingQueryMap;
+
+// all CMSG_*_QUERY packets go through here. a query is sent only once until it is answered or times out,
+// no matter how often it is requested, and the queries are sent no faster than the configured rate,
+// higher priorities first. queries that time out are sent again a few times.
+class QueryScheduler
+{
+public:
+    QueryScheduler();
+    inline void SetSession(WorldSession *session) { _session = session; }
+    void SetRate(uint32 perSecond, uint32 burst); // perSecond = 0: no limit
+    void SetTimeout(uint32 ms, uint32 retries);
+    bool Add(uint8 type, uint64 id, uint64 guid = 0, uint8 prio = QUERY_PRIO_NORMAL); // false if it was pending already
+    void Done(uint8 type, uint64 id); // the server answered
+    inline bool IsPending(uint8 type, uint64 id) { return _pending[type].find(id) != _pending[type].end(); }
+    void Update(void); // send what the rate allows, check for timeouts
+    void Clear(void); // forget everything, the answers will never come
+
+private:
+    struct QueueEntry
+    {
+        uint8 type;
+        uint64 id;
+        uint32 sent; // for the in-flight queue: which send this entry is about
+    };
+    typedef std::deque<QueueEntry> QueryQueue;
+
+    void _Send(QueueEntry& qe, PendingQuery& q, uint32 now);
+
+    WorldSession *_session;
+    PendingQueryMap _pending[QUERY_TYPE_COUNT];
+    QueryQueue _queue[QUERY_PRIO_COUNT]; // waiting to be sent. may contain outdated entries, checked when taken out
+    QueryQueue _sentqueue; // in order of sending, so the oldest ones time out first
+    uint32 _waiting, _inflight;
+    uint32 _rate, _burst, _timeout, _retries;
+    uint32 _allowance; // how many queries may be sent right now, in 1/1000
+    uint32 _lastupdate;
+};
+
+#endif
@@ -17,21 +17,15 @@ void WorldSession::_HandleCompressedUpdateObjectOpcode(WorldPacket& recvPacket)
 {
     uint32 realsize;
     recvPacket >> realsize;
-    ZCompressor z;
-    z.append(recvPacket.contents() + sizeof(uint32),recvPacket.size() - sizeof(uint32));
-    z.Compressed(true);
-    z.RealSize(realsize);
-    z.Inflate();
-    if(z.Compressed())
+    // inflate into a packet kept by the session, its storage is reused for all following compressed updates
+    _inflatedPkt.SetOpcode(recvPacket.GetOpcode());
+    if(!_inflater.Inflate(recvPacket.contents() + sizeof(uint32), recvPacket.size() - sizeof(uint32), _inflatedPkt, realsize))
     {
-        logerror("_HandleCompressedUpdateObjectOpcode(): Inflate() failed! size=%u realsize=%u",z.size(),realsize);
+        logerror("_HandleCompressedUpdateObjectOpcode(): Inflate() failed! size=%u realsize=%u",recvPacket.size(),realsize);
         return;
     }
-    WorldPacket wp;
-    wp.SetOpcode(recvPacket.GetOpcode());
-    wp.append(z.contents(),z.size());
 
-    _HandleUpdateObjectOpcode(wp);
+    _HandleUpdateObjectOpcode(_inflatedPkt);
 }
 
 void WorldSession::_HandleUpdateObjectOpcode(WorldPacket& recvPacket)
@@ -43,6 +37,13 @@ void WorldSession::_HandleUpdateObjectOpcode(WorldPacket& recvPacket)
     recvPacket >> ublocks; // >> hasTransport;
     //logdev("UpdateObject: blocks = %u, hasTransport = %u", ublocks, hasTransport);
     logdev("UpdateObject: blocks = %u", ublocks);
+
+    // look up the script hooks only once per packet, not once per object
+    DefScriptPackage *sc = GetInstance()->GetScripts();
+    bool oncreate = sc->ScriptExists("_onobjectcreate");
+    bool oncreatebatch = sc->ScriptExists("_onobjectscreated");
+    bool ondelete = sc->ScriptExists("_onobjectdelete");
+    bool ondeletebatch = sc->ScriptExists("_onobjectsdeleted");
     while((recvPacket.rpos() < recvPacket.size())&& (readblocks < ublocks))
     {
         recvPacket >> utype;
@@ -171,13 +172,23 @@ void WorldSession::_HandleUpdateObjectOpcode(WorldPacket& recvPacket)
                 _QueryObjectInfo(uguid);
 
 
-                // call script "_OnObjectCreate"
-                if(GetInstance()->GetScripts()->ScriptExists("_onobjectcreate"))
+                // call script "_OnObjectCreate" for every object the scripts are interested in,
+                // and queue it for "_OnObjectsCreated", which is called once per tick
+                if(oncreate || oncreatebatch)
                 {
-                    CmdSet Set;
-                    Set.defaultarg = toString(uguid);
-                    Set.arg[0] = toString(objtypeid);
-                    GetInstance()->GetScripts()->RunScript("_onobjectcreate", &Set);
+                    Object *obj = objmgr.GetObj(uguid);
+                    if(obj && !objmgr.IsObjectEventFiltered(obj))
+                    {
+                        if(oncreatebatch)
+                            objmgr.QueueObjectCreation(obj);
+                        if(oncreate)
+                        {
+                            CmdSet Set;
+                            Set.defaultarg = toString(uguid);
+                            Set.arg[0] = toString(objtypeid);
+                            sc->RunScript("_onobjectcreate", &Set);
+                        }
+                    }
                 }
 
                 // if our own character got finally created, we have successfully entered the world,
@@ -188,24 +199,34 @@ void WorldSession::_HandleUpdateObjectOpcode(WorldPacket& recvPacket)
             case UPDATETYPE_OUT_OF_RANGE_OBJECTS:
             {
                 recvPacket >> usize;
-                for(uint16 i=0;i<usize;i++)
+                std::vector<uint64> guids;
+                guids.reserve(std::min<uint32>(usize, recvPacket.size() - recvPacket.rpos())); // count is from the packet, each guid takes at least 1 byte
+                for(uint32 i=0;i<usize;i++)
+                    guids.push_back(recvPacket.GetPackedGuid()); // not 100% sure if this is correct
+                logdebug("%u objects out of range",usize);
+
+                // call scripts just before object removal
+                if(ondeletebatch)
                 {
-                    uguid = recvPacket.GetPackedGuid(); // not 100% sure if this is correct
-                    logdebug("GUID "I64FMT" out of range",uguid);
-
-                    // call script just before object removal
-                    if(GetInstance()->GetScripts()->ScriptExists("_onobjectdelete"))
+                    for(uint32 i=0;i<guids.size();i++)
+                        objmgr.QueueObjectDeletion(guids[i], true);
+                }
+                if(ondelete) // per-object variant
+                {
+                    for(uint32 i=0;i<guids.size();i++)
                     {
-                        Object *del_obj = objmgr.GetObj(uguid);
+                        Object *del_obj = objmgr.GetObj(guids[i]);
+                        if(del_obj && objmgr.IsObjectEventFiltered(del_obj))
+                            continue;
                         CmdSet Set;
-                        Set.defaultarg = toString(uguid);
+                        Set.defaultarg = toString(guids[i]);
                         Set.arg[0] = del_obj ? toString(del_obj->GetTypeId()) : "";
                         Set.arg[1] = "true"; // out of range = true
-                        GetInstance()->GetScripts()->RunScript("_onobjectdelete", &Set);
+                        sc->RunScript("_onobjectdelete", &Set);
                     }
-
-                    objmgr.Remove(uguid, false);
                 }
+
+                objmgr.Remove(guids, false);
             }
             break;
 
@@ -440,13 +461,17 @@ void WorldSession::_ValuesUpdate(uint64 uguid, WorldPacket& recvPacket)
             {
                 if(IsFloatField(obj->GetTypeMask(),i))
                 {
-                    recvPacket >> fvalue;                    
+                    recvPacket >> fvalue;
+                    if(obj->GetFloatValue(i) != fvalue)
+                        obj->_SetFieldDirty(i);
                     obj->SetFloatValue(i, fvalue);
                     logdev("-> Field[%u] = %f",i,fvalue);
                 }
                 else
                 {
                     recvPacket >> value;
+                    if(obj->GetUInt32Value(i) != value)
+                        obj->_SetFieldDirty(i);
                     obj->SetUInt32Value(i, value);
                     logdev("-> Field[%u] = %u",i,value);
                 }
@@ -457,6 +482,10 @@ void WorldSession::_ValuesUpdate(uint64 uguid, WorldPacket& recvPacket)
             }            
         }
     }
+
+    // changes will be passed to field watchers once all packets of this tick are handled
+    if(obj && obj->_HasDirtyFields())
+        objmgr.AddDirtyObject(obj);
 }
 
 void WorldSession::_QueryObjectInfo(uint64 guid)
@@ -483,7 +512,7 @@ void WorldSession::_QueryObjectInfo(uint64 guid)
             }
         case TYPEID_PLAYER:
             {
-                std::string name = GetOrRequestPlayerName(obj->GetGUID());
+                std::string name = GetOrRequestPlayerName(obj->GetGUID(), QUERY_PRIO_NORMAL);
                 if(!name.empty())
                 {
                     obj->SetName(name);
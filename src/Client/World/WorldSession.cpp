@@ -15,6 +15,7 @@
 #include "RealmSession.h"
 #include "WorldSession.h"
 #include "MemoryDataHolder.h"
+#include "CacheJournal.h"
 
 struct OpcodeHandler
 {
@@ -36,6 +37,13 @@ WorldSession::WorldSession(PseuInstance *in)
     objmgr.SetInstance(in);
     _lag_ms = 0;
     _partyacceptexpire = 0;
+    _queries.SetSession(this);
+    _queries.SetRate(in->GetConf()->queryRate, in->GetConf()->queryBurst);
+    _queries.SetTimeout(in->GetConf()->queryTimeout, in->GetConf()->queryRetries);
+    for(uint32 i = 0; i < CACHE_JOURNAL_COUNT; i++)
+        _cachejournal[i] = NULL;
+    _cacherunnable = NULL;
+    _cachethread = NULL;
     //...
 
     in->GetScripts()->RunScriptIfExists("_onworldsessioncreate");
@@ -87,6 +95,18 @@ WorldSession::~WorldSession()
         delete _socket;
     if(_world)
         delete _world;
+
+    // write what is left in the journals, then put the merged files in place
+    if(_cachethread)
+    {
+        _cacherunnable->Stop();
+        _cachethread->wait();
+        delete _cachethread; // also deletes the runnable
+        _UpdateCacheJournals();
+    }
+    for(uint32 i = 0; i < CACHE_JOURNAL_COUNT; i++)
+        if(_cachejournal[i])
+            delete _cachejournal[i];
     DEBUG(logdebug("~WorldSession() this=0x%X _instance=0x%X",this,_instance));
 }
 
@@ -99,6 +119,7 @@ void WorldSession::SetMustDie(void)
 void WorldSession::Start(void)
 {
     log("Connecting to '%s' on port %u",GetInstance()->GetConf()->worldhost.c_str(),GetInstance()->GetConf()->worldport);
+    _queries.Clear(); // nothing sent over an earlier connection will be answered on this one
     _socket=new WorldSocket(_sh,this);
     _socket->Open(GetInstance()->GetConf()->worldhost,GetInstance()->GetConf()->worldport);
     _sh.Add(_socket);
@@ -115,12 +136,44 @@ void WorldSession::Start(void)
 
 void WorldSession::_LoadCache(void)
 {
+    if(_cachethread)
+        return; // already loaded, this was not the first login of this session
     logdetail("Loading Cache...");
-    plrNameCache.ReadFromFile(); // load names/guids of known players
+    PlayerNameCache_InsertDataToSession(this);
     ItemProtoCache_InsertDataToSession(this);
     CreatureTemplateCache_InsertDataToSession(this);
     GOTemplateCache_InsertDataToSession(this);
+    NonexistentCache_InsertDataToSession(this);
     //...
+
+    // new cache entries are written by this thread while we go on
+    _cacherunnable = new CacheJournalRunnable();
+    for(uint32 i = 0; i < CACHE_JOURNAL_COUNT; i++)
+        _cacherunnable->Add(_cachejournal[i]);
+    _cachethread = new ZThread::Thread(_cacherunnable);
+}
+
+// merge all journals into their cache files now. happens in the background, see _UpdateCacheJournals()
+void WorldSession::SaveCache(void)
+{
+    for(uint32 i = 0; i < CACHE_JOURNAL_COUNT; i++)
+        if(_cachejournal[i])
+            _cachejournal[i]->RequestCompaction();
+}
+
+// replace the cache files by the merged ones the journal thread created
+void WorldSession::_UpdateCacheJournals(void)
+{
+    _cachejournal[CACHE_PLAYERNAMES]->FinishCompaction();
+    _cachejournal[CACHE_NONEXISTENT]->FinishCompaction();
+    _cachejournal[CACHE_ITEMPROTOS]->FinishCompaction(&objmgr.GetItemProtoCacheFile());
+    _cachejournal[CACHE_CREATURETEMPLATES]->FinishCompaction(&objmgr.GetCreatureTemplateCacheFile());
+    objmgr.GetGOTemplateMutex().acquire(); // the GUI thread may load GO templates
+    _cachejournal[CACHE_GOTEMPLATES]->FinishCompaction(&objmgr.GetGOTemplateCacheFile());
+    objmgr.GetGOTemplateMutex().release();
+
+    if(GetInstance()->GetConf()->sharedCache)
+        SharedCache_Receive(this);
 }
 
 void WorldSession::AddToPktQueue(WorldPacket *pkt)
@@ -170,10 +223,25 @@ void WorldSession::Update(void)
     // now check if there are packets that couldnt be handled earlier due to missing data
     _HandleDelayedPackets();
 
+    // notify field watchers about all values changed by the packets above
+    objmgr.DispatchFieldChanges();
+
+    // pass all objects created/deleted during this tick to the scripts at once
+    objmgr.DispatchObjectEvents();
+
+    // send the queries for everything we learned about so far, as far as the rate limit allows
+    _queries.Update();
+
     _DoTimedActions();
 
+    if(_cachethread)
+        _UpdateCacheJournals();
+
     if(_world)
         _world->Update();
+
+    // positions and values are final for this tick, hand a copy over to the GUI
+    objmgr.PublishSnapshot();
 }
 
 // this func will delete the WorldPacket after it is handled!
@@ -500,7 +568,7 @@ std::string WorldSession::DumpPacket(WorldPacket& pkt, int errpos, const char *e
     return fn.str();
 }
 
-std::string WorldSession::GetOrRequestPlayerName(uint64 guid)
+std::string WorldSession::GetOrRequestPlayerName(uint64 guid, uint8 prio)
 {
     if(!guid || GUID_HIPART(guid) != HIGHGUID_PLAYER)
     {
@@ -509,13 +577,7 @@ std::string WorldSession::GetOrRequestPlayerName(uint64 guid)
     }
     std::string name = plrNameCache.GetName(guid);
     if(name.empty())
-    {
-        if(!objmgr.IsRequestedPlayerGUID(guid))
-        {
-            objmgr.AddRequestedPlayerGUID(guid);
-            SendQueryPlayerName(guid);
-        }
-    }
+        SendQueryPlayerName(guid, prio); // sent only once until answered
     return name;
 }
 
@@ -1007,7 +1069,7 @@ void WorldSession::_HandleMessageChatOpcode(WorldPacket& recvPacket)
                 {
                     logdebug("Found Item in chat message: %u",id);
                     if(objmgr.GetItemProto(id)==NULL)
-                        SendQueryItem(id,0);
+                        SendQueryItem(id,0,QUERY_PRIO_LOW);
                 }
                 else
                 {
@@ -1044,6 +1106,7 @@ void WorldSession::_HandleNameQueryResponseOpcode(WorldPacket& recvPacket)
     std::string pname;
     
     pguid = recvPacket.GetPackedGuid();
+    _queries.Done(QUERY_PLAYERNAME, pguid);
     recvPacket >> unk >> pname;
     if(pname.length()>MAX_PLAYERNAME_LENGTH || pname.length()<MIN_PLAYERNAME_LENGTH)
         return; // playernames maxlen=12, minlen=2
@@ -1706,11 +1769,13 @@ void WorldSession::_HandleCreatureQueryResponseOpcode(WorldPacket& recvPacket)
 {
     uint32 entry;
     recvPacket >> entry;
+    _queries.Done(QUERY_CREATURE, entry & ~0x80000000);
     if( (!entry) || (entry & 0x80000000) ) // last bit marks that entry is invalid / does not exist on server side
     {
         uint32 real_entry = entry & ~0x80000000;
         logerror("Creature %u does not exist!", real_entry);
         objmgr.AddNonexistentCreature(real_entry);
+        NonexistentCache_AddToJournal(this, TYPEID_UNIT, real_entry);
         return;
     }
 
@@ -1752,6 +1817,7 @@ void WorldSession::_HandleCreatureQueryResponseOpcode(WorldPacket& recvPacket)
     logdetail("%s",ss.str().c_str());
 
     objmgr.Add(ct);
+    CreatureTemplateCache_AddToJournal(this, ct);
     objmgr.AssignNameToObj(entry, TYPEID_UNIT, ct->name);
 }
 
@@ -1759,11 +1825,13 @@ void WorldSession::_HandleGameobjectQueryResponseOpcode(WorldPacket& recvPacket)
 {
     uint32 entry;
     recvPacket >> entry;
+    _queries.Done(QUERY_GAMEOBJECT, entry & ~0x80000000);
     if(entry & 0x80000000)
     {
         uint32 real_entry = entry & ~0x80000000;
         logerror("Gameobject %u does not exist!");
         objmgr.AddNonexistentGO(real_entry);
+        NonexistentCache_AddToJournal(this, TYPEID_GAMEOBJECT, real_entry);
         return;
     }
 
@@ -1793,6 +1861,7 @@ void WorldSession::_HandleGameobjectQueryResponseOpcode(WorldPacket& recvPacket)
     logdetail("%s",ss.str().c_str());
 
     objmgr.Add(go);
+    GOTemplateCache_AddToJournal(this, go);
     objmgr.AssignNameToObj(entry, TYPEID_GAMEOBJECT, go->name);
 }
 
@@ -12,7 +12,10 @@
 #include "SharedDefines.h"
 #include "ObjMgr.h"
 #include "CacheHandler.h"
+#include "QueryScheduler.h"
 #include "Opcodes.h"
+#include "WorldPacket.h"
+#include "ZCompressor.h"
 
 class WorldSocket;
 class WorldPacket;
@@ -20,6 +23,7 @@ class Channel;
 class RealmSession;
 struct OpcodeHandler;
 class World;
+class CacheJournalRunnable;
 
 struct WhoListEntry
 {
@@ -123,7 +127,7 @@ public:
     inline MyCharacter *GetMyChar(void) { ASSERT(_myGUID > 0); return (MyCharacter*)objmgr.GetObj(_myGUID); }
     inline World *GetWorld(void) { return _world; }
 
-    std::string GetOrRequestPlayerName(uint64);
+    std::string GetOrRequestPlayerName(uint64, uint8 prio = QUERY_PRIO_HIGH);
     std::string DumpPacket(WorldPacket& pkt, int errpos = -1, const char *errstr = NULL);
 
     inline uint32 GetCharsCount(void) { return _charList.size(); }
@@ -134,15 +138,16 @@ public:
 
     // CMSGConstructor
     void SendChatMessage(uint32 type, uint32 lang, std::string msg, std::string to="");
-    void SendQueryPlayerName(uint64 guid);
+    void SendQueryPlayerName(uint64 guid, uint8 prio = QUERY_PRIO_HIGH);
     void SendPing(uint32);
     void SendEmote(uint32);
-    void SendQueryItem(uint32 id, uint64 guid = 0);
+    void SendQueryItem(uint32 id, uint64 guid = 0, uint8 prio = QUERY_PRIO_NORMAL);
     void SendSetSelection(uint64);
     void SendCastSpell(uint32 spellid, bool nocheck=false);
     void SendWhoListRequest(uint32 minlvl=0, uint32 maxlvl=100, uint32 racemask=-1, uint32 classmask=-1, std::string name="", std::string guildname="", std::vector<uint32> *zonelist=NULL, std::vector<std::string> *strlist=NULL);
-    void SendQueryCreature(uint32 entry, uint64 guid = 0);
-    void SendQueryGameobject(uint32 entry, uint64 guid = 0);
+    void SendQueryCreature(uint32 entry, uint64 guid = 0, uint8 prio = QUERY_PRIO_NORMAL);
+    void SendQueryGameobject(uint32 entry, uint64 guid = 0, uint8 prio = QUERY_PRIO_NORMAL);
+    void SendQueryPacket(uint8 type, uint64 id, uint64 guid); // only used by the QueryScheduler, use the functions above
     void SendCharCreate(std::string name, uint8 race, uint8 class_, uint8 gender=0, uint8 skin=0, uint8 face=0, uint8 hairstyle=0, uint8 haircolor=0, uint8 facial=0, uint8 outfit=0);
 
     void SendGroupInvite(std::string playername);
@@ -162,6 +167,10 @@ public:
     PlayerNameCache plrNameCache;
     ObjMgr objmgr;
 
+    inline CacheJournal *GetCacheJournal(uint32 type) { return _cachejournal[type]; }
+    inline void SetCacheJournal(uint32 type, CacheJournal *j) { _cachejournal[type] = j; }
+    void SaveCache(void);
+
 
 private:
 
@@ -222,6 +231,7 @@ private:
     void _QueryObjectInfo(uint64 guid);
 
     void _LoadCache(void);
+    void _UpdateCacheJournals(void);
 
     PseuInstance *_instance;
     WorldSocket *_socket;
@@ -236,8 +246,15 @@ private:
     CharList _charList;
     uint32 _lag_ms;
     std::bitset<MAX_OPCODE_ID> _disabledOpcodes;
+    QueryScheduler _queries;
+    CacheJournal *_cachejournal[CACHE_JOURNAL_COUNT];
+    CacheJournalRunnable *_cacherunnable; // owned by _cachethread
+    ZThread::Thread *_cachethread;
 
     int32 _partyacceptexpire;
+
+    ZInflateStream _inflater; // for SMSG_COMPRESSED_UPDATE_OBJECT
+    WorldPacket _inflatedPkt;
 };
 
 #endif
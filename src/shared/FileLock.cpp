@@ -0,0 +1,149 @@
+#include "common.h"
+#include "FileLock.h"
+
+#if PLATFORM == PLATFORM_WIN32
+#   include <windows.h>
+#   include <io.h>
+#else
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/file.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <errno.h>
+#endif
+
+FileLock::FileLock()
+{
+    _file = NULL;
+    _fd = -1;
+}
+
+FileLock::~FileLock()
+{
+    Close();
+}
+
+bool FileLock::Open(const char *fn)
+{
+    Close();
+#if PLATFORM == PLATFORM_WIN32
+    HANDLE fh = CreateFile(fn, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(fh == INVALID_HANDLE_VALUE)
+        return false;
+    _file = fh;
+#else
+    _fd = open(fn, O_RDWR | O_CREAT, 0644);
+    if(_fd < 0)
+        return false;
+#endif
+    return true;
+}
+
+void FileLock::Close(void)
+{
+#if PLATFORM == PLATFORM_WIN32
+    if(_file)
+        CloseHandle((HANDLE)_file);
+#else
+    if(_fd >= 0)
+        close(_fd);
+#endif
+    _file = NULL;
+    _fd = -1;
+}
+
+bool FileLock::Lock(bool exclusive, bool wait)
+{
+    if(!IsOpen())
+        return false;
+#if PLATFORM == PLATFORM_WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    DWORD flags = (exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0) | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    return LockFileEx((HANDLE)_file, flags, 0, 1, 0, &ov) != 0;
+#else
+    int op = (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB);
+    while(flock(_fd, op))
+        if(errno != EINTR)
+            return false;
+    return true;
+#endif
+}
+
+void FileLock::Unlock(void)
+{
+    if(!IsOpen())
+        return;
+#if PLATFORM == PLATFORM_WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    UnlockFileEx((HANDLE)_file, 0, 1, 0, &ov);
+#else
+    flock(_fd, LOCK_UN);
+#endif
+}
+
+#if PLATFORM == PLATFORM_WIN32
+static bool _GetFileId(HANDLE fh, FileId& id)
+{
+    BY_HANDLE_FILE_INFORMATION info;
+    if(!GetFileInformationByHandle(fh, &info))
+        return false;
+    id.dev = info.dwVolumeSerialNumber;
+    id.ino = (uint64(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    return true;
+}
+#else
+static void _GetFileId(struct stat& st, FileId& id)
+{
+    id.dev = st.st_dev;
+    id.ino = st.st_ino;
+}
+#endif
+
+bool GetFileId(const char *fn, FileId& id)
+{
+#if PLATFORM == PLATFORM_WIN32
+    HANDLE fh = CreateFile(fn, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(fh == INVALID_HANDLE_VALUE)
+        return false;
+    bool result = _GetFileId(fh, id);
+    CloseHandle(fh);
+    return result;
+#else
+    struct stat st;
+    if(stat(fn, &st))
+        return false;
+    _GetFileId(st, id);
+    return true;
+#endif
+}
+
+bool GetFileId(FILE *fh, FileId& id)
+{
+#if PLATFORM == PLATFORM_WIN32
+    return _GetFileId((HANDLE)_get_osfhandle(_fileno(fh)), id);
+#else
+    struct stat st;
+    if(fstat(fileno(fh), &st))
+        return false;
+    _GetFileId(st, id);
+    return true;
+#endif
+}
+
+bool TruncateFile(const char *fn, uint32 size)
+{
+#if PLATFORM == PLATFORM_WIN32
+    FILE *fh = fopen(fn, "r+b");
+    if(!fh)
+        return false;
+    bool result = _chsize(_fileno(fh), size) == 0;
+    fclose(fh);
+    return result;
+#else
+    return truncate(fn, size) == 0;
+#endif
+}
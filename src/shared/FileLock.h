@@ -0,0 +1,38 @@
+#ifndef _FILELOCK_H
+#define _FILELOCK_H
+
+#include "common.h"
+
+// advisory lock on a file, to coordinate several processes working with the same files.
+// the lock file is created if needed and never deleted. the lock is released if the process dies.
+class FileLock
+{
+public:
+    FileLock();
+    ~FileLock();
+    bool Open(const char *fn);
+    void Close(void);
+    inline bool IsOpen(void) { return _file != NULL || _fd >= 0; }
+    bool Lock(bool exclusive, bool wait = true); // returns false if !wait and another process holds a conflicting lock
+    void Unlock(void);
+
+private:
+    void *_file; // platform specific handles
+    int _fd;
+};
+
+// identifies a file independent of its name, to notice when a file was replaced by another one
+struct FileId
+{
+    uint64 dev;
+    uint64 ino;
+    inline bool operator==(const FileId& other) const { return dev == other.dev && ino == other.ino; }
+    inline bool operator!=(const FileId& other) const { return !(*this == other); }
+};
+
+bool GetFileId(const char *fn, FileId& id);
+bool GetFileId(FILE *fh, FileId& id);
+
+bool TruncateFile(const char *fn, uint32 size);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include "common.h"
+
+// read-only memory mapped file. the OS loads pages only when they are accessed,
+// and the same file mapped by several processes shares the same physical memory.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    bool Open(const char *fn);
+    void Close(void);
+    inline bool IsOpen(void) { return _data != NULL; }
+    inline const uint8 *GetData(void) { return _data; }
+    inline uint32 GetSize(void) { return _size; }
+
+private:
+    const uint8 *_data;
+    uint32 _size;
+    void *_file; // platform specific handles
+    void *_mapping;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _UNORDEREDMAP_H
+#define _UNORDEREDMAP_H
+
+#include "SysDefs.h"
+
+// hash based containers. only use what std::tr1::unordered_map and stdext::hash_map have in common:
+// find(), insert(), erase(), operator[], iteration, size(), clear() - and only keys that have a default hash function
+// (integers, std::string). iteration order is undefined!
+#if COMPILER == COMPILER_MICROSOFT && _MSC_VER >= 1500 && _HAS_TR1
+#  include <unordered_map>
+#  include <unordered_set>
+#  define UNORDERED_MAP std::tr1::unordered_map
+#  define UNORDERED_SET std::tr1::unordered_set
+#elif COMPILER == COMPILER_MICROSOFT
+#  include <hash_map>
+#  include <hash_set>
+#  define UNORDERED_MAP stdext::hash_map
+#  define UNORDERED_SET stdext::hash_set
+#elif COMPILER == COMPILER_GNU || COMPILER == COMPILER_INTEL
+#  include <tr1/unordered_map>
+#  include <tr1/unordered_set>
+#  define UNORDERED_MAP std::tr1::unordered_map
+#  define UNORDERED_SET std::tr1::unordered_set
+#else
+#  include <map>
+#  include <set>
+#  define UNORDERED_MAP std::map
+#  define UNORDERED_SET std::set
+#endif
+
+#endif
@@ -123,4 +123,48 @@ void ZCompressor::clear(void)
     _real_size=0;
     _iscompressed=false;
 }
-    
+
+ZInflateStream::ZInflateStream()
+{
+    z_stream *zs = new z_stream;
+    zs->zalloc = (alloc_func)Z_NULL;
+    zs->zfree = (free_func)Z_NULL;
+    zs->opaque = (voidpf)Z_NULL;
+    zs->next_in = Z_NULL;
+    zs->avail_in = 0;
+    _zs = zs;
+    _initialized = (inflateInit((z_stream*)_zs) == Z_OK);
+    if(!_initialized)
+        logerror("ZInflateStream: inflateInit() failed!");
+}
+
+ZInflateStream::~ZInflateStream()
+{
+    if(_initialized)
+        inflateEnd((z_stream*)_zs);
+    delete (z_stream*)_zs;
+}
+
+bool ZInflateStream::Inflate(const uint8 *src, uint32 srcsize, ByteBuffer& dst, uint32 realsize)
+{
+    if(!_initialized || !srcsize || !realsize)
+        return false;
+
+    z_stream *zs = (z_stream*)_zs;
+    dst.resize(realsize); // does not free memory, so the buffer can be reused without reallocation
+    zs->next_in = (Bytef*)src;
+    zs->avail_in = (uInt)srcsize;
+    zs->next_out = (Bytef*)dst.contents();
+    zs->avail_out = (uInt)realsize;
+
+    int result = inflate(zs, Z_FINISH);
+    uint32 outsize = zs->total_out;
+    inflateReset(zs); // keep allocated state for the next call
+    if(result != Z_STREAM_END || outsize != realsize)
+    {
+        logerror("ZInflateStream: Inflate error! result=%d srcsize=%u outsize=%u realsize=%u",result,srcsize,outsize,realsize);
+        dst.clear();
+        return false;
+    }
+    return true;
+}
@@ -28,6 +28,20 @@ protected:
         
 
 
+};
+
+// keeps one zlib stream alive and inflates directly into the target buffer.
+// intended for frequently arriving compressed data, like SMSG_COMPRESSED_UPDATE_OBJECT.
+class ZInflateStream
+{
+public:
+    ZInflateStream();
+    ~ZInflateStream();
+    bool Inflate(const uint8 *src, uint32 srcsize, ByteBuffer& dst, uint32 realsize); // replaces content of dst
+
+private:
+    void *_zs; // z_stream, not exposed to keep zlib headers out of here
+    bool _initialized;
 };
 
 